@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * file     fixed-format-bench.cpp
+ * author   W Steen
+ *
+ * Linux benchmark of fixedFormat() against snprintf "%.*f", the JSONBufferWriter path,
+ * checks every value gives the same text and prints the cycles per value of each
+ * build:   g++ -std=c++17 -O2 -I../src ../src/FixedFormat.cpp fixed-format-bench.cpp -o fixed-format-bench
+ * usage:   fixed-format-bench [values] - default 1000000 random amps, volts and temperatures
+ *
+ * versions
+ * v1.0 - First release 17/10/26
+********************************************************************************/
+#include "FixedFormat.h"
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() {return __rdtsc();}
+#define CYCLE_UNIT "cycles"
+#else
+static uint64_t cycles() {return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();}
+#define CYCLE_UNIT "ns"
+#endif
+
+struct Sample {
+	double val;
+	int precision;
+};
+
+// the ranges and decimals of the doubles in the events, LA/LV 3, TMP 1, MNR 6, MNC 2
+static std::vector<Sample> makeSamples(size_t count)
+{
+	std::mt19937_64 rng(20261017);
+	std::uniform_real_distribution<float> amps(0.0f, 16.0f), volts(200.0f, 260.0f), temp(-10.0f, 80.0f), rate(0.0f, 0.01f);
+	std::vector<Sample> samples;
+	samples.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		switch (i % 5)
+		{
+			case 0: samples.push_back({(double) amps(rng), 3}); break;
+			case 1: samples.push_back({(double) volts(rng), 3}); break;
+			case 2: samples.push_back({(double) temp(rng), 1}); break;
+			case 3: samples.push_back({(double) rate(rng), 6}); break;
+			default: samples.push_back({(double) amps(rng), 2}); break;
+		}
+	}
+	return samples;
+}
+
+// values at and around rounding halves, zero, negative zero and the limits
+static size_t checkEdges()
+{
+	const double edges[] = {0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375, 1.005, 2.675, 0.0005, -0.0004, 9.995, 99.5,
+		1e15, 9.1e15, 123456789.123456789, -1e-12, 4294967296.5, NAN, INFINITY, -INFINITY};
+	size_t mismatches = 0;
+	char a[512], b[512];
+	for (double val : edges)
+	{
+		for (int precision = 0; precision <= FIXED_MAX_PRECISION + 1; precision++)
+		{
+			fixedFormatAny(val, precision, a, sizeof(a));
+			double ref = isnan(val) ? 0.0 : (isinf(val) ? (val < 0 ? -1.7976931348623157e308 : 1.7976931348623157e308) : val);
+			snprintf(b, sizeof(b), "%.*f", precision, ref);
+			if (strcmp(a, b) != 0)
+			{
+				printf("edge mismatch %.17g %d: %s %s\n", val, precision, a, b);
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1000000;
+	std::vector<Sample> samples = makeSamples(count);
+	static char a[64], b[64];
+
+	size_t mismatches = checkEdges(), fallbacks = 0;
+	for (const Sample& s : samples)
+	{
+		if (fixedFormat(s.val, s.precision, a, sizeof(a)) == 0) fallbacks++;
+		fixedFormatAny(s.val, s.precision, a, sizeof(a));
+		snprintf(b, sizeof(b), "%.*f", s.precision, s.val);
+		if (strcmp(a, b) != 0)
+		{
+			if (mismatches < 10) printf("mismatch %.17g %d: %s %s\n", s.val, s.precision, a, b);
+			mismatches++;
+		}
+	}
+
+	volatile size_t sink = 0;
+	uint64_t start = cycles();
+	for (const Sample& s : samples) sink += (size_t) snprintf(b, sizeof(b), "%.*f", s.precision, s.val);
+	uint64_t printfCycles = cycles() - start;
+
+	start = cycles();
+	for (const Sample& s : samples) sink += fixedFormatAny(s.val, s.precision, a, sizeof(a));
+	uint64_t fixedCycles = cycles() - start;
+
+	printf("values %zu mismatches %zu snprintf fallbacks %zu\n", count, mismatches, fallbacks);
+	printf("snprintf    %7.1f %s per value\n", (double) printfCycles / count, CYCLE_UNIT);
+	printf("fixedFormat %7.1f %s per value\n", (double) fixedCycles / count, CYCLE_UNIT);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * file     timestamp-bench.cpp
+ * author   W Steen
+ *
+ * Linux benchmark of TimestampCache against gmtime_r and strftime, the Time.format() path,
+ * checks every time gives the same text and prints the cycles per timestamp of each
+ * build:   g++ -std=c++17 -O2 -I../src ../src/FixedFormat.cpp timestamp-bench.cpp -o timestamp-bench
+ * usage:   timestamp-bench [times] - default 1000000 event times
+ *
+ * versions
+ * v1.0 - First release 17/10/26
+********************************************************************************/
+#include "FixedFormat.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() {return __rdtsc();}
+#define CYCLE_UNIT "cycles"
+#else
+static uint64_t cycles() {return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();}
+#define CYCLE_UNIT "ns"
+#endif
+
+#define ISO_FORMAT "%Y-%m-%dT%H:%M:%S"
+
+// Time.format() - gmtime_r of the local time, strftime and a heap String of the text
+static std::string timeFormat(int64_t t)
+{
+	time_t tt = (time_t) t;
+	struct tm calendar;
+	char text[32];
+	gmtime_r(&tt, &calendar);
+	strftime(text, sizeof(text), ISO_FORMAT, &calendar);
+	return std::string(text);
+}
+
+// event times as the device makes them, a few events in the same second, then seconds to minutes apart
+static std::vector<int64_t> makeTimes(size_t count)
+{
+	std::mt19937_64 rng(20261017);
+	std::vector<int64_t> times;
+	times.reserve(count);
+	int64_t t = 1792195200;										//2026-10-17T00:00:00
+	while (times.size() < count)
+	{
+		size_t burst = 1 + rng() % 5;
+		for (size_t i = 0; i < burst && times.size() < count; i++) times.push_back(t);
+		t += (rng() % 4 == 0) ? (int64_t) (rng() % 600) : 1;
+	}
+	return times;
+}
+
+// every second across day, month, year and leap day boundaries, then random times up to 9999
+static size_t checkTimes()
+{
+	const int64_t starts[] = {0, 951782400 - 5, 951868800 - 5, 978307200 - 5, 1709164800 - 5, 4107542400 - 5, 253402300799 - 5};
+	std::mt19937_64 rng(1);
+	TimestampCache cache;
+	char text[TIMESTAMP_LENGTH + 1];
+	size_t mismatches = 0, checked = 0;
+
+	auto check = [&](int64_t t) {
+		checked++;
+		if (cache.format(t, text, sizeof(text)) != TIMESTAMP_LENGTH || timeFormat(t) != text)
+		{
+			if (mismatches < 10) printf("mismatch %lld: %s %s\n", (long long) t, text, timeFormat(t).c_str());
+			mismatches++;
+		}
+	};
+	for (int64_t start : starts)
+	{
+		for (int64_t t = start; t <= start + 10 && t <= TIMESTAMP_MAX_TIME; t++) check(t);
+	}
+	for (int64_t t = 1792195200 - 86400; t < 1792195200 + 86400; t++) check(t);
+	for (int i = 0; i < 1000000; i++) check((int64_t) (rng() % (TIMESTAMP_MAX_TIME + 1)));
+	if (cache.format(-1, text, sizeof(text)) != 0 || cache.format(TIMESTAMP_MAX_TIME + 1, text, sizeof(text)) != 0) mismatches++;
+	printf("checked %zu times mismatches %zu\n", checked, mismatches);
+	return mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1000000;
+	std::vector<int64_t> times = makeTimes(count);
+	size_t mismatches = checkTimes();
+
+	TimestampCache cache;
+	char text[TIMESTAMP_LENGTH + 1];
+	for (int64_t t : times)
+	{
+		cache.format(t, text, sizeof(text));
+		if (timeFormat(t) != text) mismatches++;
+	}
+
+	volatile size_t sink = 0;
+	uint64_t start = cycles();
+	for (int64_t t : times) sink += timeFormat(t).length();
+	uint64_t formatCycles = cycles() - start;
+
+	TimestampCache timed;
+	start = cycles();
+	for (int64_t t : times) sink += timed.format(t, text, sizeof(text));
+	uint64_t cacheCycles = cycles() - start;
+
+	printf("times %zu mismatches %zu new dates %u same second %u\n", count, mismatches, timed.getDateCount(), timed.getReuseCount());
+	printf("Time.format    %7.1f %s per timestamp\n", (double) formatCycles / count, CYCLE_UNIT);
+	printf("TimestampCache %7.1f %s per timestamp\n", (double) cacheCycles / count, CYCLE_UNIT);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*******************************************************************************
+ * file     FixedFormat.cpp
+ * author   W Steen
+ *
+ * Library for the Zioxi Trolley 2 to format doubles as fixed point decimals straight
+ * into a buffer, giving the same text as printf "%.*f" without newlib floating point,
+ * and event timestamps without strftime or a heap String.
+ *
+ * versions
+ * v1.0 - First release fixedFormat() and FixedJSONWriter 17/10/26
+ * v1.1 - added TimestampCache for the event date 17/10/26
+********************************************************************************/
+#include "FixedFormat.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+#define FIXED_MAX_SCALED        9.0e15	//below 2^53 so the whole part and fraction of the scaled value are exact
+#define FIXED_HALF_MARGIN       4.0e-16	//relative error of val * 10^precision is under 1.2e-16, so this is safely outside it
+
+static const double fixedScale[FIXED_MAX_PRECISION + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+static const uint32_t fixedDivide[FIXED_MAX_PRECISION + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+size_t fixedFormat(double val, int precision, char* out, size_t size)
+{
+	if (isnan(val)) val = 0.0;					//as JSONWriter, NaN is not valid JSON
+	if (precision < 0 || precision > FIXED_MAX_PRECISION || isinf(val)) return 0;
+
+	bool isNegative = signbit(val);				//printf keeps the sign of values that round to zero, "-0.00"
+	double scaled = (isNegative ? -val : val) * fixedScale[precision];
+	if (scaled >= FIXED_MAX_SCALED) return 0;
+
+	// printf rounds the exact binary value half to even, the product can be half an ulp out so near a half it cannot be told here
+	double whole = floor(scaled);
+	double fraction = scaled - whole;
+	if (fabs(fraction - 0.5) <= scaled * FIXED_HALF_MARGIN) return 0;
+
+	uint64_t n = (uint64_t) whole + (fraction > 0.5 ? 1 : 0);
+	uint64_t integer = n / fixedDivide[precision];
+	uint32_t decimals = (uint32_t) (n % fixedDivide[precision]);
+
+	char text[FIXED_MAX_TEXT];
+	char* p = text + sizeof(text);				//built from the right
+	for (int i = 0; i < precision; i++)
+	{
+		*--p = (char) ('0' + decimals % 10);
+		decimals /= 10;
+	}
+	if (precision > 0) *--p = '.';
+	do
+	{
+		*--p = (char) ('0' + integer % 10);
+		integer /= 10;
+	} while (integer != 0);
+	if (isNegative) *--p = '-';
+
+	size_t length = (size_t) (text + sizeof(text) - p);
+	if (length + 1 > size) return 0;
+	for (size_t i = 0; i < length; i++) out[i] = p[i];
+	out[length] = '\0';
+	return length;
+}
+
+size_t fixedFormatAny(double val, int precision, char* out, size_t size)
+{
+	size_t length = fixedFormat(val, precision, out, size);
+	if (length != 0) return length;
+
+	if (isnan(val)) val = 0.0;
+	if (isinf(val)) val = (val < 0) ? -DBL_MAX : DBL_MAX;	//as JSONWriter
+	int n = snprintf(out, size, "%.*f", precision, val);
+	if (n < 0 || (size_t) n >= size) return 0;
+	return (size_t) n;
+}
+
+// two digits at text[pos]
+static void putTwoDigits(char* text, int pos, int32_t val)
+{
+	text[pos] = (char) ('0' + val / 10);
+	text[pos + 1] = (char) ('0' + val % 10);
+}
+
+size_t TimestampCache::format(int64_t t, char* out, size_t size)
+{
+	if (size < TIMESTAMP_LENGTH + 1 || t < 0 || t > TIMESTAMP_MAX_TIME) return 0;
+
+	if (_isValid && t == _time)
+	{
+		_reuseCount++;
+	}
+	else
+	{
+		int64_t day = t / 86400;
+		int32_t seconds = (int32_t) (t - day * 86400);
+		if (!_isValid || day != _day)
+		{
+			formatDate(day);
+			formatTime(seconds);
+		}
+		else if (t == _time + 1)
+		{
+			nextSecond();							//same day so never past 23:59:59
+		}
+		else
+		{
+			formatTime(seconds);
+		}
+		_day = day;
+		_time = t;
+		_isValid = true;
+	}
+	for (size_t i = 0; i <= TIMESTAMP_LENGTH; i++) out[i] = _text[i];
+	return TIMESTAMP_LENGTH;
+}
+
+// YYYY-MM-DDT from days since 1970, civil from days by H Hinnant, only positive days are used here
+void TimestampCache::formatDate(int64_t day)
+{
+	int64_t z = day + 719468;
+	int64_t era = z / 146097;
+	int32_t doe = (int32_t) (z - era * 146097);							//day of the 400 year era
+	int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;	//year of the era
+	int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);				//day of the year from 1 March
+	int32_t mp = (5 * doy + 2) / 153;
+	int32_t mday = doy - (153 * mp + 2) / 5 + 1;
+	int32_t month = mp < 10 ? mp + 3 : mp - 9;
+	int32_t year = (int32_t) (yoe + era * 400) + (month <= 2 ? 1 : 0);
+
+	putTwoDigits(_text, 0, year / 100);
+	putTwoDigits(_text, 2, year % 100);
+	_text[4] = '-';
+	putTwoDigits(_text, 5, month);
+	_text[7] = '-';
+	putTwoDigits(_text, 8, mday);
+	_text[10] = 'T';
+	_text[13] = ':';
+	_text[16] = ':';
+	_text[TIMESTAMP_LENGTH] = '\0';
+	_dateCount++;
+}
+
+void TimestampCache::formatTime(int32_t seconds)
+{
+	putTwoDigits(_text, 11, seconds / 3600);
+	putTwoDigits(_text, 14, (seconds / 60) % 60);
+	putTwoDigits(_text, 17, seconds % 60);
+}
+
+// add one second to the text, a digit that wraps carries into the one before it
+void TimestampCache::nextSecond()
+{
+	static const uint8_t digit[] = {18, 17, 15, 14, 12, 11};
+	static const char last[] = {'9', '5', '9', '5', '9', '2'};
+	for (size_t i = 0; i < sizeof(digit); i++)
+	{
+		if (_text[digit[i]] != last[i])
+		{
+			_text[digit[i]]++;
+			return;
+		}
+		_text[digit[i]] = '0';
+	}
+}
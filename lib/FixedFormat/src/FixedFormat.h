@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * file     FixedFormat.h
+ * author   W Steen
+ *
+ * Library for the Zioxi Trolley 2 to format doubles as fixed point decimals straight
+ * into a buffer, giving the same text as printf "%.*f" without newlib floating point,
+ * and event timestamps without strftime or a heap String.
+ * No Device OS dependencies so the same files build the benchmarks in host/.
+ *
+ * versions
+ * v1.0 - First release fixedFormat() and FixedJSONWriter 17/10/26
+ * v1.1 - added TimestampCache for the event date 17/10/26
+*
+********************************************************************************/
+#ifndef FIXEDFORMAT_H
+#define FIXEDFORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FIXED_MAX_PRECISION     9		//decimals handled, more are left to snprintf
+#define FIXED_MAX_TEXT          28		//longest text from the integer path, sign, 16 digits, point and 9 decimals
+
+// write val with precision decimals and a terminating null, returns the characters written not counting the null
+// or 0 if the text needs snprintf - too many decimals, too big, or too close to a rounding half to be sure of printf
+size_t fixedFormat(double val, int precision, char* out, size_t size);
+
+// as fixedFormat() but uses snprintf when fixedFormat() cannot, so the text always matches printf "%.*f"
+size_t fixedFormatAny(double val, int precision, char* out, size_t size);
+
+#define TIMESTAMP_LENGTH        19		//"%Y-%m-%dT%H:%M:%S" text
+#define TIMESTAMP_MAX_TIME      253402300799LL	//9999-12-31T23:59:59, later years are not 4 digits
+
+// "%Y-%m-%dT%H:%M:%S" text of a time in seconds since 1970, keeps the last text and only rewrites the date on a new day
+// and the digits that change for the next second
+class TimestampCache {
+public:
+	// write the text and a terminating null, returns TIMESTAMP_LENGTH or 0 if size is too small or t is out of range
+	size_t format(int64_t t, char* out, size_t size);
+
+	uint32_t getDateCount() const {return _dateCount;}		//dates formatted, new days and jumps
+	uint32_t getReuseCount() const {return _reuseCount;}		//calls in the same second as the last
+
+private:
+	void formatDate(int64_t day);
+	void formatTime(int32_t seconds);
+	void nextSecond();
+
+	char _text[TIMESTAMP_LENGTH + 1] = {0};
+	int64_t _time = 0;
+	int64_t _day = 0;
+	bool _isValid = false;
+	uint32_t _dateCount = 0;
+	uint32_t _reuseCount = 0;
+};
+
+#endif
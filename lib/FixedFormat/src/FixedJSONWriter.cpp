@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * file     FixedJSONWriter.cpp
+ * author   W Steen
+ *
+ * JSONBufferWriter that writes value(double, precision) with fixedFormat() rather than
+ * newlib vsnprintf, the output text is unchanged.
+ *
+ * versions
+ * v1.0 - First release 17/10/26
+********************************************************************************/
+#include "FixedJSONWriter.h"
+
+#include <stdarg.h>
+
+void FixedJSONWriter::printf(const char* fmt, ...)
+{
+	char text[FIXED_MAX_TEXT];
+	va_list args;
+	va_start(args, fmt);
+	if (strcmp(fmt, "%.*lf") == 0)
+	{
+		int precision = va_arg(args, int);
+		double val = va_arg(args, double);
+		size_t length = fixedFormat(val, precision, text, sizeof(text));
+		if (length != 0)
+		{
+			va_end(args);
+			write(text, length);
+			return;
+		}
+		va_end(args);
+		va_start(args, fmt);
+	}
+	// integers, %g and the few doubles fixedFormat() leaves, all short, the same as JSONWriter::printf()
+	int n = vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	if (n <= 0) return;
+	if ((size_t) n < sizeof(text))
+	{
+		write(text, n);
+		return;
+	}
+	char longText[n + 1];
+	va_start(args, fmt);
+	vsnprintf(longText, sizeof(longText), fmt, args);
+	va_end(args);
+	write(longText, n);
+}
@@ -0,0 +1,26 @@
+/*******************************************************************************
+ * file     FixedJSONWriter.h
+ * author   W Steen
+ *
+ * JSONBufferWriter that writes value(double, precision) with fixedFormat() rather than
+ * newlib vsnprintf, the output text is unchanged.
+ *
+ * versions
+ * v1.0 - First release 17/10/26
+********************************************************************************/
+#ifndef FIXEDJSONWRITER_H
+#define FIXEDJSONWRITER_H
+
+#include "Particle.h"
+#include "FixedFormat.h"
+
+class FixedJSONWriter : public JSONBufferWriter {
+public:
+	FixedJSONWriter(char* buf, size_t size) : JSONBufferWriter(buf, size) {}
+
+protected:
+	// JSONWriter writes all numbers through printf(), "%.*lf" is value(double, precision) and goes to fixedFormat()
+	virtual void printf(const char* fmt, ...) override;
+};
+
+#endif
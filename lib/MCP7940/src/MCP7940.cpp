@@ -620,6 +620,27 @@ uint8_t MCP7940X::getMFP() const
     return bitRead(controlRegister, MCP7940_OUT);         // MFP in manual mode, return value
 }
 
+// Sets the MFP square wave output frequency 0 = 1Hz, 1 = 4.096kHz, 2 = 8.192kHz, 3 = 32.768kHz and enables (true) or disables (false) it - returns state
+bool MCP7940X::setSQWSpeed(const uint8_t frequency, const bool state) const
+{
+    writeRegisterBit(MCP7940_CONTROL, MCP7940_SQWFS0, frequency & 0x01);
+    writeRegisterBit(MCP7940_CONTROL, MCP7940_SQWFS1, frequency & 0x02);
+    return setSQWState(state);
+}
+
+// Enables (true) or disables (false) the MFP square wave output, the alarm and manual outputs are not available while it is enabled - returns state
+bool MCP7940X::setSQWState(const bool state) const
+{
+    writeRegisterBit(MCP7940_CONTROL, MCP7940_SQWEN, state);
+    return state;
+}
+
+// returns true if the MFP square wave output is enabled
+bool MCP7940X::getSQWState() const
+{
+    return readRegisterBit(MCP7940_CONTROL, MCP7940_SQWEN);
+}
+
 /* Sets one of the 2 alarms
 *  In order to configure the alarm modules, the following steps need to be performed in order:
 *   1. Load the timekeeping registers and enable the oscillator
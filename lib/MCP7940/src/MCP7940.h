@@ -140,6 +140,9 @@ class MCP7940X
     uint8_t  weekdayWrite(const uint8_t dow) const;
     bool     setMFP(const bool value) const;
     uint8_t  getMFP() const;
+    bool     setSQWSpeed(const uint8_t frequency, const bool state = true) const;
+    bool     setSQWState(const bool state) const;
+    bool     getSQWState() const;
     bool     setAlarm(const uint8_t alarmNumber, const uint8_t alarmType, const DateTime& dt, const bool state = true) const;
     void     setAlarmPolarity(const bool polarity) const;
     DateTime getAlarm(const uint8_t alarmNumber, uint8_t& alarmType) const;
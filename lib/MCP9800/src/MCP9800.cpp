@@ -11,6 +11,7 @@
  * v1.3 - Modified as a library for the P2-PDU-base project added check for Wire already started 03/09/24 
  * v1.4 - added support for interrupt mode alert active low asserted when Ta > Tset and <Thyst
  * v1.5 - changed begin from void to uint8_t to indicate success or failure
+ * v1.6 - added split phase startConversion()/collectTemperature() and continuous conversion mode 17/10/26
 ********************************************************************************/
 #include "MCP9800.h"
 
@@ -34,26 +35,76 @@ uint8_t MCP9800::begin(uint8_t addr)
 		code = Wire.endTransmission();	//V1.5
 	}
 	_isAlertOn = false;					//V1.4
+	_isContinuous = false;				//V1.6
+	_isConverting = false;				//V1.6
 	return code;						//V1.5
 }
 
-// Read temperature from sensor
+// Read temperature from sensor - blocks for the conversion time in oneshot mode
 // returns Temperature in Celsius (int) or 0 if unsuccessful or -1 if alert active
 int MCP9800::readTemperature()
 {
-    int tempint = 0;
 	if (_isAlertOn) return MCP9800_ALERTACTIVE;             //if alert is on return special value and do not reset config values V1.4
+	if (!_isContinuous)
+	{
+		startConversion();
+		delay(MCP9800_CONVERSION_MS);                       //9 bit resolution read requires delay of >30mS
+	}
+	_isConverting = false;
+	_lastTemp = readRegister();
+	return _lastTemp;
+}
+
+// Start a oneshot conversion and return without waiting, collect the result with collectTemperature() V1.6
+// several sensors can be started together so they convert in parallel, does nothing in continuous mode
+void MCP9800::startConversion()
+{
+	if (_isAlertOn || _isContinuous) return;
     write(i2caddr, MCP9800_CONFIG_REG, SHUTDOWN);           //single read needs to be in shutdown
     write(i2caddr, MCP9800_CONFIG_REG, STARTONESHOT);       //start oneshort read
-    delay(31);                                              //9 bit resolution read requires delay of >30mS
+	_conversionStart = millis();
+	_isConverting = true;
+}
+
+// return true if the conversion started by startConversion() has had time to complete or in continuous mode V1.6
+bool MCP9800::isConversionReady()
+{
+	if (_isContinuous || !_isConverting) return true;
+	return (millis() - _conversionStart) >= MCP9800_CONVERSION_MS;
+}
+
+// Collect the temperature from a conversion started by startConversion() without waiting V1.6
+// the result stays in the sensor register after a oneshot conversion so it can be collected on any later pass
+// returns Temperature in Celsius (int), the previous result if the conversion is not yet complete or -1 if alert active
+int MCP9800::collectTemperature()
+{
+	if (_isAlertOn) return MCP9800_ALERTACTIVE;
+	if (!isConversionReady()) return _lastTemp;
+	_isConverting = false;
+	_lastTemp = readRegister();
+	return _lastTemp;
+}
+
+// Set continuous conversion (on) or oneshot shutdown mode (off) V1.6
+// in continuous mode the latest conversion is always available without starting one at the cost of higher supply current
+void MCP9800::setContinuous(bool _on)
+{
+	if (_isAlertOn) return;
+	_isContinuous = _on;
+	_isConverting = false;
+	write(i2caddr, MCP9800_CONFIG_REG, _on ? CONTINUOUS9BIT : SHUTDOWN);
+}
+
+// Read the temperature register and convert to Celsius (int) V1.6
+int MCP9800::readRegister()
+{
 	int16_t temp16 = 0;
 	uint8_t temp[2] = {0, 0};
 	read(i2caddr, MCP9800_TEMPA_REG, temp, 2);
 	temp16 = (temp[0] << 8) | temp[1];
 	int8_t highByte = (temp16 >> 8);
 	uint8_t lowByte = (temp16 & 0xFF);
-	tempint = ((highByte << 4) | (lowByte >> 4))/16;
-	return tempint;
+	return ((highByte << 4) | (lowByte >> 4))/16;
 }
 
 // Set temperature for alert to assert and hysteresis for alert to assert
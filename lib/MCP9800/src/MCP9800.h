@@ -11,6 +11,7 @@
  * v1.3 - Modified as a library for the P2-PDU-base project 03/09/24
  * v1.4 - added support for interrupt mode alert active low asserted when Ta > Tset and <Thyst
  * v1.5 - changed begin from void to uint8_t to indicate success or failure
+ * v1.6 - added split phase startConversion()/collectTemperature() and continuous conversion mode 17/10/26
 *
 ********************************************************************************/
 #ifndef MCP9800_H
@@ -22,6 +23,9 @@
 #define SHUTDOWN            0x01
 #define STARTONESHOT        0x81	//data sheet says 0x81 but 0x80 works V1.4
 #define ALERTMODE           0x02
+#define CONTINUOUS9BIT      0x00	//continuous conversion 9bit resolution V1.6
+
+#define MCP9800_CONVERSION_MS 31	//9 bit resolution conversion time is >30mS V1.6
 
 #define MCP9800_TEMPA_REG   0x00
 #define MCP9800_CONFIG_REG  0x01
@@ -36,16 +40,25 @@ public:
 
 	uint8_t begin(uint8_t address);
 	int readTemperature();
+	void startConversion();				//V1.6
+	bool isConversionReady();			//V1.6
+	int collectTemperature();			//V1.6
+	void setContinuous(bool on);		//V1.6
 	bool setTempAlert(bool on, int16_t tSet, int16_t tHyst); //V1.4
 	bool hasAlertOn(); //V1.4
 
 private:
 
+	int readRegister();					//V1.6
 	void write(uint8_t addr, uint8_t reg, uint8_t data);
 	void write16(uint8_t addr, uint8_t reg, uint8_t data0, uint8_t data1);
 	void read(uint8_t addr, uint8_t reg, uint8_t* buffer, uint8_t length);
 	uint8_t i2caddr;
 	bool _isAlertOn = false;
+	bool _isContinuous = false;			//V1.6
+	bool _isConverting = false;			//V1.6
+	uint32_t _conversionStart = 0;		//V1.6
+	int _lastTemp = 0;					//V1.6
 };
 
 #endif  //
\ No newline at end of file
@@ -38,6 +38,112 @@ PublishQueuePosix &PublishQueuePosix::withFileQueueSize(size_t size) {
     return *this; 
 }
 
+PublishQueuePosix &PublishQueuePosix::withCoalesce(unsigned long windowMs, const char *eventName, const char *excludePrefix) {
+    if (eventName && strlen(eventName) <= particle::protocol::MAX_EVENT_NAME_LENGTH) {
+        strcpy(coalesceEventName, eventName);
+    }
+    if (!excludePrefix) {
+        coalesceExclude[0] = 0;
+    }
+    else if (strlen(excludePrefix) <= particle::protocol::MAX_EVENT_NAME_LENGTH) {
+        strcpy(coalesceExclude, excludePrefix);
+    }
+    coalesceWindowMs = windowMs;
+
+    if (windowMs == 0) {
+        flushCoalesced();
+    }
+    return *this;
+}
+
+PublishQueuePosix &PublishQueuePosix::withEventPool(size_t count, size_t dataSize) {
+    if (pool || count == 0 || count > 32 || dataSize < 2 || dataSize > particle::protocol::MAX_EVENT_DATA_LENGTH + 1) {
+        _log.error("withEventPool(%u, %u) ignored", count, dataSize);
+        return *this;
+    }
+    eventDataSize = dataSize;
+    poolBlockSize = (sizeof(PublishQueueEvent) + dataSize + 3) & ~3;
+    pool = new char[count * poolBlockSize];
+    if (pool) {
+        poolCount = count;
+        poolFree = (count == 32) ? 0xffffffff : ((1UL << count) - 1);
+    }
+    return *this;
+}
+
+PublishQueueEvent *PublishQueuePosix::allocEvent() {
+    PublishQueueEvent *event = NULL;
+
+    uint32_t free = poolFree.load();
+    while (free != 0) {
+        int index = __builtin_ctz(free);
+        if (poolFree.compare_exchange_weak(free, free & ~(1UL << index))) {
+            event = (PublishQueueEvent *) (pool + index * poolBlockSize);
+            break;
+        }
+    }
+    if (!event) {
+        if (poolCount) {
+            poolMisses++;
+        }
+        event = (PublishQueueEvent *) new char[sizeof(PublishQueueEvent) + eventDataSize];
+    }
+    if (event) {
+        // eventData is eventDataSize bytes, the one byte in sizeof(PublishQueueEvent) is spare
+        memset(event, 0, sizeof(PublishQueueEvent) + eventDataSize);
+    }
+    return event;
+}
+
+void PublishQueuePosix::freeEvent(PublishQueueEvent *event) {
+    char *p = (char *) event;
+
+    if (!p) {
+        return;
+    }
+    if (pool && p >= pool && p < pool + poolCount * poolBlockSize) {
+        poolFree.fetch_or(1UL << ((p - pool) / poolBlockSize));
+    }
+    else {
+        delete[] p;
+    }
+}
+
+bool PublishQueuePosix::publishEvent(PublishQueueEvent *event, const char *eventName, PublishFlags flags) {
+    if (!event) {
+        return false;
+    }
+    if (!eventName || strlen(eventName) > particle::protocol::MAX_EVENT_NAME_LENGTH) {
+        freeEvent(event);
+        return false;
+    }
+    if (publishFilter && !publishFilter(eventName)) {
+        filtered++;
+        _log.trace("publishEvent eventName=%s discarded by filter", eventName);
+        freeEvent(event);
+        return false;
+    }
+    event->flags = flags;
+    strcpy(event->eventName, eventName);
+
+    _log.trace("publishEvent eventName=%s eventData=%s", event->eventName, event->eventData);
+
+    publishQueued(event);
+    return true;
+}
+
+bool PublishQueueBuffer::publish(const char *eventName, PublishFlags flags1, PublishFlags flags2) {
+    if (!event) {
+        return false;
+    }
+    // The composer may have filled data() to the end
+    event->eventData[PublishQueuePosix::instance().getEventDataSize() - 1] = 0;
+
+    PublishQueueEvent *queued = event;
+    event = NULL;
+    return PublishQueuePosix::instance().publishEvent(queued, eventName, flags1 | flags2);
+}
+
 void PublishQueuePosix::setup() {
     if (system_thread_get_state(nullptr) != spark::feature::ENABLED) {
         _log.error("SYSTEM_THREAD(ENABLED) is required");
@@ -57,22 +163,200 @@ void PublishQueuePosix::setup() {
     checkQueueLimits();
 
     stateHandler = &PublishQueuePosix::stateConnectWait;
+
+    if (useThread && threadHandoffSize > 0) {
+        if (os_queue_create(&handoffQueue, sizeof(PublishQueueEvent *), threadHandoffSize, 0) == 0) {
+            thread = new Thread("pubq", [this]() { threadFunction(); }, OS_THREAD_PRIORITY_DEFAULT, 3072);
+        }
+        if (!thread) {
+            _log.error("worker thread not started, using loop()");
+        }
+    }
 }
 
 void PublishQueuePosix::loop() {
+    if (thread) {
+        // The worker thread runs the state machine
+        return;
+    }
+    PublishQueueEvent *event = takeCoalesced(false);
+    if (event) {
+        queueEvent(event);
+    }
     if (stateHandler) {
         stateHandler(*this);
     }
 }
 
+void PublishQueuePosix::threadFunction() {
+    while(true) {
+        PublishQueueEvent *event = NULL;
+        if (os_queue_take(handoffQueue, &event, threadWaitMs, 0) == 0) {
+            if (event) {
+                queueEvent(event);
+            }
+            handoffCount--;
+        }
+        event = takeCoalesced(false);
+        if (event) {
+            queueEvent(event);
+        }
+        if (stateHandler) {
+            // The file queue is also used by the system event handler on reset or disconnect
+            WITH_LOCK(*this) {
+                stateHandler(*this);
+            }
+        }
+    }
+}
+
 bool PublishQueuePosix::publishCommon(const char *eventName, const char *eventData, int ttl, PublishFlags flags1, PublishFlags flags2) {
 
+    if (publishFilter && !publishFilter(eventName)) {
+        filtered++;
+        _log.trace("publishCommon eventName=%s discarded by filter", eventName);
+        return false;
+    }
+
     PublishQueueEvent *event = newRamEvent(eventName, eventData, flags1 | flags2);
     if (!event) {
         return false;
     }
     _log.trace("publishCommon eventName=%s eventData=%s", eventName, eventData ? eventData : "");
 
+    publishQueued(event);
+
+    return true;
+}
+
+void PublishQueuePosix::publishQueued(PublishQueueEvent *event) {
+    if (coalesceWindowMs) {
+        coalesceEvent(event);
+    }
+    else {
+        handOffEvent(event);
+    }
+}
+
+void PublishQueuePosix::handOffEvent(PublishQueueEvent *event) {
+    if (thread) {
+        // Hand off to the worker thread, which does any file system access
+        canSleep = false;
+        handoffCount++;
+        if (os_queue_put(handoffQueue, &event, 0, 0) == 0) {
+            return;
+        }
+        // Full, so wait for the worker thread rather than queue this event ahead of the ones still handed off.
+        // Queueing from the caller would wait for the same queue lock the worker holds during flash access.
+        handoffOverflow++;
+        _log.trace("handoff queue full, waiting for worker thread");
+        os_queue_put(handoffQueue, &event, CONCURRENT_WAIT_FOREVER, 0);
+        return;
+    }
+
+    queueEvent(event);
+}
+
+void PublishQueuePosix::coalesceEvent(PublishQueueEvent *event) {
+    // Records are separated by newlines and the name from the data by a tab, so data with either is sent on its own
+    bool canMerge = (strpbrk(event->eventData, "\t\n") == NULL);
+    if (coalesceExclude[0] && strncmp(event->eventName, coalesceExclude, strlen(coalesceExclude)) == 0) {
+        canMerge = false;
+    }
+    PublishQueueEvent *flushEvent = NULL;
+
+    os_mutex_lock(coalesceMutex);
+    if (coalesceHeld && (!canMerge || coalesceHeld->flags.value() != event->flags.value())) {
+        flushEvent = coalesceHeld;
+        coalesceHeld = NULL;
+    }
+    if (canMerge) {
+        PublishQueueEvent *merged = coalesceHeld ? newMergedEvent(coalesceHeld, event) : NULL;
+        if (merged) {
+            freeEvent(coalesceHeld);
+            freeEvent(event);
+            coalesceHeld = merged;
+            coalesceCount++;
+            coalesced++;
+        }
+        else {
+            // First event of a window, or too long to merge so the held event goes and a new window opens
+            flushEvent = coalesceHeld;
+            coalesceHeld = event;
+            coalesceCount = 1;
+            coalesceStart = millis();
+        }
+        event = NULL;
+        canSleep = false;
+    }
+    os_mutex_unlock(coalesceMutex);
+
+    if (flushEvent) {
+        handOffEvent(flushEvent);
+    }
+    if (event) {
+        handOffEvent(event);
+    }
+}
+
+PublishQueueEvent *PublishQueuePosix::newMergedEvent(const PublishQueueEvent *held, const PublishQueueEvent *event) {
+    size_t heldLen = strlen(held->eventData);
+    size_t recordLen = strlen(event->eventName) + 1 + strlen(event->eventData);
+    size_t len;
+
+    if (coalesceCount == 1) {
+        // The held event is still the original, it becomes the first record
+        len = strlen(held->eventName) + 1 + heldLen + 1 + recordLen;
+    }
+    else {
+        len = heldLen + 1 + recordLen;
+    }
+    if (len > particle::protocol::MAX_EVENT_DATA_LENGTH) {
+        return NULL;
+    }
+
+    PublishQueueEvent *merged = (PublishQueueEvent *) new char[sizeof(PublishQueueEvent) + len];
+    if (merged) {
+        merged->flags = held->flags;
+        strcpy(merged->eventName, coalesceEventName);
+        if (coalesceCount == 1) {
+            snprintf(merged->eventData, len + 1, "%s\t%s\n%s\t%s", held->eventName, held->eventData, event->eventName, event->eventData);
+        }
+        else {
+            snprintf(merged->eventData, len + 1, "%s\n%s\t%s", held->eventData, event->eventName, event->eventData);
+        }
+    }
+    return merged;
+}
+
+PublishQueueEvent *PublishQueuePosix::takeCoalesced(bool force) {
+    PublishQueueEvent *event = NULL;
+
+    if (!coalesceHeld) {
+        return NULL;
+    }
+    os_mutex_lock(coalesceMutex);
+    if (coalesceHeld && (force || millis() - coalesceStart >= coalesceWindowMs)) {
+        event = coalesceHeld;
+        coalesceHeld = NULL;
+        _log.trace("coalesced %u events into %s", coalesceCount, event->eventName);
+    }
+    os_mutex_unlock(coalesceMutex);
+    return event;
+}
+
+void PublishQueuePosix::flushCoalesced() {
+    PublishQueueEvent *event = takeCoalesced(true);
+    if (event) {
+        WITH_LOCK(*this) {
+            // The held event is newer than any still on the handoff queue
+            drainHandoffQueue();
+            ramQueue.push_back(event);
+        }
+    }
+}
+
+void PublishQueuePosix::queueEvent(PublishQueueEvent *event) {
     WITH_LOCK(*this) {
         ramQueue.push_back(event);
 
@@ -89,9 +373,21 @@ bool PublishQueuePosix::publishCommon(const char *eventName, const char *eventDa
         }
         checkQueueLimits();
     }
+}
 
-
-    return true;
+void PublishQueuePosix::drainHandoffQueue() {
+    if (!handoffQueue) {
+        return;
+    }
+    WITH_LOCK(*this) {
+        PublishQueueEvent *event = NULL;
+        while(os_queue_take(handoffQueue, &event, 0, 0) == 0) {
+            handoffCount--;
+            if (event) {
+                ramQueue.push_back(event);
+            }
+        }
+    }
 }
 
 PublishQueueEvent *PublishQueuePosix::newRamEvent(const char *eventName, const char *eventData, PublishFlags flags) {
@@ -120,6 +416,9 @@ PublishQueueEvent *PublishQueuePosix::newRamEvent(const char *eventName, const c
 void PublishQueuePosix::writeQueueToFiles() {
 
     WITH_LOCK(*this) {
+        // Events still on the handoff queue are newer than those in the RAM queue
+        drainHandoffQueue();
+
         while(!ramQueue.empty()) {
             PublishQueueEvent *event = ramQueue.front();
             ramQueue.pop_front();
@@ -143,7 +442,7 @@ void PublishQueuePosix::writeQueueToFiles() {
             }
             fileQueue.addFileToQueue(fileNum);
 
-            delete event;
+            freeEvent(event);
         }
     }
 }
@@ -180,7 +479,7 @@ PublishQueueEvent *PublishQueuePosix::readQueueFile(int fileNum) {
                 }
                 else {
                     _log.trace("readQueueFile %d corrupted event name or data", fileNum);
-                    delete result;
+                    freeEvent(result);
                     result = NULL;
                 }
 
@@ -195,12 +494,16 @@ PublishQueueEvent *PublishQueuePosix::readQueueFile(int fileNum) {
 }
 
 void PublishQueuePosix::clearQueues() {
+    freeEvent(takeCoalesced(true));
+
     WITH_LOCK(*this) {
+        drainHandoffQueue();
+
         while(!ramQueue.empty()) {
             PublishQueueEvent *event = ramQueue.front();
             ramQueue.pop_front();
 
-            delete event;
+            freeEvent(event);
         }
 
         fileQueue.removeAll(true);
@@ -256,6 +559,12 @@ size_t PublishQueuePosix::getNumEvents() {
                 result++;
             }
         }
+        if (handoffCount > 0) {
+            result += handoffCount;
+        }
+        if (coalesceHeld) {
+            result++;
+        }
     }
     return result;
 }
@@ -335,8 +644,8 @@ void PublishQueuePosix::stateWait() {
         }
     }
     else {
-        // No events, can sleep
-        canSleep = true;
+        // No events, can sleep unless one has been handed off or is held for the coalescing window
+        canSleep = (handoffCount == 0 && !coalesceHeld);
     }
 }
 void PublishQueuePosix::statePublishWait() {
@@ -359,7 +668,7 @@ void PublishQueuePosix::statePublishWait() {
             curFileNum = 0;
         }
 
-        delete curEvent;
+        freeEvent(curEvent);
         curEvent = NULL;
         durationMs = waitBetweenPublish;
     }
@@ -371,7 +680,7 @@ void PublishQueuePosix::statePublishWait() {
 
         if (curFileNum) {
             // Was from the file-based queue
-            delete curEvent;
+            freeEvent(curEvent);
             curEvent = NULL;
         }
         else {
@@ -390,8 +699,9 @@ void PublishQueuePosix::statePublishWait() {
 }
 
 
-PublishQueuePosix::PublishQueuePosix() {
+PublishQueuePosix::PublishQueuePosix() : canSleep(false), filtered(0), handoffCount(0), poolFree(0), poolMisses(0) {
     fileQueue.withDirPath("/usr/pubqueue");
+    os_mutex_create(&coalesceMutex);
 }
 
 PublishQueuePosix::~PublishQueuePosix() {
@@ -401,6 +711,7 @@ PublishQueuePosix::~PublishQueuePosix() {
 void PublishQueuePosix::systemEventHandler(system_event_t event, int param) {
     if ((event == reset) || ((event == cloud_status) && (param == cloud_status_disconnecting))) {
         _log.trace("reset or disconnect event, save files to queue");
+        PublishQueuePosix::instance().flushCoalesced();
         PublishQueuePosix::instance().writeQueueToFiles();
     }
 }
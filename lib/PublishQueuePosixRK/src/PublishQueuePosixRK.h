@@ -7,6 +7,7 @@
 #include "Particle.h"
 #include "SequentialFileRK.h"
 
+#include <atomic>
 #include <deque>
 
 /**
@@ -134,6 +135,124 @@ public:
     PublishQueuePosix &withPublishCompleteUserCallback(std::function<void(bool succeeded, const char *eventName, const char *eventData)> cb) { publishCompleteUserCallback = cb; return *this; };
 
 
+    /**
+     * @brief Run the queue state machine and all file system access on a worker thread (default is off)
+     *
+     * @param enable true to start the worker thread from setup()
+     * @param handoffSize The number of events publish() can hand to the worker thread before it
+     * has to wait for the worker (default is 8)
+     *
+     * Must be called before setup(). With the worker thread, publish() only allocates the event and
+     * puts it on a bounded handoff queue, so flash open/write/close latency is not added to the
+     * caller. If the handoff queue is full publish() waits for space, so events are neither lost
+     * nor queued out of order. loop() does nothing when the worker thread is enabled.
+     */
+    PublishQueuePosix &withThread(bool enable = true, size_t handoffSize = 8) { useThread = enable; threadHandoffSize = handoffSize; return *this; };
+
+    /**
+     * @brief Returns true if the worker thread is running
+     */
+    bool getUseThread() const { return thread != NULL; };
+
+    /**
+     * @brief Gets the number of times publish() waited for the worker thread because the handoff queue was full
+     */
+    uint32_t getHandoffOverflow() const { return handoffOverflow; };
+
+    /**
+     * @brief Merge events published close together into one multi-record event (default is off)
+     *
+     * @param windowMs How long the first event is held for others to join it, 0 to turn off
+     * @param eventName Name of the multi-record event (default is "MREC")
+     * @param excludePrefix Events whose name starts with this are never merged (default is none)
+     *
+     * Events published before the window closes with the same flags are merged into one event, so a
+     * burst is one flash file and one publish. The data is one record per line with the original event
+     * name and data separated by a tab: "name1\tdata1\nname2\tdata2". If only one event was published
+     * in the window it is queued unchanged. An event that would make the data too long closes the window
+     * early and starts a new one. Events whose data contains a tab or newline are never merged. The
+     * backend splits the data on newlines and each line on its first tab. An excluded event is queued
+     * on its own after the held event, so integrations that match on its name still see it and the
+     * order is kept.
+     */
+    PublishQueuePosix &withCoalesce(unsigned long windowMs, const char *eventName = "MREC", const char *excludePrefix = NULL);
+
+    /**
+     * @brief Gets the coalescing window set using withCoalesce(), 0 if off
+     */
+    unsigned long getCoalesceWindow() const { return coalesceWindowMs; };
+
+    /**
+     * @brief Gets the number of events merged into a multi-record event, the publishes saved
+     */
+    uint32_t getCoalesced() const { return coalesced; };
+
+    /**
+     * @brief Queue an event held for the coalescing window now
+     */
+    void flushCoalesced();
+
+    /**
+     * @brief Sets a function that decides whether each published event is queued (default is none)
+     *
+     * @param filter Function or C++ lambda, bool filter(const char *eventName), return false to discard the event
+     *
+     * The filter is called by publish() and PublishQueueBuffer::publish() on the thread that publishes, before the
+     * event is coalesced, so multi-record events are not filtered again. A discarded event makes publish() return false.
+     */
+    PublishQueuePosix &withPublishFilter(std::function<bool(const char *eventName)> filter) { publishFilter = filter; return *this; };
+
+    /**
+     * @brief Gets the number of events discarded by the publish filter
+     */
+    uint32_t getFiltered() const { return filtered; };
+
+    /**
+     * @brief Sets a fixed pool of event buffers for PublishQueueBuffer (default is none)
+     *
+     * @param count The number of buffers, 1 to 32
+     * @param dataSize The event data size of each buffer including the null terminator
+     *
+     * The pool is allocated once here. PublishQueueBuffer takes a buffer from the pool, the event data is composed in
+     * it and it is queued as the event itself, so it is not copied again. It goes back to the pool when the event has
+     * been written to a file, published or discarded. When all buffers are in use a buffer of the same size comes
+     * from the heap. Call this before setup() and before any PublishQueueBuffer is made.
+     */
+    PublishQueuePosix &withEventPool(size_t count, size_t dataSize);
+
+    /**
+     * @brief Gets the event data size of PublishQueueBuffer buffers, including the null terminator
+     */
+    size_t getEventDataSize() const { return eventDataSize; };
+
+    /**
+     * @brief Gets the number of PublishQueueBuffer buffers that came from the heap because the pool was in use
+     */
+    uint32_t getPoolMisses() const { return poolMisses; };
+
+    /**
+     * @brief Takes an event buffer from the pool, or the heap if the pool is in use, with zero filled data
+     *
+     * Safe to call from any thread. May return NULL if out of memory. Use PublishQueueBuffer rather than calling this.
+     */
+    PublishQueueEvent *allocEvent();
+
+    /**
+     * @brief Returns an event to the pool, or deletes it if it came from the heap
+     */
+    void freeEvent(PublishQueueEvent *event);
+
+    /**
+     * @brief Queues an event from allocEvent() with its data already composed, without copying it
+     *
+     * @param event The event, it is owned by the queue after this call even if false is returned
+     * @param eventName The name of the event (63 character maximum)
+     * @param flags NO_ACK or WITH_ACK, PRIVATE can be used
+     *
+     * @return true if the event was queued or false if the name is too long
+     */
+    bool publishEvent(PublishQueueEvent *event, const char *eventName, PublishFlags flags);
+
     /**
      * @brief You must call this from setup() to initialize this library
      */
@@ -361,6 +480,53 @@ protected:
      */
     PublishQueueEvent *readQueueFile(int fileNum);
 
+    /**
+     * @brief Add an event to the RAM queue, moving the queue to files if needed
+     * @param event The event to queue, it is owned by the queue after this call
+     */
+    void queueEvent(PublishQueueEvent *event);
+
+    /**
+     * @brief Queue an event from publish() or publishEvent(), coalescing it if that is on
+     * @param event The event to queue, it is owned by the queue after this call
+     */
+    void publishQueued(PublishQueueEvent *event);
+
+    /**
+     * @brief Queue an event from publish(), handing it to the worker thread if there is one
+     * @param event The event to queue, it is owned by the queue after this call
+     */
+    void handOffEvent(PublishQueueEvent *event);
+
+    /**
+     * @brief Hold an event for the coalescing window, merging it with the held event if possible
+     * @param event The event, it is owned by the queue after this call
+     */
+    void coalesceEvent(PublishQueueEvent *event);
+
+    /**
+     * @brief Make a multi-record event from the held event and another event
+     *
+     * Returns NULL if the merged data would be too long or out of memory. You must delete the result
+     * from this method when you are done using it.
+     */
+    PublishQueueEvent *newMergedEvent(const PublishQueueEvent *held, const PublishQueueEvent *event);
+
+    /**
+     * @brief Take the held event if the coalescing window has closed or force is true, NULL if none
+     */
+    PublishQueueEvent *takeCoalesced(bool force);
+
+    /**
+     * @brief Move any events on the handoff queue to the end of the RAM queue
+     */
+    void drainHandoffQueue();
+
+    /**
+     * @brief Worker thread function, queues handed off events and runs the state machine
+     */
+    void threadFunction();
+
     /**
      * @brief Callback for BackgroundPublishRK library
      */
@@ -409,7 +575,7 @@ protected:
     bool publishComplete = false; //!< true if the publish has completed (successfully or not)
     bool publishSuccess = false; //!< true if the publish succeeded
     bool pausePublishing = false; //!< flag to pause publishing (used from automated test)
-    bool canSleep = false; //!< returns true if this is a good time to go to sleep
+    std::atomic<bool> canSleep; //!< returns true if this is a good time to go to sleep, written by publish() and the worker thread
 
     unsigned long waitAfterConnect = 2000; //!< time to wait after Particle.connected() before publishing
     unsigned long waitBetweenPublish = 1000; //!< how long to wait in milliseconds between publishes
@@ -419,9 +585,75 @@ protected:
 
     std::function<void(PublishQueuePosix&)> stateHandler = 0; //!< state handler (stateConnectWait, stateWait, etc).
 
+    std::function<bool(const char *eventName)> publishFilter = 0; //!< publish filter, false to discard the event
+    std::atomic<uint32_t> filtered; //!< events discarded by publishFilter
+
+    bool useThread = false; //!< start the worker thread from setup()
+    size_t threadHandoffSize = 8; //!< size of the handoff queue from publish() to the worker thread
+    unsigned long threadWaitMs = 20; //!< how long the worker thread waits for a handed off event before running the state machine
+    Thread *thread = NULL; //!< worker thread, NULL when not used
+    os_queue_t handoffQueue = NULL; //!< events from publish() not yet queued by the worker thread
+    std::atomic<int> handoffCount; //!< number of events in handoffQueue
+    uint32_t handoffOverflow = 0; //!< times publish() waited because handoffQueue was full
+
+    unsigned long coalesceWindowMs = 0; //!< how long an event is held for others to join it, 0 for off
+    char coalesceEventName[particle::protocol::MAX_EVENT_NAME_LENGTH + 1] = "MREC"; //!< name of the multi-record event
+    char coalesceExclude[particle::protocol::MAX_EVENT_NAME_LENGTH + 1] = ""; //!< events whose name starts with this are not merged, "" for none
+    os_mutex_t coalesceMutex = 0; //!< mutex for the held event, publish() and the worker thread both use it
+    PublishQueueEvent *coalesceHeld = NULL; //!< event held for the coalescing window, NULL if none
+    size_t coalesceCount = 0; //!< number of events in coalesceHeld
+    unsigned long coalesceStart = 0; //!< millis() value when the window opened
+    uint32_t coalesced = 0; //!< events merged into a multi-record event
+
+    char *pool = NULL; //!< event buffers for PublishQueueBuffer, poolCount of poolBlockSize bytes
+    size_t poolCount = 0; //!< number of buffers in pool
+    size_t poolBlockSize = 0; //!< bytes per buffer, the PublishQueueEvent header and eventDataSize bytes of data
+    size_t eventDataSize = particle::protocol::MAX_EVENT_DATA_LENGTH + 1; //!< data size of PublishQueueBuffer buffers including the null
+    std::atomic<uint32_t> poolFree; //!< bit set for each free buffer in pool
+    std::atomic<uint32_t> poolMisses; //!< buffers from the heap because the pool was in use
+
     static void systemEventHandler(system_event_t event, int param); //!< system event handler, used to detect reset events
 
     static PublishQueuePosix *_instance; //!< singleton instance of this class
 };
 
+/**
+ * @brief Buffer to compose the data of one event in, from the PublishQueuePosix event pool
+ *
+ * Compose the event data in data(), which has size() zero filled bytes, then call publish(). The buffer is queued as
+ * the event, so the data is not copied again. If publish() is not called the buffer goes back to the pool when this
+ * object goes out of scope. Each producer has its own buffer, so events can be composed from any thread.
+ *
+ * If out of memory data() is a single zero byte and publish() returns false.
+ */
+class PublishQueueBuffer {
+public:
+    PublishQueueBuffer() : event(PublishQueuePosix::instance().allocEvent()) {};
+    ~PublishQueueBuffer() { if (event) PublishQueuePosix::instance().freeEvent(event); };
+
+    /**
+     * @brief The event data to compose, size() bytes
+     */
+    char *data() { return event ? event->eventData : none; };
+
+    /**
+     * @brief Size of data() including the null terminator
+     */
+    size_t size() const { return event ? PublishQueuePosix::instance().getEventDataSize() : 1; };
+
+    /**
+     * @brief Queue the composed data as an event, the buffer is owned by the queue after this
+     *
+     * @return true if the event was queued
+     */
+    bool publish(const char *eventName, PublishFlags flags1, PublishFlags flags2 = PublishFlags());
+
+    PublishQueueBuffer(const PublishQueueBuffer&) = delete; //!< This class is not copyable
+    PublishQueueBuffer& operator=(const PublishQueueBuffer&) = delete; //!< This class is not copyable
+
+protected:
+    PublishQueueEvent *event; //!< the event from the pool, NULL once published
+    char none[1] = {0}; //!< data() if out of memory
+};
+
 #endif /* __PUBLISHQUEUEPOSIXRK_H */
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * file     relay-event-check.cpp
+ * author   W Steen
+ *
+ * Linux check of the relay on and off events - renders every row of relayOnSchema
+ * and relayOffSchema with fixed values, one line per context, and compares them
+ * with the expected lines in relay-events.txt
+ * build:   g++ -std=c++17 -I../src relay-event-check.cpp -o relay-event-check
+ * usage:   relay-event-check [expected] - prints the events, with a file of expected lines
+ *          reports each difference and exits 1 if there are any
+ *
+ * versions
+ * v1.0 - First release 17/10/26
+********************************************************************************/
+#include "RelayEventSchema.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// the JSONWriter calls used by renderRelayEvent() writing the same text as Device OS JSONBufferWriter
+class HostJSONWriter {
+public:
+	HostJSONWriter& beginObject() {separate(); text += '{'; isFirst = true; return *this;}
+	HostJSONWriter& endObject() {text += '}'; isFirst = false; return *this;}
+	HostJSONWriter& beginArray() {separate(); text += '['; isFirst = true; return *this;}
+	HostJSONWriter& endArray() {text += ']'; isFirst = false; return *this;}
+	HostJSONWriter& name(const char* name) {separate(); quoted(name); text += ':'; isName = true; return *this;}
+	HostJSONWriter& value(int val) {char num[16]; snprintf(num, sizeof(num), "%d", val); separate(); text += num; return *this;}
+	HostJSONWriter& value(double val, int precision) {char num[64]; snprintf(num, sizeof(num), "%.*lf", precision, val); separate(); text += num; return *this;}
+	HostJSONWriter& value(const char* val) {separate(); quoted(val); return *this;}
+	HostJSONWriter& nullValue() {separate(); text += "null"; return *this;}
+
+	std::string text;
+
+private:
+	void separate() {if (isName) isName = false; else if (!isFirst) text += ','; isFirst = false;}
+	void quoted(const char* s) {text += '"'; for (; *s; s++) {if (*s == '"' || *s == '\\') text += '\\'; text += *s;} text += '"';}
+
+	bool isFirst = true;
+	bool isName = false;
+};
+
+static void renderTable(const char* table, const EventSchema* schema, size_t n, bool isHubPorts, std::vector<std::string>& lines)
+{
+	static const char lvsun[4][17] = {"OOOO", "GGOO", "RRRR", "OOOG"};
+	for (size_t i = 0; i < n; i++)
+	{
+		EventValues values = {"2026-10-17T12:34:56", W_CHARGED_ON, W_CHARGING, 1.2345f, 230.4f, 42, 41, 600, 28.34f, C_RATE_CHARGING, nullptr};
+		if (isHubPorts) values.lvsun = lvsun;
+		HostJSONWriter writer;
+		renderRelayEvent(writer, schema[i], values);
+		char head[48];
+		snprintf(head, sizeof(head), "%s %d %s ", table, schema[i].context, schema[i].event);
+		lines.push_back(head + (writer.text.empty() ? std::string("(empty)") : writer.text));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> lines;
+	renderTable("on", relayOnSchema, sizeof(relayOnSchema) / sizeof(relayOnSchema[0]), false, lines);
+	renderTable("off", relayOffSchema, sizeof(relayOffSchema) / sizeof(relayOffSchema[0]), true, lines);
+
+	if (argc < 2)
+	{
+		for (const std::string& line : lines) printf("%s\n", line.c_str());
+		return 0;
+	}
+
+	FILE* fp = fopen(argv[1], "r");
+	if (fp == nullptr)
+	{
+		fprintf(stderr, "relay-event-check: cannot open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<std::string> expected;
+	char buf[1024];
+	while (fgets(buf, sizeof(buf), fp) != nullptr)
+	{
+		size_t length = strlen(buf);
+		while (length > 0 && (buf[length - 1] == '\n' || buf[length - 1] == '\r')) buf[--length] = 0;
+		if (length > 0) expected.push_back(buf);
+	}
+	fclose(fp);
+
+	int differences = 0;
+	for (size_t i = 0; i < lines.size() || i < expected.size(); i++)
+	{
+		const char* got = i < lines.size() ? lines[i].c_str() : "(none)";
+		const char* want = i < expected.size() ? expected[i].c_str() : "(none)";
+		if (strcmp(got, want) == 0) continue;
+		printf("line %u\n  expected %s\n  rendered %s\n", (unsigned) (i + 1), want, got);
+		differences++;
+	}
+	printf("checked %u events differences %d\n", (unsigned) lines.size(), differences);
+	return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+/*******************************************************************************
+ * file     RelayEventSchema.h
+ * author   W Steen
+ *
+ * The Zioxi Trolley 2 relay on and off events - the ACRelaysOn() and ACRelaysOff()
+ * contexts, the onView and KL values they report, the event names and one schema
+ * row per context. Included by the application and by the host check in host/.
+ *
+ * versions
+ * v1.0 - First release, moved from the application 17/10/26
+*
+********************************************************************************/
+#ifndef RELAYEVENTSCHEMA_H
+#define RELAYEVENTSCHEMA_H
+
+#include "RelayEvents.h"
+
+// charge state values (KL)
+enum ChargeState {
+	C_NOT_CHARGING = 0,  //not charging
+	C_CHARGING = 1,      //charging or warm-up charging
+	C_CHARGING_FULL = 2, //full rate charging-warm up ended V130
+	C_RATE_CHARGING = 7, //rate monitoring
+	//C_RATE_CHARGING_PLUS = 8, //confirmed rate monitoring V130 removed
+	C_CHARGING_DONE = 9, //rate monitoring slope < target or time expired
+	C_CHARGING_ENDED = 10 //charging stopped after extra time
+};
+// onView web app RunState values
+#define W_STANDBY               1 
+#define W_TIMED_ON              3 
+#define W_AUTO_OFF              4 
+#define W_AUTO_ON               5
+#define W_ON                    6
+#define W_SLEEPING              7 
+#define W_CHARGED_ON            8 
+#define W_CHARGED_ON_AUTO       9
+#define W_CHARGED_ON_USBC       15
+#define W_CHARGED_ON_USBC_AUTO  16
+
+// onView web app PowerState values
+#define W_MAINS_OFF             100
+#define W_MAINS_ON              101
+#define W_CHARGING              105
+#define W_RESUME                200
+
+// context values for ACRelaysOn and ACRelaysOff
+#define R_NONE  88                          //relay no message
+#define R_AUTO  10                          //auto - start/ended under schedule control
+#define X_AUTO  12                          //suspend auto - mains power removed or overheated/resume start
+#define T_AUTO  13                          //auto - ended no valid time
+#define W_AUTO  15                          //stopped auto charging - web command
+#define R_TIMED 20                          //timed on relay message/timed end
+#define X_TIMED 22                          //exit timed on because mains power removed/resume start
+#define Z_TIMED 23                          //stop timed on because scheduled start of on until charged
+#define W_TIMED 24                          //stop timed on by web command
+#define R_ONC   30                          //continuous charge - start
+#define X_ONC   32                          //suspend continuous charge - mains power removed/resume start
+#define Z_ONC   33                          //stop continuous charge - scheduled start of auto on until charged
+#define M_ONC   34                          //stop continuous charge - maximum charge time reached
+#define W_ONC   35                          //stop continuous charge by web command
+#define R_ONTIL 40                          //on til charged relay message - normal soft start
+#define X_ONTIL 42                          //suspend on until charged - mains power removed/resume start
+#define M_ONTIL 44                          //on til charged relay stop - maximum charge time reached
+#define W_ONTIL 45                          //auto OuC exit by web command
+#define Z_ONTIL 46                          //stop OuC charge - scheduled start of auto on until charged
+#define R_USBC  50                          //USBC charge relay message - normal soft start
+#define X_USBC  52                          //suspend USBC charge - mains power removed/resume start
+#define M_USBC  54                          //USBC charge relay stop - maximum charge time reached
+#define W_USBC  55                          //stop USBC charge by web command
+#define Z_USBC  56                          //stop USBC charge - scheduled start of auto on until charged
+
+#define AUTOANDOFF 99                       //special prevrunstate value to signal auto off message needs to be sent
+
+// relay event names, constexpr so the schema tables below are compile time constants
+constexpr const char* eventonstart    =    "CTOS";
+constexpr const char* eventonended    =    "CTOE";
+constexpr const char* eventtimerstart =    "CTTS";
+constexpr const char* eventtimerended =    "CTTE";
+constexpr const char* eventontilstart =    "CTUS";
+constexpr const char* eventontilended =    "CTUE";
+constexpr const char* eventscheduleon =    "CTSS";
+constexpr const char* eventscheduloff =    "CTSE";
+constexpr const char* eventschedulexp =    "CTSX";
+
+constexpr EventField FL_START_RESUME[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_RUNSTATE}, {"Z", ES_POWERSTATE}, {"LA", ES_AMPS, 3}, {"LV", ES_VOLTS, 3},
+	{"TMP", ES_TEMPERATURE, 1}, {nullptr, ES_END}};
+constexpr EventField FL_START_RESUME_ONTIL[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_RUNSTATE}, {"Z", ES_POWERSTATE}, {"LA", ES_AMPS, 3}, {"LV", ES_VOLTS, 3},
+	{"KL", ES_CHARGE_STATE}, {"TMP", ES_TEMPERATURE, 1}, {nullptr, ES_END}};
+constexpr EventField FL_START_AUTO[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_AUTO_ON}, {"Z", ES_POWERSTATE}, {"LA", ES_AMPS, 3}, {"LV", ES_VOLTS, 3},
+	{"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CHARGE_STATE}, {nullptr, ES_END}};
+constexpr EventField FL_START[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_RUNSTATE}, {"Z", ES_POWERSTATE}, {"LA", ES_AMPS, 3}, {"LV", ES_VOLTS, 3},
+	{"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CHARGE_STATE}, {nullptr, ES_END}};
+
+constexpr EventField FL_END_SUSPEND[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_RUNSTATE}, {"Z", ES_POWERSTATE}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"K", ES_KVALUE}, {"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CHARGE_STATE}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_STOPPED[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_STANDBY}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_MAXIMUM[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_STANDBY}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"KL", ES_CHARGE_STATE}, {"K", ES_MAX_TIME_ON}, {"TMP", ES_TEMPERATURE, 1}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_ONC[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_STANDBY}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"K", ES_CHARGE_MINS}, {"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CONST, 0, 0}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_AUTO[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_AUTO_OFF}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"K", ES_KVALUE}, {"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CONST, 0, 0}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_TIMED[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_STANDBY}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"K", ES_KVALUE}, {"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CONST, 0, 0}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_ONTIL[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_STANDBY}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"K", ES_KVALUE}, {"TMP", ES_TEMPERATURE, 1}, {"KL", ES_CONST, 0, C_CHARGING_ENDED}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+constexpr EventField FL_END_AUTOANDOFF[] = {
+	{"date", ES_DATE}, {"CX", ES_CX}, {"R", ES_CONST, 0, W_AUTO_OFF}, {"Z", ES_CONST, 0, W_MAINS_ON}, {"LA", ES_CONST_DOUBLE, 3, 0}, {"LV", ES_VOLTS, 3},
+	{"TMP", ES_TEMPERATURE, 1}, {"LV0", ES_HUB_PORTS}, {nullptr, ES_END}};
+
+// events published by helperSoftStartDone() when the soft start started by ACRelaysOn() is complete
+constexpr EventSchema relayOnSchema[] = {
+//   context    event               cx                                      fields                  isDelayDRUP
+	{X_ONC,     eventonstart,       "Resume After Suspend",                 FL_START_RESUME,        true},
+	{X_AUTO,    eventscheduleon,    "Resume After Suspend",                 FL_START_RESUME,        false},
+	{X_TIMED,   eventtimerstart,    "Resume After Suspend",                 FL_START_RESUME,        true},
+	{X_ONTIL,   eventontilstart,    "Resume Warm-up Smart AC",              FL_START_RESUME_ONTIL,  true},
+	{X_USBC,    eventontilstart,    "Resume After Suspend",                 FL_START_RESUME,        true},
+	{R_AUTO,    eventscheduleon,    "Normal Start",                         FL_START_AUTO,          false},
+	{R_ONC,     eventonstart,       "Normal Start",                         FL_START,               true},
+	{R_TIMED,   eventtimerstart,    "Normal Start",                         FL_START,               true},
+	{R_ONTIL,   eventontilstart,    "Normal Warm-up Smart AC",              FL_START,               true},
+	{R_USBC,    eventontilstart,    "Normal Start USB-C",                   FL_START,               true},
+};
+
+// events published by ACRelaysOff(), R_NONE is not in the table so nothing is published
+constexpr EventSchema relayOffSchema[] = {
+//   context    event               cx                                      fields                  isDelayDRUP
+	{X_ONC,     eventonended,       "Suspended Mains Off or Overheated",    FL_END_SUSPEND,         false},
+	{X_AUTO,    eventscheduloff,    "Suspended Mains Off or Overheated",    FL_END_SUSPEND,         false},
+	{X_TIMED,   eventtimerended,    "Suspended Mains Off or Overheated",    FL_END_SUSPEND,         false},
+	{X_ONTIL,   eventontilended,    "Suspended Mains Off or Overheated",    FL_END_SUSPEND,         false},
+	{X_USBC,    eventontilended,    "Suspended Mains Off or Overheated",    FL_END_SUSPEND,         false},
+	{Z_ONC,     eventonended,       "Stopped for Auto Smart Charge",        FL_END_STOPPED,         false},
+	{Z_TIMED,   eventtimerended,    "Stopped for Auto Smart Charge",        FL_END_STOPPED,         false},
+	{Z_ONTIL,   eventontilended,    "Stopped for Auto Smart Charge",        FL_END_STOPPED,         false},
+	{Z_USBC,    eventontilended,    "Stopped for Auto Smart Charge",        FL_END_STOPPED,         false},
+	{M_ONC,     eventonended,       nullptr,                                nullptr,                false},     //no layout, published empty as before
+	{M_ONTIL,   eventontilended,    "Stopped at Maximum Time Charging",     FL_END_MAXIMUM,         false},
+	{M_USBC,    eventontilended,    "Stopped at Maximum Time Charging",     FL_END_MAXIMUM,         false},
+	{R_ONC,     eventonended,       "Normal",                               FL_END_ONC,             false},
+	{W_ONC,     eventonended,       "Web Cmd Standby",                      FL_END_ONC,             false},
+	{R_AUTO,    eventscheduloff,    "Normal",                               FL_END_AUTO,            false},
+	{W_AUTO,    eventscheduloff,    "Web Cmd Standby",                      FL_END_AUTO,            false},
+	{R_TIMED,   eventtimerended,    "Normal Period",                        FL_END_TIMED,           false},
+	{W_TIMED,   eventtimerended,    "Web Cmd Standby",                      FL_END_TIMED,           false},
+	{R_ONTIL,   eventontilended,    "Extra time ended",                     FL_END_ONTIL,           false},
+	{W_ONTIL,   eventontilended,    "Normal end",                           FL_END_ONTIL,           false},
+	{R_USBC,    eventontilended,    "Normal end",                           FL_END_ONTIL,           false},
+	{W_USBC,    eventontilended,    "Normal end",                           FL_END_ONTIL,           false},
+	{T_AUTO,    eventschedulexp,    "Suspended as no valid time",           FL_END_STOPPED,         false},
+	{AUTOANDOFF,eventscheduloff,    "Auto Control with schedule off",       FL_END_AUTOANDOFF,      false},
+};
+
+static_assert(isEventSchemaValid(relayOnSchema, sizeof(relayOnSchema) / sizeof(relayOnSchema[0])), "relayOnSchema entries are invalid");
+static_assert(isEventSchemaValid(relayOffSchema, sizeof(relayOffSchema) / sizeof(relayOffSchema[0])), "relayOffSchema entries are invalid");
+
+#endif
@@ -0,0 +1,130 @@
+/*******************************************************************************
+ * file     RelayEvents.h
+ * author   W Steen
+ *
+ * Library for the Zioxi Trolley 2 to describe the relay on and off events as
+ * constexpr schema rows and render any row through a JSONWriter. The values are
+ * passed in by the caller and the writer is a template parameter, so there are
+ * no Device OS dependencies and the same files build the host check in host/.
+ *
+ * versions
+ * v1.0 - First release, schema types and renderer moved from the application 17/10/26
+*
+********************************************************************************/
+#ifndef RELAYEVENTS_H
+#define RELAYEVENTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// where the value of each field comes from
+typedef enum : uint8_t {
+	ES_END = 0,							//end of the field list
+	ES_DATE,							//values.date
+	ES_CX,								//cx text of the schema row
+	ES_CONST,							//constant integer value
+	ES_CONST_DOUBLE,					//constant value as a double with decimals
+	ES_RUNSTATE,						//values.runState
+	ES_POWERSTATE,						//values.powerState
+	ES_AMPS,							//values.amps
+	ES_VOLTS,							//values.volts
+	ES_KVALUE,							//values.kvalue
+	ES_CHARGE_MINS,						//values.chargeMins
+	ES_MAX_TIME_ON,						//values.maxTimeOn
+	ES_TEMPERATURE,						//values.maxtemp
+	ES_CHARGE_STATE,					//values.chargeState
+	ES_HUB_PORTS,						//values.lvsun as an array, left out if nullptr
+} EventSource_t;
+
+struct EventField {
+	const char* name;
+	uint8_t source;						//EventSource_t
+	uint8_t decimals = 0;				//for double values
+	int constant = 0;					//value for ES_CONST and ES_CONST_DOUBLE
+};
+
+struct EventSchema {
+	int context;						//ACRelaysOn() or ACRelaysOff() context
+	const char* event;					//event name published
+	const char* cx;						//CX text
+	const EventField* fields;			//ES_END terminated, nullptr for an empty event
+	bool isDelayDRUP;					//the caller delays the next DRUP after publishing
+};
+
+// values of the event being rendered, worked out by the caller
+struct EventValues {
+	const char* date;					//event date text
+	int runState;						//onView RunState
+	int powerState;						//onView PowerState
+	float amps;
+	float volts;
+	int kvalue;							//minutes worked out by ACRelaysOff() for the context
+	int chargeMins;
+	int maxTimeOn;
+	float maxtemp;						//maximum of board and external temperature
+	int chargeState;					//KL
+	const char (*lvsun)[17];			//LVSUN Hub port states of the 4 input channels, nullptr if none
+};
+
+// the schema row for a context, nullptr if the context has no event
+constexpr const EventSchema* findEventSchema(const EventSchema* table, size_t n, int context)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if (table[i].context == context) return &table[i];
+	}
+	return nullptr;
+}
+
+// compile time check of a schema table - unique contexts, an event name for every row and a cx text for every layout
+constexpr bool isEventSchemaValid(const EventSchema* table, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t j = i + 1; j < n; j++) {if (table[i].context == table[j].context) return false;}
+		if (table[i].event == nullptr) return false;
+		if (table[i].fields != nullptr && table[i].cx == nullptr) return false;
+	}
+	return true;
+}
+
+// render a schema row as a JSON object with a JSONWriter, or a writer with the same calls, nothing is written if the row has no layout
+template <class Writer>
+void renderRelayEvent(Writer& writer, const EventSchema& schema, const EventValues& values)
+{
+	if (schema.fields == nullptr) return;
+
+	writer.beginObject();
+	for (const EventField* f = schema.fields; f->source != ES_END; f++)
+	{
+		if (f->source == ES_HUB_PORTS)
+		{
+			if (values.lvsun == nullptr) continue;
+			writer.name(f->name).beginArray();
+			for (int ch = 0; ch < 4; ch++) {writer.value(ch + 1); writer.value((const char*) values.lvsun[ch]);}
+			writer.endArray();
+			continue;
+		}
+		writer.name(f->name);
+		switch (f->source)
+		{
+			case ES_DATE:			writer.value(values.date);								break;
+			case ES_CX:				writer.value(schema.cx);								break;
+			case ES_CONST:			writer.value(f->constant);								break;
+			case ES_CONST_DOUBLE:	writer.value((double) f->constant, f->decimals);		break;
+			case ES_RUNSTATE:		writer.value(values.runState);							break;
+			case ES_POWERSTATE:		writer.value(values.powerState);						break;
+			case ES_AMPS:			writer.value((double) values.amps, f->decimals);		break;
+			case ES_VOLTS:			writer.value((double) values.volts, f->decimals);		break;
+			case ES_KVALUE:			writer.value(values.kvalue);							break;
+			case ES_CHARGE_MINS:	writer.value(values.chargeMins);						break;
+			case ES_MAX_TIME_ON:	writer.value(values.maxTimeOn);							break;
+			case ES_TEMPERATURE:	writer.value((double) values.maxtemp, f->decimals);		break;
+			case ES_CHARGE_STATE:	writer.value(values.chargeState);						break;
+			default:				writer.nullValue();										break;
+		}
+	}
+	writer.endObject();
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * file     telemetry-decode.cpp
+ * author   W Steen
+ *
+ * Linux command line decoder for base85 CBOR DRUP and DEUP event data
+ * build:   g++ -std=c++17 -I../src ../src/TelemetryCBOR.cpp telemetry-decode.cpp -o telemetry-decode
+ * usage:   telemetry-decode [data ...] - one event data string per argument or per line on stdin
+ *          JSON event data is passed through unchanged
+ *
+ * versions
+ * v1.0 - First release 17/10/26
+********************************************************************************/
+#include "TelemetryCBOR.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_EVENT 1100			//publish data limit plus margin
+
+static int decodeLine(const char* data)
+{
+	static uint8_t cbor[MAX_EVENT];
+	static char json[4 * MAX_EVENT];
+
+	size_t length = strlen(data);
+	while (length > 0 && (data[length - 1] == '\n' || data[length - 1] == '\r')) length--;
+	if (length == 0) return 0;
+
+	if (data[0] != TELEMETRY_PREFIX)
+	{
+		printf("%.*s\n", (int) length, data);
+		return 0;
+	}
+
+	size_t bytes = base85Decode(data + 1, length - 1, cbor, sizeof(cbor));
+	if (bytes == 0 || !telemetryToJson(cbor, bytes, json, sizeof(json)))
+	{
+		fprintf(stderr, "telemetry-decode: cannot decode %.*s\n", (int) length, data);
+		return 1;
+	}
+	printf("%s\n", json);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	int errors = 0;
+	if (argc > 1)
+	{
+		for (int i = 1; i < argc; i++) errors += decodeLine(argv[i]);
+	}
+	else
+	{
+		static char line[4 * MAX_EVENT];
+		while (fgets(line, sizeof(line), stdin) != nullptr) errors += decodeLine(line);
+	}
+	return errors ? 1 : 0;
+}
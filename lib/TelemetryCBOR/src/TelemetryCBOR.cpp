@@ -0,0 +1,456 @@
+/*******************************************************************************
+ * file     TelemetryCBOR.cpp
+ * author   W Steen
+ *
+ * Library for the Zioxi Trolley 2 to encode DRUP and DEUP telemetry as CBOR with
+ * integer keys, wrap it in base85 for the publish API and decode it back to JSON.
+ *
+ * versions
+ * v1.0 - First release CBOR writer, base85 and JSON decoder 17/10/26
+ * v1.1 - added nullValue(), SEQ, KF and BS keys and telemetryPeekUint() for delta encoded DRUP 17/10/26
+ * v1.1.1 - value(double) NaN written as 0 and range checked before the integer test, decoder date buffer enlarged 17/10/26
+ * v1.2 - added LAS, LVS and TMS keys for the DRUP sensor statistics, the count is printed as an integer 17/10/26
+********************************************************************************/
+#include "TelemetryCBOR.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+#define CBOR_UINT       0
+#define CBOR_NINT       1
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_SIMPLE     7
+#define CBOR_FALSE      0xf4
+#define CBOR_TRUE       0xf5
+#define CBOR_NULL       0xf6
+#define CBOR_FLOAT32    0xfa
+#define CBOR_FLOAT64    0xfb
+#define CBOR_BREAK      0xff
+#define CBOR_INDEFINITE 31
+
+// DRUP and DEUP names - append only
+const TelemetryKey telemetryKeys[] = {
+//   name       decimals    kind
+	{"date",    0,          TK_KIND_TIME},
+	{"C",       0,          TK_KIND_VALUE},
+	{"R",       0,          TK_KIND_VALUE},
+	{"Z",       0,          TK_KIND_VALUE},
+	{"D",       0,          TK_KIND_VALUE},
+	{"Q",       0,          TK_KIND_VALUE},
+	{"SS",      2,          TK_KIND_VALUE},
+	{"SQ",      2,          TK_KIND_VALUE},
+	{"TMP",     1,          TK_KIND_VALUE},
+	{"AO",      0,          TK_KIND_VALUE},
+	{"KL",      0,          TK_KIND_VALUE},
+	{"MCD",     0,          TK_KIND_VALUE},
+	{"LA",      3,          TK_KIND_VALUE},
+	{"LV",      1,          TK_KIND_VALUE},
+	{"VBT",     3,          TK_KIND_VALUE},
+	{"CHG",     0,          TK_KIND_VALUE},
+	{"CHD",     0,          TK_KIND_VALUE},
+	{"BFT",     0,          TK_KIND_VALUE},
+	{"RBF",     0,          TK_KIND_VALUE},
+	{"LV0",     0,          TK_KIND_VALUE},
+	{"J",       0,          TK_KIND_VALUE},
+	{"ST",      0,          TK_KIND_VALUE},
+	{"Y",       4,          TK_KIND_VALUE},
+	{"X",       4,          TK_KIND_VALUE},
+	{"M",       0,          TK_KIND_VALUE},
+	{"W",       0,          TK_KIND_VALUE},
+	{"2",       0,          TK_KIND_VALUE},
+	{"ETH",     0,          TK_KIND_VALUE},
+	{"BLE",     0,          TK_KIND_VALUE},
+	{"CH",      0,          TK_KIND_VALUE},
+	{"SEQ",     0,          TK_KIND_VALUE},		//V1.1 DRUP sequence number
+	{"KF",      0,          TK_KIND_VALUE},		//V1.1 DRUP keyframe
+	{"BS",      0,          TK_KIND_VALUE},		//V1.1 DRUP baseline sequence number
+	{"LAS",     3,          TK_KIND_STATS},		//V1.2 DRUP current count, min, max, mean and standard deviation
+	{"LVS",     1,          TK_KIND_STATS},		//V1.2 DRUP voltage statistics
+	{"TMS",     1,          TK_KIND_STATS},		//V1.2 DRUP temperature statistics
+};
+
+const size_t telemetryKeyCount = sizeof(telemetryKeys) / sizeof(telemetryKeys[0]);
+
+static const char z85[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.-:+=^!/*?&<>()[]{}@%$#";
+
+int telemetryKeyIndex(const char* name)
+{
+	for (size_t i = 0; i < telemetryKeyCount; i++)
+	{
+		if (strcmp(telemetryKeys[i].name, name) == 0) return (int) i;
+	}
+	return -1;
+}
+
+// days since 1970-01-01 for a civil date (proleptic Gregorian)
+static int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d)
+{
+	y -= m <= 2;
+	const int32_t era = (y >= 0 ? y : y - 399) / 400;
+	const uint32_t yoe = (uint32_t) (y - era * 400);
+	const uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int32_t) doe - 719468;
+}
+
+// civil date for days since 1970-01-01
+static void civilFromDays(int32_t z, int32_t* y, uint32_t* m, uint32_t* d)
+{
+	z += 719468;
+	const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+	const uint32_t doe = (uint32_t) (z - era * 146097);
+	const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const uint32_t mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = (int32_t) yoe + era * 400 + (*m <= 2);
+}
+
+TelemetryCBOR::TelemetryCBOR(uint8_t* buffer, size_t size) : _buffer(buffer), _size(size)
+{
+}
+
+void TelemetryCBOR::writeByte(uint8_t b)
+{
+	if (_length < _size) _buffer[_length++] = b;
+	else _isOverflow = true;
+}
+
+// major type and argument in the shortest form
+void TelemetryCBOR::writeHead(uint8_t major, uint64_t val)
+{
+	major <<= 5;
+	if (val < 24) {writeByte(major | (uint8_t) val); return;}
+	int bytes = (val <= 0xff) ? 1 : (val <= 0xffff) ? 2 : (val <= 0xffffffffULL) ? 4 : 8;
+	writeByte(major | (uint8_t) (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27));
+	for (int i = bytes - 1; i >= 0; i--) writeByte((uint8_t) (val >> (8 * i)));
+}
+
+TelemetryCBOR& TelemetryCBOR::beginObject()
+{
+	writeByte((CBOR_MAP << 5) | CBOR_INDEFINITE);
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::endObject()
+{
+	writeByte(CBOR_BREAK);
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::beginArray()
+{
+	writeByte((CBOR_ARRAY << 5) | CBOR_INDEFINITE);
+	_kind = TK_KIND_VALUE;
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::endArray()
+{
+	writeByte(CBOR_BREAK);
+	return *this;
+}
+
+// schema names as the integer key, others as text so nothing is lost
+TelemetryCBOR& TelemetryCBOR::name(const char* name)
+{
+	int key = telemetryKeyIndex(name);
+	if (key >= 0)
+	{
+		writeHead(CBOR_UINT, (uint64_t) key);
+		_kind = telemetryKeys[key].kind;
+	}
+	else
+	{
+		value(name);
+		_kind = TK_KIND_VALUE;
+	}
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::value(bool val)
+{
+	writeByte(val ? CBOR_TRUE : CBOR_FALSE);
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::value(int val)
+{
+	if (val >= 0) writeHead(CBOR_UINT, (uint64_t) val);
+	else writeHead(CBOR_NINT, (uint64_t) (-1 - (int64_t) val));
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::value(unsigned val)
+{
+	writeHead(CBOR_UINT, (uint64_t) val);
+	return *this;
+}
+
+// single precision is enough for the sensor values, whole numbers are written as integers
+TelemetryCBOR& TelemetryCBOR::value(double val, int precision)
+{
+	(void) precision;							//the decoder uses the key decimals
+	if (isnan(val)) val = 0.0;					//as fixedFormat() and JSONWriter, NaN is not valid JSON
+	if (val >= (double) INT32_MIN && val <= (double) INT32_MAX && val == (double) (int32_t) val) return value((int) val);
+	if (val > FLT_MAX) val = FLT_MAX;			//out of single precision range, infinity as JSONWriter
+	else if (val < -FLT_MAX) val = -FLT_MAX;
+	float f = (float) val;
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	writeByte(CBOR_FLOAT32);
+	for (int i = 3; i >= 0; i--) writeByte((uint8_t) (bits >> (8 * i)));
+	return *this;
+}
+
+// text, or seconds since 1970 for a time key with a "%Y-%m-%dT%H:%M:%S" value
+TelemetryCBOR& TelemetryCBOR::value(const char* val)
+{
+	int y, mo, d, h, mi, s;
+	if (_kind == TK_KIND_TIME && strlen(val) == 19 && sscanf(val, "%4d-%2d-%2dT%2d:%2d:%2d", &y, &mo, &d, &h, &mi, &s) == 6)
+	{
+		int64_t t = (int64_t) daysFromCivil(y, (uint32_t) mo, (uint32_t) d) * 86400 + h * 3600 + mi * 60 + s;
+		if (t >= 0) writeHead(CBOR_UINT, (uint64_t) t);
+		else writeHead(CBOR_NINT, (uint64_t) (-1 - t));
+		_kind = TK_KIND_VALUE;
+		return *this;
+	}
+	size_t n = strlen(val);
+	writeHead(CBOR_TEXT, n);
+	for (size_t i = 0; i < n; i++) writeByte((uint8_t) val[i]);
+	_kind = TK_KIND_VALUE;
+	return *this;
+}
+
+TelemetryCBOR& TelemetryCBOR::nullValue()
+{
+	writeByte(CBOR_NULL);
+	_kind = TK_KIND_VALUE;
+	return *this;
+}
+
+size_t base85Encode(const uint8_t* in, size_t length, char* out, size_t size)
+{
+	size_t chars = (length / 4) * 5 + ((length % 4) ? (length % 4) + 1 : 0);
+	if (chars + 1 > size) return 0;
+	size_t o = 0;
+	for (size_t i = 0; i < length; i += 4)
+	{
+		size_t n = (length - i < 4) ? length - i : 4;
+		uint32_t val = 0;
+		for (size_t j = 0; j < 4; j++) val = (val << 8) | (j < n ? in[i + j] : 0);
+		char group[5];
+		for (int j = 4; j >= 0; j--) {group[j] = z85[val % 85]; val /= 85;}
+		for (size_t j = 0; j < n + 1; j++) out[o++] = group[j];
+	}
+	out[o] = '\0';
+	return o;
+}
+
+size_t base85Decode(const char* in, size_t length, uint8_t* out, size_t size)
+{
+	if (length % 5 == 1) return 0;				//not a valid partial group
+	size_t bytes = (length / 5) * 4 + ((length % 5) ? (length % 5) - 1 : 0);
+	if (bytes > size) return 0;
+	size_t o = 0;
+	for (size_t i = 0; i < length; i += 5)
+	{
+		size_t n = (length - i < 5) ? length - i : 5;
+		uint64_t val = 0;
+		for (size_t j = 0; j < 5; j++)
+		{
+			int digit = 84;						//pad a partial group with the highest digit
+			if (j < n)
+			{
+				const char* p = strchr(z85, in[i + j]);
+				if (p == nullptr || in[i + j] == '\0') return 0;
+				digit = (int) (p - z85);
+			}
+			val = val * 85 + (uint64_t) digit;
+		}
+		if (n == 5 && val > 0xffffffffULL) return 0;
+		for (size_t j = 0; j < n - 1; j++) out[o++] = (uint8_t) (val >> (24 - 8 * j));
+	}
+	return o;
+}
+
+// JSON output with overflow tracking
+struct JsonOut {
+	char* buf;
+	size_t size;
+	size_t length;
+	bool isOverflow;
+	void put(const char* s)
+	{
+		size_t n = strlen(s);
+		if (length + n + 1 > size) {isOverflow = true; return;}
+		memcpy(buf + length, s, n);
+		length += n;
+		buf[length] = '\0';
+	}
+};
+
+// CBOR reader for the subset written by TelemetryCBOR
+struct CborIn {
+	const uint8_t* p;
+	const uint8_t* end;
+	bool isError;
+	bool readHead(uint8_t* major, uint8_t* info, uint64_t* val)
+	{
+		if (p >= end) {isError = true; return false;}
+		*major = *p >> 5;
+		*info = *p & 0x1f;
+		p++;
+		*val = *info;
+		if (*info < 24 || *info == CBOR_INDEFINITE) return true;
+		int bytes = (*info == 24) ? 1 : (*info == 25) ? 2 : (*info == 26) ? 4 : (*info == 27) ? 8 : 0;
+		if (bytes == 0 || end - p < bytes) {isError = true; return false;}
+		*val = 0;
+		for (int i = 0; i < bytes; i++) *val = (*val << 8) | *p++;
+		return true;
+	}
+	bool isBreak() const {return p < end && *p == CBOR_BREAK;}
+};
+
+static void printString(JsonOut& out, const uint8_t* s, size_t n)
+{
+	out.put("\"");
+	for (size_t i = 0; i < n; i++)
+	{
+		char c[7] = {0};
+		if (s[i] == '"' || s[i] == '\\') {c[0] = '\\'; c[1] = (char) s[i];}
+		else if (s[i] < 0x20) snprintf(c, sizeof(c), "\\u%04x", s[i]);
+		else c[0] = (char) s[i];
+		out.put(c);
+	}
+	out.put("\"");
+}
+
+// one CBOR item as JSON, key is the schema entry for the enclosing name or nullptr
+static bool printItem(CborIn& in, JsonOut& out, const TelemetryKey* key, int depth)
+{
+	uint8_t major, info;
+	uint64_t val;
+	char num[80];								//room for the date with any field values so it is never truncated
+	if (depth > TELEMETRY_MAX_DEPTH || !in.readHead(&major, &info, &val)) return false;
+	switch (major)
+	{
+		case CBOR_UINT:
+		case CBOR_NINT:
+		{
+			int64_t v = (major == CBOR_UINT) ? (int64_t) val : -1 - (int64_t) val;
+			if (key != nullptr && key->kind == TK_KIND_TIME)
+			{
+				int32_t days = (int32_t) (v >= 0 ? v / 86400 : (v - 86399) / 86400);
+				int32_t secs = (int32_t) (v - (int64_t) days * 86400);
+				int32_t y; uint32_t m, d;
+				civilFromDays(days, &y, &m, &d);
+				snprintf(num, sizeof(num), "\"%04d-%02u-%02uT%02d:%02d:%02d\"", (int) y, (unsigned) m, (unsigned) d, (int) (secs / 3600), (int) ((secs / 60) % 60), (int) (secs % 60));
+			}
+			else if (key != nullptr && key->decimals > 0) snprintf(num, sizeof(num), "%.*f", key->decimals, (double) v);
+			else snprintf(num, sizeof(num), "%lld", (long long) v);
+			out.put(num);
+			return true;
+		}
+		case CBOR_TEXT:
+			if ((uint64_t) (in.end - in.p) < val) return false;
+			printString(out, in.p, (size_t) val);
+			in.p += val;
+			return true;
+		case CBOR_ARRAY:
+		{
+			out.put("[");
+			bool isFirst = true;
+			for (uint64_t i = 0; info == CBOR_INDEFINITE || i < val; i++)
+			{
+				if (info == CBOR_INDEFINITE && in.isBreak()) {in.p++; break;}
+				if (!isFirst) out.put(",");
+				isFirst = false;
+				bool isCount = (i == 0 && key != nullptr && key->kind == TK_KIND_STATS);	//the count has no decimals
+				if (!printItem(in, out, isCount ? nullptr : key, depth + 1)) return false;
+			}
+			out.put("]");
+			return true;
+		}
+		case CBOR_MAP:
+		{
+			out.put("{");
+			bool isFirst = true;
+			for (uint64_t i = 0; info == CBOR_INDEFINITE || i < val; i++)
+			{
+				if (info == CBOR_INDEFINITE && in.isBreak()) {in.p++; break;}
+				if (!isFirst) out.put(",");
+				isFirst = false;
+				uint8_t kmajor, kinfo;
+				uint64_t kval;
+				const TelemetryKey* child = nullptr;
+				if (!in.readHead(&kmajor, &kinfo, &kval)) return false;
+				if (kmajor == CBOR_UINT && kval < telemetryKeyCount)
+				{
+					child = &telemetryKeys[kval];
+					printString(out, (const uint8_t*) child->name, strlen(child->name));
+				}
+				else if (kmajor == CBOR_TEXT && (uint64_t) (in.end - in.p) >= kval)
+				{
+					printString(out, in.p, (size_t) kval);
+					in.p += kval;
+				}
+				else return false;
+				out.put(":");
+				if (!printItem(in, out, child, depth + 1)) return false;
+			}
+			out.put("}");
+			return true;
+		}
+		case CBOR_SIMPLE:
+			if (info == (CBOR_FALSE & 0x1f)) {out.put("false"); return true;}
+			if (info == (CBOR_TRUE & 0x1f)) {out.put("true"); return true;}
+			if (info == (CBOR_NULL & 0x1f)) {out.put("null"); return true;}
+			if (info == (CBOR_FLOAT32 & 0x1f) || info == (CBOR_FLOAT64 & 0x1f))
+			{
+				double d;
+				if (info == (CBOR_FLOAT32 & 0x1f)) {uint32_t bits = (uint32_t) val; float f; memcpy(&f, &bits, sizeof(f)); d = f;}
+				else memcpy(&d, &val, sizeof(d));
+				if (key != nullptr && key->decimals > 0) snprintf(num, sizeof(num), "%.*f", key->decimals, d);
+				else snprintf(num, sizeof(num), "%g", d);
+				out.put(num);
+				return true;
+			}
+			return false;
+		default:
+			return false;
+	}
+}
+
+bool telemetryPeekUint(const char* data, const char* name, uint32_t* val)
+{
+	uint8_t head[12];
+	int key = telemetryKeyIndex(name);
+	if (data == nullptr || data[0] != TELEMETRY_PREFIX || key < 0) return false;
+	size_t chars = strlen(data + 1);
+	if (chars > 15) chars = 15;							//whole groups enough for the map, key and a 32 bit value
+	size_t bytes = base85Decode(data + 1, chars, head, sizeof(head));
+	CborIn in = {head, head + bytes, false};
+	uint8_t major, info;
+	uint64_t v;
+	if (!in.readHead(&major, &info, &v) || major != CBOR_MAP) return false;
+	if (!in.readHead(&major, &info, &v) || major != CBOR_UINT || v != (uint64_t) key) return false;
+	if (!in.readHead(&major, &info, &v) || major != CBOR_UINT || v > 0xffffffffULL) return false;
+	*val = (uint32_t) v;
+	return true;
+}
+
+bool telemetryToJson(const uint8_t* cbor, size_t length, char* json, size_t size)
+{
+	if (size == 0) return false;
+	json[0] = '\0';
+	CborIn in = {cbor, cbor + length, false};
+	JsonOut out = {json, size, 0, false};
+	bool isOK = printItem(in, out, nullptr, 0);
+	return isOK && !in.isError && !out.isOverflow && in.p == in.end;
+}
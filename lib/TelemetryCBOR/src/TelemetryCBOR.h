@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * file     TelemetryCBOR.h
+ * author   W Steen
+ *
+ * Library for the Zioxi Trolley 2 to encode DRUP and DEUP telemetry as CBOR with
+ * integer keys, wrap it in base85 for the publish API and decode it back to JSON.
+ * No Device OS dependencies so the same files build the Linux decoder in host/.
+ *
+ * versions
+ * v1.0 - First release CBOR writer, base85 and JSON decoder 17/10/26
+ * v1.1 - added nullValue(), SEQ, KF and BS keys and telemetryPeekUint() for delta encoded DRUP 17/10/26
+ * v1.1.1 - value(double) NaN written as 0 and range checked before the integer test, decoder date buffer enlarged 17/10/26
+ * v1.2 - added LAS, LVS and TMS keys for the DRUP sensor statistics, the count is printed as an integer 17/10/26
+*
+********************************************************************************/
+#ifndef TELEMETRYCBOR_H
+#define TELEMETRYCBOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_PREFIX        '~'		//first character of a base85 CBOR event, JSON events start with '{'
+#define TELEMETRY_MAX_DEPTH     4		//nesting of maps and arrays handled by the decoder
+
+// key kinds - how the decoder prints a value
+#define TK_KIND_VALUE           0		//as encoded, floats with the key decimals
+#define TK_KIND_TIME            1		//"%Y-%m-%dT%H:%M:%S" text encoded as seconds since 1970
+#define TK_KIND_STATS           2		//array of a count then values with the key decimals V1.2
+
+// integer key schema - the index in telemetryKeys[] is the CBOR key, append new keys only so old events still decode
+struct TelemetryKey {
+	const char* name;					//JSON name
+	uint8_t decimals;					//decimals for floats
+	uint8_t kind;						//TK_KIND_
+};
+
+extern const TelemetryKey telemetryKeys[];
+extern const size_t telemetryKeyCount;
+
+int telemetryKeyIndex(const char* name);	//-1 if not in the schema
+
+// CBOR writer with the subset of the JSONWriter API used for DRUP and DEUP, names in the schema are written as integer keys
+class TelemetryCBOR {
+public:
+	TelemetryCBOR(uint8_t* buffer, size_t size);
+
+	TelemetryCBOR& beginObject();
+	TelemetryCBOR& endObject();
+	TelemetryCBOR& beginArray();
+	TelemetryCBOR& endArray();
+	TelemetryCBOR& name(const char* name);
+	TelemetryCBOR& value(bool val);
+	TelemetryCBOR& value(int val);
+	TelemetryCBOR& value(unsigned val);
+	TelemetryCBOR& value(double val, int precision = 2);
+	TelemetryCBOR& value(const char* val);
+	TelemetryCBOR& nullValue();			//V1.1
+
+	size_t dataSize() const {return _length;}
+	bool isOverflow() const {return _isOverflow;}
+
+private:
+
+	void writeHead(uint8_t major, uint64_t val);
+	void writeByte(uint8_t b);
+	uint8_t* _buffer;
+	size_t _size;
+	size_t _length = 0;
+	bool _isOverflow = false;
+	uint8_t _kind = TK_KIND_VALUE;		//kind of the last name written
+};
+
+// base85 (Z85 alphabet, JSON safe) - a partial last group of n bytes is n+1 characters, returns characters or bytes written, 0 if too small
+size_t base85Encode(const uint8_t* in, size_t length, char* out, size_t size);
+size_t base85Decode(const char* in, size_t length, uint8_t* out, size_t size);
+
+// value of the first map entry of a base85 CBOR event if it is name with an unsigned value V1.1
+bool telemetryPeekUint(const char* data, const char* name, uint32_t* val);
+
+// decode a CBOR telemetry event to the JSON the device would have published, returns false if malformed or too big for json
+bool telemetryToJson(const uint8_t* cbor, size_t length, char* json, size_t size);
+
+#endif
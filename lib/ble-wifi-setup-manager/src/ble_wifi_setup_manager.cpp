@@ -31,6 +31,7 @@
  * Have added the ability to handle new commands to switch off WiFi use and to report the connected WiFi details.
  * Have added the ability to set the device name without setup.
  * Have added the ability to stop/start advertising.
+ * Have made the set_creds WiFi and Cloud connection non-blocking using the STATE_CONFIG_* states driven from loop().
  * 
  ********************************************************************************************************************************************/
 
@@ -70,7 +71,8 @@ static inline void onDataReceived(const uint8_t* rx_data, size_t len, const BleP
 BLEWiFiSetupManager::BLEWiFiSetupManager() 
   : config_state(STATE_CONFIG_SETUP),
     next_config_state(STATE_CONFIG_SETUP),
-    provisionCb(nullptr)
+    provisionCb(nullptr),
+    connect_start(0)
 {}
 
 // setup() method to be called from the main application setup()
@@ -139,8 +141,45 @@ void BLEWiFiSetupManager::loop()
         }
 
         case STATE_CONFIG_PARSE_MSG: {
-            parse_message();
             next_config_state = STATE_CONFIG_IDLE;
+            parse_message();                    // may move on to STATE_CONFIG_WIFI_CONNECTING
+            break;
+        }
+
+        // Wait for WiFi after set_creds without blocking loop(), then start the Cloud connection
+        case STATE_CONFIG_WIFI_CONNECTING: {
+            if (WiFi.ready())
+            {
+                BLEWiFiSetupManagerLogger.info("WiFi Connected");
+                status_message("Connected to WAP");
+                status_message("Connecting to Cloud...");
+                Particle.connect();
+                connect_start = millis();
+                next_config_state = STATE_CONFIG_CLOUD_CONNECTING;
+            }
+            else if (millis() - connect_start >= CONNECTION_TIMEOUT)
+            {
+                BLEWiFiSetupManagerLogger.info("WAP connection Timeout");
+                status_message("WAP Connection Timeout");
+                next_config_state = STATE_CONFIG_IDLE;
+            }
+            break;
+        }
+
+        // Wait for the Cloud connection without blocking loop()
+        case STATE_CONFIG_CLOUD_CONNECTING: {
+            if (Particle.connected())
+            {
+                BLEWiFiSetupManagerLogger.info("Cloud Connected");
+                status_message("Connected to Cloud");
+                next_config_state = STATE_CONFIG_IDLE;
+            }
+            else if (millis() - connect_start >= CONNECTION_TIMEOUT)
+            {
+                BLEWiFiSetupManagerLogger.info("Cloud Connection Timeout");
+                status_message("CloudConnection Timeout");
+                next_config_state = STATE_CONFIG_IDLE;
+            }
             break;
         }
     }
@@ -235,37 +274,9 @@ void BLEWiFiSetupManager::parse_message()
                         status_message("WiFi Credentials Set");
                         WiFi.listen(false); //stop listening
                         WiFi.connect();
-                        timer_t wtimeout = millis();
+                        connect_start = millis();
                         status_message("Connecting to WAP...");
-
-                        while (!WiFi.ready() && (millis() - wtimeout < CONNECTION_TIMEOUT)) {};
-
-                        if (WiFi.ready())
-                        {
-                            BLEWiFiSetupManagerLogger.info("WiFi Connected");
-                            status_message("Connected to WAP");
-                            status_message("Connecting to Cloud...");
-                            Particle.connect();
-                            timer_t ptimeout = millis();
-
-                            while (!Particle.connected() && (millis() - ptimeout < CONNECTION_TIMEOUT)) {}; //Refresh Watchdog to avoid reset not possible here so increase Watchdog time to be more than CONNECTION_TIMEOUT x2
-
-                            if (Particle.connected())
-                            {
-                                BLEWiFiSetupManagerLogger.info("Cloud Connected");
-                                status_message("Connected to Cloud");
-                            }
-                            else
-                            {
-                                BLEWiFiSetupManagerLogger.info("Cloud Connection Timeout");
-                                status_message("CloudConnection Timeout");
-                            }
-                        }
-                        else
-                        {
-                        BLEWiFiSetupManagerLogger.info("WAP connection Timeout");
-                        status_message("WAP Connection Timeout");
-                        }
+                        next_config_state = STATE_CONFIG_WIFI_CONNECTING;   // loop() waits for WiFi then Cloud rather than busy waiting here
                     }
                     else
                     {
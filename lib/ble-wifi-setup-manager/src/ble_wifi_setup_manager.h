@@ -32,6 +32,7 @@
  * Have added the ability to handle new commands to switch off WiFi use and to report the connected WiFi details.
  * Have added the ability to set the device name without setup.
  * Have added the ability to stop/start advertising.
+ * Have made the set_creds WiFi and Cloud connection non-blocking using the STATE_CONFIG_* states driven from loop().
  * 
  ********************************************************************************************************************************************/
 
@@ -48,6 +49,8 @@ class BLEWiFiSetupManager {
         STATE_CONFIG_SETUP = 0,
         STATE_CONFIG_IDLE,
         STATE_CONFIG_PARSE_MSG,
+        STATE_CONFIG_WIFI_CONNECTING,
+        STATE_CONFIG_CLOUD_CONNECTING,
     } ConfigState_t;
 
     typedef void (provisionCb_t)(void);
@@ -88,6 +91,8 @@ class BLEWiFiSetupManager {
 
         provisionCb_t *provisionCb;
 
+        system_tick_t connect_start;    // millis() when the current WiFi or Cloud connection attempt started
+
         void parse_message();
 
         wifi_scan_response_queue_t wifi_scan_response_queue;
@@ -139,6 +139,31 @@
  * 134      19-Oct-25   Build and test on Rev12 board - zioxi-8792, increase minChargeRate resolution to 6dp to avoid it defaulting to scientific notation
  * 135      19-Oct-25   Build and test on Rev12 board - zioxi-8603, configuration and eeprom data recovery after param struct change or flash restart
  * 136      20-Oct-25   Build and test on Rev12 board - zioxi-8809, revert change with compile switch in ble_wifi_setup_manager.cpp
+ * 137      17-Oct-26   Build and test on Rev12 board - non-blocking soft start sequencer for ACRelaysOn stepped from loop(), CT** event sent when sequence complete
+ * 138      17-Oct-26   Build and test on Rev12 board - cooperative task scheduler for the periodic checks in loop(), task run counts and durations by web command 'tsk'
+ * 139      17-Oct-26   Build and test on Rev12 board - per stage loop latency histograms with p50/p99/max by web command 'lat'
+ * 140      17-Oct-26   Build and test on Rev12 board - WiFi and Cloud connection waits in wifiProvisioning replaced by non-blocking states with timeouts
+ * 141      17-Oct-26   Build and test on Rev12 board - non-blocking set_creds connection in ble_wifi_setup_manager.cpp, Watchdog timeout reduced to 60 seconds
+ * 142      17-Oct-26   Build and test on Rev12 board - non-blocking daily time sync, MCP7940 adjusted on completion, sync round trip and clock step as variables
+ * 143      17-Oct-26   Build and test on Rev12 board - MCP9800 v1.6 split phase conversions so all temperature sensors convert in parallel without delay(31)
+ * 144      17-Oct-26   Build and test on Rev12 board - interrupt driven debounced mains supply detect with timestamped event queue, powerStateCheck no longer reads GPIO
+ * 145      17-Oct-26   Build and test on Rev12 board - run state descriptor table replaces runState switch, onViewRunState, powerOnStateSelection and previousStateHandler
+ * 146      17-Oct-26   Build and test on Rev12 board - watchdog headroom monitor, worst refresh intervals and loop stage saved in MCP7940 RAM and reported in DEST
+ * 147      17-Oct-26   Build and test on Rev12 board - stackless coroutine steps for sleeping, hibernate and factory reset controllers and Hub port sampling, no blocking queue waits or Hub busy delays
+ * 148      17-Oct-26   Build and test on Rev12 board - PublishQueuePosixRK 0.0.8 worker thread for queue state machine and flash file I/O with handoff queue from publish()
+ * 149      17-Oct-26   Build and test on Rev12 board - MCP7940 1.1.0 MFP 1Hz square wave interrupt drives timerCountdown and timerCharging minutes in place of software Timers
+ * 150      17-Oct-26   Build and test on Rev12 board - typed event bus with static subscriber table for current, temperature, mains, Hub status and interface changes, DRUP uses bus samples
+ * 151      17-Oct-26   Build and test on Rev12 board - max-age sensor cache for current, temperature and BMS readings with hit and miss counts in DEST
+ * 152      17-Oct-26   Build and test on Rev12 board - relay on and off events described by a constexpr schema table and rendered by renderRelayEvent() in place of per-context JSON blocks
+ * 153      17-Oct-26   Build and test on Rev12 board - TelemetryCBOR 1.0.0 optional base85 CBOR with integer keys for DRUP and network info DEUP, host decoder in the library
+ * 154      17-Oct-26   Build and test on Rev12 board - delta encoded DRUP from a field table with SEQ, KF keyframes and BS acknowledged baseline, TelemetryCBOR 1.1.0
+ * 155      17-Oct-26   Build and test on Rev12 board - burst coalescing of events into MREC multi-record publishes, PublishQueuePosixRK 0.0.9
+ * 156      17-Oct-26   Build and test on Rev12 board - FixedFormat 1.0.0 event JSON decimals without newlib floating point printf
+ * 157      17-Oct-26   Build and test on Rev12 board - event date from a cached timestamp rather than Time.format(), FixedFormat 1.1.0
+ * 158      17-Oct-26   Build and test on Rev12 board - events composed in PublishQueueBuffer pool buffers queued without a copy rather than the global dataStr, PublishQueuePosixRK 0.1.0
+ * 159      17-Oct-26   Build and test on Rev12 board - token bucket rate limits per event name and monthly data operations budget in RTC SRAM, PublishQueuePosixRK 0.1.1
+ * 160      17-Oct-26   Build and test on Rev12 board - latest DRUP state in the zdevicestatus Ledger set on material change, DRUP only on state change, wake or hourly for history
+ * 161      17-Oct-26   Build and test on Rev12 board - DRUP LAS, LVS and TMS count, min, max, mean and standard deviation of the sensorReading() samples since the last DRUP
  */
 
 // P2-PDU-base *************************************
@@ -150,6 +175,20 @@
 #define SERIAL_WAIT false                   //V083/V136 false
 #define RESET_AUTO_SMART_MONITORING false   //V110
 #define REV12_BOARD true                    //V125
+#define LOOP_HISTOGRAM true                 //V139
+#define TEMP_CONTINUOUS false               //V143 true for MCP9800 continuous conversion rather than oneshot
+#define PUBQ_THREAD true                    //V148 true for PublishQueuePosix flash I/O on its own thread rather than from loop()
+#define PUBQ_HANDOFF 8                      //V148 events publish() can hand to the PublishQueuePosix thread
+#define RTC_TICK true                       //V149 true for charge and countdown minutes from the MCP7940 MFP 1Hz square wave rather than software Timers
+#define TELEMETRY_CBOR false                //V153 true for DRUP and network info DEUP as base85 CBOR rather than JSON
+#define DRUP_DELTA false                   //V154 true for DRUP with only the fields changed since the last acknowledged DRUP and periodic keyframes
+#define EVENT_COALESCE true                 //V155 true to merge events published within COALESCE_WINDOW into one MREC publish, the backend splits MREC into its records
+#define COALESCE_WINDOW 1500                //V155 ms the first event of a burst is held for others to join it
+#define FIXED_FORMAT true                   //V156 true for event JSON value(double, precision) with fixedFormat() rather than vsnprintf
+#define TIMESTAMP_CACHE true                //V157 true for the event date from TimestampCache rather than Time.format() strftime and String
+#define RATE_LIMIT true                     //V159 true for token bucket limits per event name and the monthly data operations budget
+#define STATUS_LEDGER false                 //V160 true for the latest device state in the zdevicestatus device to cloud Ledger with DRUP kept for history
+#define SENSOR_STATS true                   //V161 true for DRUP statistics of current, voltage and temperature over the samples since the last DRUP
 
 #include "Particle.h"
 
@@ -173,13 +212,30 @@
 #include "LocalTimeRK.h"
 #endif      //LOCAL_TIME_RK
 
+#if TELEMETRY_CBOR
+#include "TelemetryCBOR.h"              //V153
+#endif      //TELEMETRY_CBOR
+
+#include "RelayEventSchema.h"           //V152 relay event contexts, names and layouts
+
+#if FIXED_FORMAT || TIMESTAMP_CACHE
+#include "FixedFormat.h"                //V157 TimestampCache
+#endif      //FIXED_FORMAT || TIMESTAMP_CACHE
+
+#if FIXED_FORMAT
+#include "FixedJSONWriter.h"            //V156
+typedef FixedJSONWriter EventJSONWriter;        //V156 same text, decimals written without newlib floating point
+#else
+typedef JSONBufferWriter EventJSONWriter;       //V156
+#endif      //FIXED_FORMAT
+
 SYSTEM_MODE(SEMI_AUTOMATIC);            //let firmware manage the connection to the Particle Cloud
 
 const char* const firmware         =   "6.3.4";
-const char* const softwarebuild    =   "136 20-10-25";
+const char* const softwarebuild    =   "161 17-10-26";
 const char* const hardwarebuild    =   "Rev12";
 
-PRODUCT_VERSION(136);
+PRODUCT_VERSION(161);
 
 // instantiations
 MCP9800 tmpSensor;                      //always instantiate onboard MCP9800 sensor
@@ -189,6 +245,7 @@ MCP9800 extSensor1;                      //instantiate external MCP9800 sensor 1
 MCP9800 extSensor2;                      //instantiate external MCP9800 sensor 2
 MCP9800 extSensor3;                      //instantiate external MCP9800 sensor 3
 MCP9800 extSensor4;                      //instantiate external MCP9800 sensor 4
+MCP9800* const extSensors[4] = {&extSensor1, &extSensor2, &extSensor3, &extSensor4};   //V143
 #endif
 
 #include "PublishQueuePosixRK.h"
@@ -217,6 +274,45 @@ typedef struct {
 restartData restartdata;
 uint8_t serializedRData[sizeof(restartData)];   // Serialize restartdata into a uint8_t array
 
+#define WATCHDOGDATA_ADDR RESTARTDATA_ADDR + sizeof(restartData)    // Address in RTC SRAM for watchdog headroom data V146
+#define WATCHDOG_OFFENDERS 3            // number of worst watchdog refresh intervals kept
+#define WATCHDOG_MAGIC 0xA5             // marks the watchdog data in RTC SRAM as valid
+typedef struct {
+    uint8_t magic;
+    uint8_t resets;                                 // watchdog resets since the data was cleared
+    uint8_t stallStage;                             // loop stage active at the last watchdog reset, copied from retained RAM by restoreWatchdogDataFromRam()
+    uint8_t stage[WATCHDOG_OFFENDERS];              // loop stage that took longest in each worst interval, NUM_LOOP_STAGES if not known
+    uint16_t worstMs[WATCHDOG_OFFENDERS];           // worst refresh intervals in ms, longest first
+} watchdogData;
+
+watchdogData watchdogdata;
+uint8_t serializedWData[sizeof(watchdogData)];  // Serialize watchdogdata into a uint8_t array
+
+#define BUDGETDATA_ADDR WATCHDOGDATA_ADDR + sizeof(watchdogData)       // Address in RTC SRAM for the data operations budget V159
+#define BUDGET_MAGIC 0x5B               // marks the budget data in RTC SRAM as valid
+typedef struct {
+    uint8_t magic;
+    uint8_t month;                                  // month of the counts 1-12, 0 until the time is valid
+    uint16_t year;
+    uint32_t used;                                  // publishes (data operations) this month
+    uint32_t dropped;                               // events dropped by the rate limiter this month
+} budgetData;
+
+budgetData budgetdata;
+uint8_t serializedBData[sizeof(budgetData)];    // Serialize budgetdata into a uint8_t array
+
+#define DRUPDATA_ADDR BUDGETDATA_ADDR + sizeof(budgetData)         // Address in RTC SRAM for the DRUP sequence number V154
+#define DRUP_MAGIC 0xD5                 // marks the DRUP data in RTC SRAM as valid
+typedef struct {
+    uint8_t magic;
+    uint32_t seq;                                   // sequence number of the last DRUP so SEQ continues across a restart
+} drupData;
+
+drupData drupdata;
+uint8_t serializedDData[sizeof(drupData)];      // Serialize drupdata into a uint8_t array
+
+static_assert(DRUPDATA_ADDR + sizeof(drupData) <= MCP7940_RAM_SIZE, "RTC SRAM data does not fit");
+
 #define RESTART_NORMAL 0
 #define RESUME_OUT_OF_MEMORY 1
 #define RESUME_WATCHDOG 2
@@ -310,7 +406,167 @@ double battv = 0.0;             //Particle variable for battery voltage
 double bTemp = 0.0;             //Particle variable for internal temperature
 double xTemps = 0.0;
 
-char dataStr[500];
+#if TELEMETRY_CBOR
+#define TELEMETRY_CBOR_SIZE ((MAXDATA - 2) * 4 / 5)             //V153/V158 CBOR that fits an event buffer once base85 wrapped with the prefix
+bool telemetryPack(const TelemetryCBOR& writer, const uint8_t* cbor, PublishQueueBuffer& eventBuffer);
+#endif //TELEMETRY_CBOR
+
+// DRUP field table V154 - values are held scaled by 10^decimals so a change is a change in the reported value
+#define DF_ACTIVE 0x01                      //sent in the charging and on states
+#define DF_IDLE 0x02                        //sent in the other states
+#define DF_SIGNAL 0x04                      //only when there is a WiFi RSSI
+#define DF_BOOL 0x08                        //sent as true or false
+#define DF_CHAR 0x10                        //sent as a one character string
+#define DF_LOCATE 0x20                      //only with GOOGLE_LOCATE
+
+typedef enum {
+    DF_C = 0, DF_R, DF_Z, DF_D, DF_Q, DF_SS, DF_SQ, DF_Y, DF_X, DF_TMP, DF_AO, DF_KL, DF_MCD, DF_LA, DF_LV, DF_J, DF_ST,
+    DF_VBT, DF_CHG, DF_CHD, DF_BFT, DF_RBF,
+    NUM_DRUP_FIELDS
+} DrupField_t;
+
+struct DrupFieldDesc {
+    const char* name;
+    uint8_t decimals;
+    uint8_t flags;
+    int32_t band;                           //V160 scaled change that is material for the status Ledger, 0 for a state where any change is
+};
+
+constexpr DrupFieldDesc drupFields[NUM_DRUP_FIELDS] = {
+//   name   decimals    flags                                   band
+    {"C",   0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"R",   0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"Z",   0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"D",   0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"Q",   0,          DF_ACTIVE | DF_IDLE | DF_SIGNAL,        5},         // 5dBm
+    {"SS",  2,          DF_ACTIVE | DF_IDLE | DF_SIGNAL,        1000},      // 10%
+    {"SQ",  2,          DF_ACTIVE | DF_IDLE | DF_SIGNAL,        1000},      // 10%
+    {"Y",   4,          DF_IDLE | DF_LOCATE,                    10},        // about 100m
+    {"X",   4,          DF_IDLE | DF_LOCATE,                    10},
+    {"TMP", 1,          DF_ACTIVE | DF_IDLE,                    20},        // 2.0C
+    {"AO",  0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"KL",  0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"MCD", 0,          DF_ACTIVE | DF_IDLE,                    0},
+    {"LA",  3,          DF_ACTIVE | DF_IDLE,                    100},       // 0.1A
+    {"LV",  1,          DF_ACTIVE | DF_IDLE,                    50},        // 5.0V
+    {"J",   0,          DF_IDLE,                                0},
+    {"ST",  0,          DF_IDLE | DF_CHAR,                      0},
+    {"VBT", 3,          DF_ACTIVE | DF_IDLE,                    100},       // 0.1V
+    {"CHG", 0,          DF_ACTIVE | DF_IDLE | DF_BOOL,          0},
+    {"CHD", 0,          DF_ACTIVE | DF_IDLE | DF_BOOL,          0},
+    {"BFT", 0,          DF_ACTIVE | DF_IDLE | DF_BOOL,          0},
+    {"RBF", 0,          DF_ACTIVE | DF_IDLE | DF_BOOL,          0},
+};
+
+struct DrupSnapshot {
+    uint32_t present;                       //bit per DrupField_t
+    int32_t value[NUM_DRUP_FIELDS];
+    bool hasHubPorts;                       //LV0 sent
+    char lvsun[4][17];
+};
+
+void drupSet(DrupSnapshot& snap, uint8_t field, double value);
+
+#if STATUS_LEDGER
+// status Ledger V160 - checkDeviceUpdate() sets the latest state in the Ledger when a field moves by more than its band
+// and publishes a DRUP for history only when a state field changes, after a forced update or once an hour
+#define STATUS_HISTORY_TIME 3600000UL       //a history DRUP at least once an hour
+
+DrupSnapshot statusSet;                     //state last set in the status Ledger
+bool isStatusSet = false;                   //false until the first set or after a failed set
+DrupSnapshot statusHistory;                 //state in the last history DRUP
+timer_t statusHistoryTime = 0;
+uint32_t statusSetCount = 0;                //Ledger sets since reset
+uint32_t statusSkipCount = 0;               //DRUPs not published as the Ledger has the latest state
+
+bool statusChanged(const DrupSnapshot& cur, const DrupSnapshot& last, bool isStateOnly);
+bool statusLedgerSet(const DrupSnapshot& cur);
+bool isStatusLedgerSynced();
+#endif //STATUS_LEDGER
+
+#if DRUP_DELTA
+// delta encoded DRUP V154 - each DRUP carries SEQ and the fields changed since BS, the last DRUP the cloud acknowledged, or KF for a full keyframe
+#define DRUP_KEYFRAME_COUNT 10              //every 10th DRUP is a keyframe
+#define DRUP_KEYFRAME_TIME 3600000UL        //and at least one keyframe an hour
+#define DRUP_PENDING 4                      //DRUPs kept until the publish complete callback acknowledges them
+
+struct DrupPending {
+    uint32_t seq;
+    DrupSnapshot snap;
+};
+
+DrupSnapshot drupAcked;                     //state the cloud has from the last acknowledged DRUP
+uint32_t drupAckedSeq = 0;                  //0 until a DRUP is acknowledged so the next DRUP is a keyframe
+DrupPending drupPending[DRUP_PENDING];      //oldest first
+uint8_t drupPendingCount = 0;
+uint32_t drupSeq = 0;                       //sequence number of the last DRUP
+uint8_t drupSinceKeyframe = 0;
+timer_t drupKeyframeTime = 0;
+std::atomic<uint32_t> drupAckSeq(0);        //last DRUP sequence number acknowledged, written by publishCompleteCallback()
+uint32_t drupAckHandled = 0;
+
+uint32_t drupSequenceOf(const char* data);
+void drupHandleAck();
+void drupAddPending(uint32_t seq, const DrupSnapshot& snap);
+void saveDrupDataToRam();
+void restoreDrupDataFromRam();
+#endif //DRUP_DELTA
+
+#if DRUP_DELTA || RATE_LIMIT
+void publishCompleteCallback(bool succeeded, const char *eventName, const char *eventData);
+#endif //DRUP_DELTA || RATE_LIMIT
+
+#if RATE_LIMIT
+// event rate limiter V159 - a token bucket per event name prefix, a token is added every refill period up to the burst size
+// and each event takes one, low priority telemetry is slowed then stopped first when the month's publishes run ahead of the budget
+#define RL_CRITICAL 0                       //never limited
+#define RL_NORMAL   1
+#define RL_LOW      2                       //degraded first
+#define DATAOPS_BUDGET 20000UL              //publishes a month for this trolley
+#define BUDGET_SLOWDOWN 4                   //refill period multiplier for degraded events
+#define BUDGETCHK 60000UL                   //publish count added to the budget and saved to RTC SRAM every minute
+
+// budget levels
+#define BL_NORMAL   0
+#define BL_AHEAD    1                       //ahead of the budget spread over the month - low priority refills slowed
+#define BL_OVER     2                       //budget used - low priority dropped, normal refills slowed
+
+struct RateLimit {
+    const char* prefix;             // event name prefix, "" matches any event
+    uint8_t priority;               // RL_
+    uint8_t burst;                  // bucket size
+    timer_t refillMs;               // a token is added every refillMs
+    uint8_t tokens;
+    timer_t lastRefill;             // millis() of the last token added
+    uint32_t dropped;               // events dropped since reset
+    uint32_t logged;                // dropped when checkDataBudget() last logged the drops
+};
+
+// first matching prefix is used
+RateLimit rateLimits[] = {
+//   prefix  priority       burst   refill
+    {"CT",   RL_CRITICAL,   0,      0},                 // relay, lock, overheat, mains and sleep events
+    {"DRUP", RL_LOW,        6,      60000UL},           // DCHK when charging, burst for state changes
+    {"DIAG", RL_LOW,        4,      300000UL},
+    {"DEUP", RL_NORMAL,     10,     60000UL},           // a flapping network
+    {"DEST", RL_NORMAL,     4,      3600000UL},
+    {"WC",   RL_NORMAL,     10,     30000UL},           // repeated web commands
+    {"",     RL_NORMAL,     10,     60000UL},
+};
+
+const size_t NUM_RATE_LIMITS = sizeof(rateLimits) / sizeof(rateLimits[0]);
+
+Mutex rateLimitMutex;                       //the filter runs on whichever thread publishes
+uint8_t budgetLevel = BL_NORMAL;
+std::atomic<uint32_t> budgetPublished(0);   //publishes since the last checkDataBudget(), written by publishCompleteCallback()
+std::atomic<uint32_t> budgetDropped(0);     //drops since the last checkDataBudget()
+
+void setupRateLimits();
+bool rateLimitFilter(const char* eventName);
+void checkDataBudget();
+void saveBudgetDataToRam();
+void restoreBudgetDataFromRam();
+#endif //RATE_LIMIT
 
 /*
 SerialLogHandler logHandler(LOG_LEVEL_INFO,
@@ -356,6 +612,84 @@ SerialLogHandler logHandler(LOG_LEVEL_INFO,
 #define D_WEBGOTOON             97
 #define D_WEBGOTOTIMED          98
 #define D_WEBOUCAUTO            99
+#define D_MAX                   196         //highest D_ run state value V145
+
+// dense index of the run states in runStateTable V145 - the D_ values are unchanged as they are saved in param.resumeState
+enum RunStateIndex : uint8_t {
+    RS_STARTUP = 0,
+    RS_RESTART,
+    RS_GOTOSTANDBY,
+    RS_STANDBY,
+    RS_WEBGOTORESTART,
+    RS_GOTOTIMED_ON,
+    RS_TIMED_ON,
+    RS_GOTOALWAYS_ON,
+    RS_ALWAYS_ON,
+    RS_GOTOAUTO,
+    RS_AUTO_OFF,
+    RS_AUTO_ON,
+    RS_GOTOCHARGED_ON,
+    RS_GOTOCHARGED_ON_AUTO,
+    RS_CHARGED_ON,
+    RS_CHARGED_ON_AUTO,
+    RS_GOTOCHARGED_ON_USBC,
+    RS_GOTOCHARGED_ON_USBC_AUTO,
+    RS_CHARGED_ON_USBC,
+    RS_CHARGED_ON_USBC_AUTO,
+    RS_GOTOSLEEP,
+    RS_SLEEPING,
+    RS_WEBGOTOSTANDBY,
+    RS_WEBGOTOTIMED,
+    RS_WEBGOTOAUTO,
+    RS_WEBGOTOON,
+    RS_WEBGOTOCHARGED,
+    RS_WEBGOTOCHARGEDUSBC,
+    RS_WEBGOTOHARDRESTART,
+    RS_WEBGOTOHIBERNATE,
+    RS_WEBOUCAUTO,
+    RS_WEBOUCAEXIT,
+    NUM_RUN_STATES
+};
+
+// web commands (Remote_Admin) allowed in a run state V145
+#define WEB_STB                 0x0001      //go to standby
+#define WEB_RST                 0x0002      //restart
+#define WEB_HST                 0x0004      //factory reset
+#define WEB_TMC                 0x0008      //timed charge
+#define WEB_CNC                 0x0010      //continuous charge
+#define WEB_OUC                 0x0020      //smart AC charge
+#define WEB_USB                 0x0040      //smart USB-C charge
+#define WEB_HIB                 0x0080      //hibernate
+#define WEB_IN_STANDBY          (WEB_RST | WEB_HST | WEB_TMC | WEB_CNC | WEB_OUC | WEB_USB | WEB_HIB)
+#define WEB_NOT_STANDBY         (WEB_STB)
+
+// run state descriptor V145
+struct RunStateDescriptor {
+    uint8_t index;                          //RunStateIndex, must match the position in runStateTable
+    int state;                              //D_ run state value
+    void (*controller)();                   //controller called from loop() in this run state, nullptr if none
+    int webState;                           //W_ run state value presented to onView
+    uint16_t webCommands;                   //WEB_ commands allowed in this run state
+    void (*entry)();                        //called by loop() before the first controller call after runState changes to this state, nullptr if none
+    void (*exit)();                         //stop timers and relays when the run state is left by a web command, nullptr if none
+    int resume;                             //D_ run state to go to at power on when this is the saved resume state (POS_LAST)
+    uint32_t next;                          //RS_BIT mask of the run states setRunState() allows this state to change to
+};
+
+// allowed next run state masks for runStateTable V145
+#define RS_BIT(i)               (1UL << (i))
+#define RS_NEXT_ANY             (0xFFFFFFFFUL >> (32 - NUM_RUN_STATES))
+#define RS_NEXT_WEB_OUC         (RS_BIT(RS_WEBOUCAUTO) | RS_BIT(RS_WEBOUCAEXIT))      //auo/aux and an emptied schedule are allowed in any run state
+#define RS_NEXT_WEB_STANDBY     (RS_BIT(RS_WEBGOTORESTART) | RS_BIT(RS_WEBGOTOHARDRESTART) | RS_BIT(RS_WEBGOTOTIMED) | RS_BIT(RS_WEBGOTOON) | \
+                                 RS_BIT(RS_WEBGOTOCHARGED) | RS_BIT(RS_WEBGOTOCHARGEDUSBC) | RS_BIT(RS_WEBGOTOHIBERNATE) | RS_BIT(RS_WEBGOTOAUTO) | RS_NEXT_WEB_OUC)
+#define RS_NEXT_WEB_NOT_STANDBY (RS_BIT(RS_WEBGOTOSTANDBY) | RS_NEXT_WEB_OUC)
+#define RS_NEXT_POWER_ON        (RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOTIMED_ON) | RS_BIT(RS_GOTOALWAYS_ON) | RS_BIT(RS_GOTOAUTO) | \
+                                 RS_BIT(RS_GOTOCHARGED_ON) | RS_BIT(RS_GOTOCHARGED_ON_USBC))     //powerOnStateSelection()
+#define RS_NEXT_SMART_START     (RS_BIT(RS_GOTOCHARGED_ON_AUTO) | RS_BIT(RS_GOTOCHARGED_ON_USBC_AUTO))  //checkScheduledStartUntilCharged()
+#define RS_NEXT_SMART_RETURN    (RS_BIT(RS_STANDBY) | RS_BIT(RS_TIMED_ON) | RS_BIT(RS_ALWAYS_ON) | RS_BIT(RS_CHARGED_ON) | RS_BIT(RS_CHARGED_ON_AUTO) | \
+                                 RS_BIT(RS_CHARGED_ON_USBC) | RS_BIT(RS_CHARGED_ON_USBC_AUTO))   //smart charge auto start without mains goes back to prevRunState
+#define RS_NEXT_RESUME          (RS_BIT(RS_TIMED_ON) | RS_BIT(RS_ALWAYS_ON) | RS_BIT(RS_AUTO_OFF) | RS_BIT(RS_AUTO_ON) | RS_BIT(RS_CHARGED_ON) | \
+                                 RS_BIT(RS_CHARGED_ON_AUTO) | RS_BIT(RS_CHARGED_ON_USBC) | RS_BIT(RS_CHARGED_ON_USBC_AUTO))     //param.resumeState after sleep
 
 #define HARD_RESET_CMD          28
 
@@ -368,33 +702,7 @@ enum PowerOnState {
     POS_SMART_USB = 8 // Smart USB - resume in smart USB state
 };
 
-// charge state values (KL)
-enum ChargeState {
-    C_NOT_CHARGING = 0,  //not charging
-    C_CHARGING = 1,      //charging or warm-up charging
-    C_CHARGING_FULL = 2, //full rate charging-warm up ended V130
-    C_RATE_CHARGING = 7, //rate monitoring
-    //C_RATE_CHARGING_PLUS = 8, //confirmed rate monitoring V130 removed
-    C_CHARGING_DONE = 9, //rate monitoring slope < target or time expired
-    C_CHARGING_ENDED = 10 //charging stopped after extra time
-};
-// onView web app RunState values
-#define W_STANDBY               1 
-#define W_TIMED_ON              3 
-#define W_AUTO_OFF              4 
-#define W_AUTO_ON               5
-#define W_ON                    6
-#define W_SLEEPING              7 
-#define W_CHARGED_ON            8 
-#define W_CHARGED_ON_AUTO       9
-#define W_CHARGED_ON_USBC       15
-#define W_CHARGED_ON_USBC_AUTO  16
-
-// onView web app PowerState values
-#define W_MAINS_OFF             100
-#define W_MAINS_ON              101
-#define W_CHARGING              105
-#define W_RESUME                200
+// charge state (KL), onView RunState and PowerState values are in RelayEventSchema.h V152
 
 // Smart charging state values
 #define ON_UNTIL_OFF            0           //Monitoring off
@@ -412,15 +720,7 @@ enum ChargeState {
 #define AUTO_ON_UNTIL_ON        true        //On Until Charged auto start monitoring
 
 // Constant char arrary definitions for event names
-const char* const eventonstart    =    "CTOS";
-const char* const eventonended    =    "CTOE"; 
-const char* const eventtimerstart =    "CTTS"; 
-const char* const eventtimerended =    "CTTE"; 
-const char* const eventontilstart =    "CTUS"; 
-const char* const eventontilended =    "CTUE"; 
-const char* const eventscheduleon =    "CTSS"; 
-const char* const eventscheduloff =    "CTSE"; 
-const char* const eventschedulexp =    "CTSX"; 
+// the relay on and off event names CTOS to CTSX are with their layouts in RelayEventSchema.h V152
 const char* const eventunlocked   =    "CTUN";
 const char* const eventlocked     =    "CTLK";
 const char* const eventoverheated =    "CTOV";
@@ -444,6 +744,7 @@ const char* const eventresetparam =    "DERE";
 const char* const eventstartupres =    "DERS"; 
 const char* const eventdiagnostic =    "DIAG";
 const char* const eventwifiupdate =    "DEUP";
+const char* const eventmultirec   =    "MREC";     //V155 coalesced burst, one "name\tdata" record per line
 
 #define SERLEN 7                            //Serial number length (amended to 7 characters V120)
 #define PRODLEN 30                          //Product Type, Name, Code length
@@ -452,6 +753,7 @@ const char* const eventwifiupdate =    "DEUP";
 #define NUM_OUTLETS 4                       //number of outlets/relays V135
 
 #define SSDELAY 2                           //sequenced start delay - 2 seconds
+#define SSHUBDELAY 5000UL                   //delay after relays on for LVSUN chargers to start up before input channels switched on V137
 #define CHARGEONOFF  'C'                    //schedule type is 'Charging On/Off'
 #define OUC_START    'O'                    //schedule type is 'On Until Charged-Start'
 #define NONESCHEDULE 'N'                    //no schedule loaded
@@ -459,6 +761,7 @@ const char* const eventwifiupdate =    "DEUP";
 #define LAST_CONFIG 20000UL                 //last configuration check time in milliseconds
 
 #define MAXDATA 500                         //maximum event data string length
+#define EVENT_BUFFERS 6                     //V158 pool of MAXDATA event composition buffers, more come from the heap
 #define RESET_TO 2000                       //timeout when waiting for events in backlog to clear before system.reset
 #define ONE_MINUTE 60000                    //one minute in milliseconds
 #define ONE_DAY_MILLIS 86400000             //one day in milliseconds
@@ -475,33 +778,7 @@ const char* const eventwifiupdate =    "DEUP";
 #define SDCHK 900000                        //Slow DCHK to every 15 minutes when in standby
 #define SAMPLE_INTERVAL 60000               //60 seconds in milliseconds for average current calculation
 
-// context values for ACRelaysOn and ACRelaysOff
-#define R_NONE  88                          //relay no message
-#define R_AUTO  10                          //auto - start/ended under schedule control
-#define X_AUTO  12                          //suspend auto - mains power removed or overheated/resume start
-#define T_AUTO  13                          //auto - ended no valid time
-#define W_AUTO  15                          //stopped auto charging - web command
-#define R_TIMED 20                          //timed on relay message/timed end
-#define X_TIMED 22                          //exit timed on because mains power removed/resume start
-#define Z_TIMED 23                          //stop timed on because scheduled start of on until charged
-#define W_TIMED 24                          //stop timed on by web command
-#define R_ONC   30                          //continuous charge - start
-#define X_ONC   32                          //suspend continuous charge - mains power removed/resume start
-#define Z_ONC   33                          //stop continuous charge - scheduled start of auto on until charged
-#define M_ONC   34                          //stop continuous charge - maximum charge time reached
-#define W_ONC   35                          //stop continuous charge by web command
-#define R_ONTIL 40                          //on til charged relay message - normal soft start
-#define X_ONTIL 42                          //suspend on until charged - mains power removed/resume start
-#define M_ONTIL 44                          //on til charged relay stop - maximum charge time reached
-#define W_ONTIL 45                          //auto OuC exit by web command
-#define Z_ONTIL 46                          //stop OuC charge - scheduled start of auto on until charged
-#define R_USBC  50                          //USBC charge relay message - normal soft start
-#define X_USBC  52                          //suspend USBC charge - mains power removed/resume start
-#define M_USBC  54                          //USBC charge relay stop - maximum charge time reached
-#define W_USBC  55                          //stop USBC charge by web command
-#define Z_USBC  56                          //stop USBC charge - scheduled start of auto on until charged
-
-#define AUTOANDOFF 99                       //special prevrunstate value to signal auto off message needs to be sent
+// context values for ACRelaysOn and ACRelaysOff and AUTOANDOFF are in RelayEventSchema.h V152
 
 #define NEXT_ON 0x01                        //schedule on value
 #define NEXT_OFF 0x0                        //schedule off value
@@ -611,6 +888,34 @@ const uint8_t  MCP7940_MEMORY_SIZE = 64;        //Number of bytes in memory
 void rtcMFP();  // Forward declaration of MFP pin interrupt handler
 void checkAlarm();  // Function to check if an alarm has been triggered
 
+#if RTC_TICK
+// 1 Hz timebase from the MCP7940 MFP square wave V149 - the MFP interrupt counts seconds and steps the minute timers,
+// timerTickFallback keeps the timebase going from millis() if the MFP ticks stop (RTC fault or not fitted)
+#define RTC_TICK_LOST 2500UL                // no MFP tick for this long and the fallback ticks instead
+volatile bool isRtcTickEnabled = false;     // MFP is in 1 Hz square wave mode so rtcMFP() is a tick
+volatile uint32_t rtcTicks = 0;             // seconds counted from the MFP (or the fallback)
+volatile uint32_t rtcMFPMillis = 0;         // millis() of the last MFP tick
+volatile uint32_t rtcTickFallbacks = 0;     // seconds counted by the fallback
+void setupRtcTick();
+void rtcTick();
+void rtcTickFallback();
+Timer timerTickFallback(1000, rtcTickFallback);
+
+// minute timer stepped by rtcTick() with the same start/stop/isActive use as the software Timer it replaces V149
+class RtcMinuteTimer {
+public:
+    RtcMinuteTimer(void (*callback)()) : callback(callback) {}
+    void start() {ATOMIC_BLOCK() {seconds = 0; active = true;}}     // a minute from now and then every minute
+    void stop() {active = false;}
+    bool isActive() const {return active;}
+    void tick() {if (active && ++seconds >= 60) {seconds = 0; callback();}}    // called once a second with interrupts disabled
+private:
+    void (*callback)();
+    volatile bool active = false;
+    volatile uint8_t seconds = 0;
+};
+#endif // RTC_TICK
+
 void checkForConfiguration();
 void restoreParameters();
 bool performConfiguration();
@@ -636,9 +941,17 @@ void resetTimeout(void);
 void charge_timer(void);
 void initTimers(void);
 
+#if RTC_TICK
+RtcMinuteTimer timerCountdown(timing_countdown);                    //auto trigger - countdown (timed on) V149
+#else
 Timer timerCountdown(ONE_MINUTE, timing_countdown);                 //auto trigger - countdown (timed on)
+#endif // RTC_TICK
 Timer timerReset(RESET_TO, resetTimeout, true);                     //one time timer for reset wait for all events sent timeout
+#if RTC_TICK
+RtcMinuteTimer timerCharging(charge_timer);                         //charge on timer (on and on until charged) V149
+#else
 Timer timerCharging(ONE_MINUTE, charge_timer);                      //charge on timer (on and on until charged)
+#endif // RTC_TICK
 int timerStartMins;                                                 //to store the start duration of the timer for the countdown typically param.timerPeriod
 volatile bool isUpdateCountdown = false;
 volatile bool isResetTimeout = false;
@@ -700,6 +1013,10 @@ void starttimerCharging();
 
 void ACRelaysOn(int context);
 void ACRelaysOff(int context);
+EventValues relayEventValues(char* createdAt, size_t size, int kvalue, float maxtemp);        //V152
+void softStartSequencer();                  //V137
+void helperSoftStartDone(int context);      //V137
+bool isSoftStartActive();                   //V137
 void startupController();
 void restartController();
 void goToStandbyController();
@@ -719,7 +1036,7 @@ void goToChargedOnAutoController();
 void goToChargedOnUSBCController();
 void goToChargedOnUSBCAutoController();
 void chargedOnUSBCController();
-bool sampleHubPorts();
+void sampleHubPorts();
 void helperGoToUSBCCharged(int context);
 void checkScheduledStartUntilCharged();     //V111
 
@@ -743,10 +1060,21 @@ void helperOnMainsOffOverheated();
 void helperTimedMainsOffOverheated();
 void putParameters();
 void previousStateHandler(int prevRunState);
+void exitAutoOn();                          //V145
+void exitAutoOff();                         //V145
+void exitTimedOn();                         //V145
+void exitAlwaysOn();                        //V145
+void exitChargedOn();                       //V145
+void exitChargedOnUSBC();                   //V145
+void entryStandby();                        //V145
+void entryNotStandby();                     //V145
+const RunStateDescriptor* findRunState(int state);     //V145
+bool setRunState(int state);                //V145
+bool isWebCommandAllowed(uint16_t command); //V145
 void helperAutoSetup();
 byte decodeBase64(char b64chr);
-void sampleCurrent();
-void sampleBMS();
+void sampleCurrent(uint32_t maxAge);   //V151
+void sampleBMS(uint32_t maxAge);       //V151
 int numberOfAdaptors();
 void mainsPowerOffEvent();
 void mainsPowerRestoredEvent();
@@ -765,15 +1093,19 @@ bool startChargeRateMonitor(float amps, int cdevices, int cs);
 bool checkIfChangedPeriod(int i, int j);
 int chargingDevicesLogic(float amps);
 void checkOverheated();
-void waitForQueueToEmpty();
 void helperDelayDRUP();       //V116
 void helperCheckFirstDRUP();  //V116
 void checkForWiFiHealth();
 void sendDESTevent();         //V135
-char* getCreatedTime();
+void sendHealthReport();
+#define CREATED_AT_SIZE 28                  //getCreatedTime() buffer size
+const char* getCreatedTime(char* createdAt, size_t size);
 
 Ledger cloudconfigurationtodevice;  // Cloud to Device, device-specific configuration
 Ledger configurationstatus;         // Device to Cloud configuration status
+#if STATUS_LEDGER
+Ledger statusledger;                // Device to Cloud latest device status V160
+#endif //STATUS_LEDGER
 
 void syncCallback(Ledger ledger);   // Call back when ledger sync'd
 
@@ -782,7 +1114,6 @@ int outOfMemory = -1;
 float xtemp = 0.0;
 
 timer_t eventdelay;
-timer_t checknetwork;
 timer_t connectedSince;
 timer_t connectTime;
 timer_t lastLoop;
@@ -794,6 +1125,100 @@ timer_t charginginitialupdate;      //V107
 
 int loopRate;
 
+// soft start sequencer states V137 - relays and LVSUN input channels are stepped on from loop() rather than with delay()
+typedef enum {
+    SS_IDLE = 0,                    // no soft start in progress
+    SS_RELAYS,                      // switching AC relays on one per SSDELAY
+    SS_HUB_WAIT,                    // waiting SSHUBDELAY for LVSUN chargers to start up
+    SS_HUB_CHANNELS,                // switching LVSUN input channels on one per SSDELAY
+    SS_DONE                         // sequence complete, send the CT** event
+} SoftStartStates_t;
+
+struct SoftStart {
+    SoftStartStates_t state;        // current sequencer state
+    uint8_t step;                   // relay or channel index within the current state
+    int context;                    // ACRelaysOn context used for the completion event
+    timer_t nextStep;               // millis() time the next step is due
+} softStart = {SS_IDLE, 0, R_NONE, 0};
+
+int softStartProgress = 100;        // Particle variable soft start steps completed as percentage, 100 when not sequencing
+
+// cooperative task scheduler for the periodic checks called from loop() V138
+typedef void (*taskFunction_t)(void);
+
+struct Task {
+    const char* name;               // short name used in the task report
+    taskFunction_t function;        // function run when the task is due
+    uint8_t stage;                  // loop stage the task time is recorded against V139
+    timer_t period;                 // run period in milliseconds
+    timer_t tolerance;              // lateness allowed before the task must run even if another task has run this pass
+    uint8_t priority;               // 0 is highest, due tasks are run in priority order
+    timer_t nextDue;                // millis() time the task is next due
+    uint32_t runs;                  // number of times run
+    uint32_t lastMicros;            // duration of the last run in microseconds
+    uint32_t worstMicros;           // worst case duration of a run in microseconds
+};
+
+void setupScheduler();
+void runScheduler();
+timer_t schedulerIdleMillis();
+void sendTaskReport();
+
+// stackless coroutine for a controller written as a sequence of steps over several loop() passes V147
+// CO_BEGIN resumes at the step last yielded from, locals do not survive a yield so anything needed after one must be global or static
+struct Coroutine {
+    uint16_t line;                  // __LINE__ of the step to resume at, 0 to start from the beginning
+    timer_t wait;                   // millis() at the start of a CO_SLEEP or CO_AWAIT_TIMEOUT
+};
+
+#define CO_BEGIN(co)                    switch ((co).line) { case 0:
+#define CO_YIELD(co)                    do { (co).line = __LINE__; return; case __LINE__:; } while (0)
+#define CO_AWAIT(co, cond)              do { (co).line = __LINE__; case __LINE__: if (!(cond)) return; } while (0)
+#define CO_AWAIT_TIMEOUT(co, cond, ms)  do { (co).wait = millis(); (co).line = __LINE__; case __LINE__: if (!(cond) && (millis() - (co).wait) < (ms)) return; } while (0)
+#define CO_SLEEP(co, ms)                do { (co).wait = millis(); (co).line = __LINE__; case __LINE__: if ((millis() - (co).wait) < (ms)) return; } while (0)
+#define CO_END(co)                      } (co).line = 0
+#define CO_RESET(co)                    ((co).line = 0)
+
+Coroutine controllerCo;             // steps of the runState controller, reset by loop() when runState changes
+int controllerCoState = -1;         // runState controllerCo was last run for
+#define QUEUE_EMPTY_TIMEOUT 5000UL  // longest wait for the publish queue to empty before sleep or restart
+
+// loop stages timed for the loop latency histograms V139
+typedef enum {
+    LS_SOFTSTART = 0,               // softStartSequencer()
+    LS_TASKS,                       // scheduler and tasks without their own stage
+    LS_SENSORS,                     // sensorReading()
+    LS_DEVICEUPDATE,                // checkDeviceUpdate()
+    LS_ETHERNET,                    // EthernetWiFi loop()
+    LS_PUBLISH,                     // PublishQueuePosix loop()
+    LS_BLE,                         // BLEWiFiSetupManager loop()
+    LS_PROVISION,                   // wifiProvisioning()
+    LS_CONTROLLER,                  // onViewRunState() and the runState controller
+    LS_LOOP,                        // whole loop() period including system thread time between loops (as LOOPC)
+    NUM_LOOP_STAGES
+} LoopStages_t;
+
+const char* const loopStageNames[NUM_LOOP_STAGES] = {"SS", "TSK", "SEN", "DRU", "ETH", "PQP", "BLE", "PRV", "CTL", "LOOP"};
+
+uint8_t loopStageNow = NUM_LOOP_STAGES;     // stage currently running, NUM_LOOP_STAGES when outside loop()
+uint32_t loopStageStart = 0;                // micros() when the current stage started
+
+void loopStage(uint8_t stage);
+
+#if LOOP_HISTOGRAM
+#define LATENCY_BUCKETS 24                  // log2 buckets of microseconds, bucket i holds 2^i to 2^(i+1)-1 so the last is 8 seconds and over
+
+struct LatencyHistogram {
+    uint32_t count[LATENCY_BUCKETS];        // samples per bucket
+    uint32_t samples;                       // total samples
+    uint32_t maxMicros;                     // largest sample
+} latency[NUM_LOOP_STAGES];
+
+void latencyRecord(uint8_t stage, uint32_t us);
+uint32_t latencyPercentile(const LatencyHistogram &h, uint8_t percent);
+void sendLatencyReport();
+#endif // LOOP_HISTOGRAM
+
 const timer_t DELAY_INITIAL_DRUP = 40000UL; // 40 seconds V107
 const timer_t HUB_UPDATE_INTERVAL = 20000UL; // 20 seconds V106
 const timer_t HUB_COMPLETION_DELAY = 300000UL; // 5 minutes V106
@@ -825,14 +1250,43 @@ void setupExternalTempSensor();
 void saveTimeSettingsToRam();
 void restoreTimeSettingsFromRam();
 bool isDSTactive();
-void clockTimeUpdate(bool forced);
+void clockTimeUpdate();
 void checkTimeSync();
+int timeSyncRTT = -1;                       //Particle variable round trip time in ms of the last cloud time sync, -1 until done V142
+int timeSyncStep = 0;                       //Particle variable RTC time less cloud time in seconds corrected by the last time sync V142
 #define CLOCKUPDATE 20000UL
+#define SENSORCHK 10000UL                   //sensor reading every 10 seconds V138
+#define TIMESYNCCHK 60000UL                 //check whether daily time sync is due every minute V138
+#define TASKCHK 1000UL                      //period for tasks that manage their own timing or react to schedule/state changes V138
 
 void saveRestartDataToRam();
 void clearRestartData();
 void restoreRestartDataFromRam();
 
+// watchdog headroom monitor V146 - the interval between refreshes and the loop stage that took longest in it
+#define WATCHDOG_TIMEOUT 60000UL            //hardware watchdog timeout
+#define WATCHDOG_STALL_WARN 30000UL         //refresh interval at which the active loop stage is saved to retained RAM in case the watchdog then resets
+#define WATCHDOG_MONITOR 1000UL             //period of timerWatchdogMonitor
+volatile bool isWatchdogRunning = false;    //false while stopped for sleep so the monitor ignores the gap
+volatile uint32_t watchdogLastRefresh = 0;  //millis() of the last refresh
+volatile bool isWatchdogStallSaved = false; //set by the monitor once the active stage has been saved for this interval
+volatile uint8_t watchdogStallStage = NUM_LOOP_STAGES; //stage saved by the monitor
+retained uint8_t retainedStallMagic;        //WATCHDOG_MAGIC while retainedStallStage is the stage of a refresh interval that has not ended
+retained uint8_t retainedStallStage;        //written by the monitor in the timer thread without I2C, survives the watchdog reset
+uint32_t passStageMicros = 0;               //time in loop stages since the last refresh
+uint32_t passWorstMicros = 0;               //longest loop stage since the last refresh
+uint8_t passWorstStage = NUM_LOOP_STAGES;   //stage of passWorstMicros
+
+void watchdogStart();
+void watchdogStop();
+void watchdogRefresh();
+void watchdogMonitor();
+bool watchdogRecord(uint32_t ms, uint8_t stage);
+void saveWatchdogDataToRam();
+void restoreWatchdogDataFromRam();
+
+Timer timerWatchdogMonitor(WATCHDOG_MONITOR, watchdogMonitor);     //checks for a stalled loop() from the timer thread
+
 
 SerialLogHandler logHandler(LOG_LEVEL_WARN, { // Logging level for non-application messages
     { "app", LOG_LEVEL_INFO }, // Default logging level for all application messages
@@ -849,6 +1303,32 @@ void setupACS37800();
 
 bool isACSupplyPresent();
 
+// mains supply detect interrupt V144 - the ISR debounces edges on P2_PDU_SUPPLY_DETECT and queues timestamped on/off transitions
+#define MAINS_DEBOUNCE 20UL                 //a new level must hold for 20ms after the last edge to be accepted
+#define MAINS_QUEUE_SIZE 8                  //must be a power of 2
+
+struct MainsEvent {
+    bool isOn;                              //true mains restored, false mains lost
+    uint32_t time;                          //millis() at the edge
+};
+
+volatile MainsEvent mainsQueue[MAINS_QUEUE_SIZE];
+volatile uint8_t mainsQueueHead = 0;        //next free slot, only written with the producer (ISR or ATOMIC_BLOCK)
+volatile uint8_t mainsQueueTail = 0;        //next event to read, only written by mainsEventPoll()
+volatile bool isMainsPresent = false;       //debounced mains supply state
+volatile uint32_t mainsLastEdge = 0;        //millis() of the last accepted edge
+volatile uint16_t mainsQueueOverflow = 0;   //transitions not queued because the queue was full (isMainsPresent is still correct)
+volatile bool isMainsPending = false;       //an edge is waiting for timerMainsDebounce to confirm the level
+volatile uint32_t mainsPendingEdge = 0;     //millis() of the first edge of the pending transition
+uint32_t mainsLastChange = 0;               //millis() of the last transition handled by mainsEventPoll()
+
+void mainsDetectISR();
+void mainsDebounceCheck();
+Timer timerMainsDebounce(MAINS_DEBOUNCE, mainsDebounceCheck, true);   //one shot, restarted by every edge so it fires once the pin has settled
+void mainsQueuePush(bool isOn, uint32_t time);
+void mainsEventPoll();
+void mainsDetectReconcile();
+
 void setupNetwork();
 void checkNetworks();
 uint8_t macAddress[6] = {0};        //WiFi MAC address
@@ -856,15 +1336,146 @@ uint8_t ethAddress[6] = {0};        //Ethernet MAC address
 
 void sensorReading();
 
+// in-process event bus V150 - producers publish typed messages to a subscriber table fixed at compile time, handlers run
+// synchronously in the publisher's context so busPublish() is only called from loop() tasks and never from an ISR
+#define BUS_TEMP_DELTA 0.5f                 //temperature change in degrees C published as BUS_TEMPERATURE
+
+typedef enum {
+    BUS_CURRENT_SAMPLE = 0,                 //sensorReading() has a new RMS voltage and current
+    BUS_TEMPERATURE,                        //board or external temperature moved by BUS_TEMP_DELTA, crossed an overheat threshold or param.maxTemp changed
+    BUS_MAINS,                              //mains supply lost or restored
+    BUS_HUB_STATUS,                         //sampleHubPorts() has a new all green or off result
+    BUS_INTERFACE,                          //active network interface or WiFi connection changed
+    NUM_BUS_TOPICS
+} BusTopic_t;
+
+struct BusMessage {
+    uint8_t topic;                          //BusTopic_t
+    uint32_t time;                          //millis() when published
+    union {
+        struct {float amps; float volts;} current;
+        struct {float board; float external;} temperature;
+        struct {bool isOn; uint32_t edge;} mains;
+        struct {bool allGreenOrOff; uint8_t channels;} hub;
+        struct {int active; bool isWiFiConnected;} network;
+    };
+};
+
+typedef void (*busHandler_t)(const BusMessage& msg);
+
+struct BusSubscriber {
+    uint8_t topic;
+    busHandler_t handler;
+};
+
+uint32_t busCount[NUM_BUS_TOPICS] = {0};    //messages published per topic
+bool isCurrentSampleReady = false;          //set by onBusCurrentSample, cleared by chargedOnController when it has acted on the sample
+
+void busPublish(BusMessage& msg);
+void onBusCurrentSample(const BusMessage& msg);
+void onBusTemperature(const BusMessage& msg);
+void onBusMains(const BusMessage& msg);
+void onBusHubStatus(const BusMessage& msg);
+void onBusInterface(const BusMessage& msg);
+
+const BusSubscriber busSubscribers[] = {
+//   topic                  handler
+    {BUS_CURRENT_SAMPLE,    onBusCurrentSample},    // chargedOnController acts on each new current sample
+    {BUS_TEMPERATURE,       onBusTemperature},      // evaluate overheated only when the temperature has moved
+    {BUS_MAINS,             onBusMains},            // powerdata.isACsupply follows the mains transitions
+    {BUS_HUB_STATUS,        onBusHubStatus},        // result for chargedOnUSBCController
+    {BUS_INTERFACE,         onBusInterface},        // DEUP network info only when the interface changes
+};
+
+const size_t NUM_BUS_SUBSCRIBERS = sizeof(busSubscribers) / sizeof(busSubscribers[0]);
+
+// sensor cache V151 - readers ask for a sample no older than maxAge ms and the hardware is only read when the cached sample is stale
+// the one source of current, temperature and battery readings for the controllers, DRUP and the other events
+#define SENSOR_AGE_NOW 0UL                  //always read the hardware
+#define SENSOR_AGE_CONTROL 1000UL           //controllers acting on the current
+#define SENSOR_AGE_REPORT (SENSORCHK + 1000UL)  //DRUP and events, sensorReading() refreshes every SENSORCHK
+
+typedef enum {
+    SC_CURRENT = 0,                         //ACS37800 RMS volts and amps
+    SC_TEMPERATURE,                         //MCP9800 board temperature
+    SC_XTEMPERATURE,                        //external temperature sensors
+    SC_BMS,                                 //BQ25185 status pins and battery volts
+    NUM_SENSOR_CACHE
+} SensorCache_t;
+
+struct SensorCache {
+    const char* name;
+    void (*read)();                         //reads the hardware into the cached values
+    uint32_t time;                          //millis() of the last hardware read
+    bool isValid;                           //false until the first hardware read
+    uint32_t hits;                          //requests served from the cache
+    uint32_t misses;                        //requests that read the hardware
+};
+
+float rawVoltsRMS = 0.0;                    //last ACS37800 readings before offset, deadband and gain
+float rawAmpsRMS = 0.0;
+
+void readCurrentSensor();
+void readTemperatureSensor();
+void readXTemperatureSensor();
+void readBMS();
+bool sensorSample(uint8_t sensor, uint32_t maxAge);
+
+SensorCache sensorCache[NUM_SENSOR_CACHE] = {
+//   name   read                        time    valid   hits    misses
+    {"CUR", readCurrentSensor,          0,      false,  0,      0},
+    {"TMP", readTemperatureSensor,      0,      false,  0,      0},
+    {"XTP", readXTemperatureSensor,     0,      false,  0,      0},
+    {"BMS", readBMS,                    0,      false,  0,      0},
+};
+
+#if SENSOR_STATS
+// windowed statistics V161 - sensorReading() adds every sample with Welford's running mean and variance so a DRUP
+// reports the spread since the last DRUP in constant memory, the window is reset once the DRUP is published
+typedef enum {
+    SS_CURRENT = 0,                         //powerdata.ampsrms
+    SS_VOLTAGE,                             //powerdata.voltsrms
+    SS_TEMPERATURE,                         //maximum of board and external temperature
+    NUM_SENSOR_STATS
+} SensorStat_t;
+
+struct SensorStats {
+    const char* name;                       //DRUP array [count, min, max, mean, standard deviation]
+    uint8_t field;                          //DrupField_t sets the decimals and whether it is sent
+    uint32_t count;                         //samples in the window
+    float min;
+    float max;
+    double mean;
+    double m2;                              //sum of squared differences from the mean
+};
+
+SensorStats sensorStats[NUM_SENSOR_STATS] = {
+//   name   field       count   min     max     mean    m2
+    {"LAS", DF_LA,      0,      0.0,    0.0,    0.0,    0.0},
+    {"LVS", DF_LV,      0,      0.0,    0.0,    0.0,    0.0},
+    {"TMS", DF_TMP,     0,      0.0,    0.0,    0.0,    0.0},
+};
+
+void sensorStatsAdd(uint8_t stat, float x);
+double sensorStatsDeviation(const SensorStats& st);
+void sensorStatsReset();
+#endif //SENSOR_STATS
+
 typedef enum {
     STATE_IDLE = 0,
     STATE_PROVISIONED,
-    STATE_CREDENTIALS
+    STATE_CREDENTIALS,
+    STATE_WIFI_CONNECTING,                      //V140 waiting for WiFi.ready() after WiFi.connect()
+    STATE_CLOUD_CONNECTING                      //V140 waiting for Particle.connected() after Particle.connect()
 } ProvisionStates_t;
 
 ProvisionStates_t provision_state, next_provision_state;
 
-void cloudConnected();
+#define WIFI_CONNECT_TIMEOUT 20000UL            //V140 previously waitFor(WiFi.ready, 20000)
+#define CLOUD_CONNECT_TIMEOUT 20000UL           //V140 previously waitFor(Particle.connected, 20000)
+timer_t provisionStart;                         //V140 millis() when the current WiFi or Cloud connection attempt started
+
+void startCloudConnect();
 void wifiProvisioning();
 void sendBLEProvisioningEvent(bool isConnected);
 void provisionCb()                  //Callback function for BLE WiFi Setup
@@ -888,6 +1499,22 @@ uint32_t hubBoardVersion();
 bool isHUBbusy(uint8_t address);
 byte sendMessage(uint8_t address, byte cmd, byte channel, const char *message);
 String receiveMessage(uint8_t address, uint8_t _channel);
+byte requestMessage(uint8_t address, uint8_t _channel);    // V147
+String readMessage(uint8_t address);                        // V147
+
+// Hub port sampling run as a coroutine by chargedOnUSBCController V147
+#define HUB_BUSY_TIMEOUT 500UL      // longest wait for the Hub to be not busy before reading a channel
+#define HUB_BUSY_POLL 50UL          // interval between Hub busy checks
+#define HUB_MESSAGE_DELAY 10UL      // time for the Hub to process the message command
+typedef enum {HS_IDLE, HS_CHARGING, HS_COMPLETION} HubSample_t;   // which check in chargedOnUSBCController started the sample
+Coroutine hubSampleCo;
+uint8_t hubSample = HS_IDLE;        // check the sample in progress is for
+bool isHubSampleReady = false;      // the sample has ended and hubAllGreenOrOff holds the result
+bool hubAllGreenOrOff = true;       // false if any configured Hub port is red
+int8_t hubSampleChannel = 0;        // channel being read
+timer_t hubBusyStart = 0;           // millis() the wait for the Hub to be not busy started
+void startHubSample(uint8_t sample);
+bool isHubSampleDone(uint8_t sample);
 void i2cSetup();
 void LVSUNLEDsOff();                // V053
 void LVSUNInputChannelsOnOff(uint8_t address, uint8_t _channel, bool _on); // V059
@@ -899,6 +1526,136 @@ volatile bool isResetPending = false;
 volatile bool isOKtoSleep = true;
 int trace = 0;
 
+#if LVSUNCHARGER
+#define USBC_CONTROLLER(f) f
+#else
+#define USBC_CONTROLLER(f) nullptr
+#endif // LVSUNCHARGER
+
+// run state descriptor table V145 - one entry per RunStateIndex in the same order
+constexpr RunStateDescriptor runStateTable[NUM_RUN_STATES] = {
+//   index                          state                       controller                                          webState                webCommands         entry               exit                resume                  next
+    {RS_STARTUP,                    D_STARTUP,                  startupController,                                  W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_NEXT_POWER_ON | RS_NEXT_WEB_STANDBY},
+    {RS_RESTART,                    D_RESTART,                  restartController,                                  W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_NEXT_WEB_STANDBY},
+    {RS_GOTOSTANDBY,                D_GOTOSTANDBY,              goToStandbyController,                              W_STANDBY,              WEB_IN_STANDBY,     entryStandby,       nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_STANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_WEB_STANDBY},
+    {RS_STANDBY,                    D_STANDBY,                  standbyController,                                  W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOSLEEP) | RS_NEXT_SMART_START | RS_NEXT_WEB_STANDBY},
+    {RS_WEBGOTORESTART,             D_WEBGOTORESTART,           webGoToRestartController,                           W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_RESTART) | RS_NEXT_WEB_STANDBY},
+    {RS_GOTOTIMED_ON,               D_GOTOTIMED_ON,             goToTimedOnController,                              W_TIMED_ON,             WEB_NOT_STANDBY,    entryNotStandby,    nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_TIMED_ON) | RS_BIT(RS_GOTOSTANDBY) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_TIMED_ON,                   D_TIMED_ON,                 timedOnController,                                  W_TIMED_ON,             WEB_NOT_STANDBY,    nullptr,            exitTimedOn,        D_GOTOTIMED_ON,         RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_SMART_START | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOALWAYS_ON,              D_GOTOALWAYS_ON,            goToOnController,                                   W_ON,                   WEB_NOT_STANDBY,    entryNotStandby,    nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_ALWAYS_ON) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_ALWAYS_ON,                  D_ALWAYS_ON,                onController,                                       W_ON,                   WEB_NOT_STANDBY,    nullptr,            exitAlwaysOn,       D_GOTOALWAYS_ON,        RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_SMART_START | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOAUTO,                   D_GOTOAUTO,                 goToAutoController,                                 W_AUTO_OFF,             WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_AUTO_OFF) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_AUTO_OFF,                   D_AUTO_OFF,                 autoController,                                     W_AUTO_OFF,             WEB_NOT_STANDBY,    nullptr,            exitAutoOff,        D_GOTOAUTO,             RS_BIT(RS_AUTO_ON) | RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_AUTO_ON,                    D_AUTO_ON,                  autoController,                                     W_AUTO_ON,              WEB_NOT_STANDBY,    nullptr,            exitAutoOn,         D_GOTOAUTO,             RS_BIT(RS_AUTO_OFF) | RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOCHARGED_ON,             D_GOTOCHARGED_ON,           goToChargedOnController,                            W_CHARGED_ON,           WEB_NOT_STANDBY,    nullptr,            exitChargedOn,      D_GOTOSTANDBY,          RS_BIT(RS_CHARGED_ON) | RS_BIT(RS_GOTOSTANDBY) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOCHARGED_ON_AUTO,        D_GOTOCHARGED_ON_AUTO,      goToChargedOnAutoController,                        W_CHARGED_ON_AUTO,      WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_CHARGED_ON_AUTO) | RS_NEXT_SMART_RETURN | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_CHARGED_ON,                 D_CHARGED_ON,               chargedOnController,                                W_CHARGED_ON,           WEB_NOT_STANDBY,    nullptr,            exitChargedOn,      D_GOTOCHARGED_ON,       RS_BIT(RS_GOTOCHARGED_ON) | RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_SMART_START | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_CHARGED_ON_AUTO,            D_CHARGED_ON_AUTO,          chargedOnController,                                W_CHARGED_ON_AUTO,      WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOCHARGED_ON,       RS_BIT(RS_GOTOCHARGED_ON) | RS_BIT(RS_GOTOCHARGED_ON_AUTO) | RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOCHARGED_ON_USBC,        D_GOTOCHARGED_ON_USBC,      USBC_CONTROLLER(goToChargedOnUSBCController),       W_CHARGED_ON_USBC,      WEB_NOT_STANDBY,    nullptr,            exitChargedOnUSBC,  D_GOTOSTANDBY,          RS_BIT(RS_CHARGED_ON_USBC) | RS_BIT(RS_GOTOSTANDBY) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOCHARGED_ON_USBC_AUTO,   D_GOTOCHARGED_ON_USBC_AUTO, USBC_CONTROLLER(goToChargedOnUSBCAutoController),   W_CHARGED_ON_USBC_AUTO, WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_CHARGED_ON_USBC_AUTO) | RS_NEXT_SMART_RETURN | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_CHARGED_ON_USBC,            D_CHARGED_ON_USBC,          USBC_CONTROLLER(chargedOnUSBCController),           W_CHARGED_ON_USBC,      WEB_NOT_STANDBY,    nullptr,            exitChargedOnUSBC,  D_GOTOCHARGED_ON_USBC,  RS_BIT(RS_GOTOCHARGED_ON_USBC) | RS_BIT(RS_GOTOCHARGED_ON_USBC_AUTO) | RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_CHARGED_ON_USBC_AUTO,       D_CHARGED_ON_USBC_AUTO,     USBC_CONTROLLER(chargedOnUSBCController),           W_CHARGED_ON_USBC_AUTO, WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOCHARGED_ON_USBC,  RS_BIT(RS_GOTOCHARGED_ON_USBC) | RS_BIT(RS_GOTOCHARGED_ON_USBC_AUTO) | RS_BIT(RS_GOTOSTANDBY) | RS_BIT(RS_GOTOSLEEP) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_GOTOSLEEP,                  D_GOTOSLEEP,                goToSleepController,                                W_SLEEPING,             WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_SLEEPING) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_SLEEPING,                   D_SLEEPING,                 sleepingController,                                 W_SLEEPING,             WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_NEXT_RESUME | RS_BIT(RS_GOTOSTANDBY) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBGOTOSTANDBY,             D_WEBGOTOSTANDBY,           webGoToStandbyController,                           W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOSTANDBY) | RS_NEXT_WEB_STANDBY},
+    {RS_WEBGOTOTIMED,               D_WEBGOTOTIMED,             webGoToTimedController,                             W_TIMED_ON,             WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOTIMED_ON) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBGOTOAUTO,                D_WEBGOTOAUTO,              webGoToAutoController,                              W_AUTO_OFF,             WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOAUTO) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBGOTOON,                  D_WEBGOTOON,                webGoToOnController,                                W_ON,                   WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOALWAYS_ON) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBGOTOCHARGED,             D_WEBGOTOCHARGED,           webGoToChargedController,                           W_CHARGED_ON,           WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOCHARGED_ON) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBGOTOCHARGEDUSBC,         D_WEBGOTOCHARGEDUSBC,       webGoToChargedController,                           W_CHARGED_ON_USBC,      WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_GOTOCHARGED_ON_USBC) | RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBGOTOHARDRESTART,         D_WEBGOTOHARDRESTART,       webGoToFactoryResetController,                      W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_BIT(RS_RESTART) | RS_NEXT_WEB_STANDBY},
+    {RS_WEBGOTOHIBERNATE,           D_WEBGOTOHIBERNATE,         webGoToHibernateController,                         W_SLEEPING,             WEB_NOT_STANDBY,    nullptr,            nullptr,            D_GOTOSTANDBY,          RS_NEXT_WEB_NOT_STANDBY},
+    {RS_WEBOUCAUTO,                 D_WEBOUCAUTO,               webGoToOUCAutoController,                           W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_NEXT_ANY},
+    {RS_WEBOUCAEXIT,                D_WEBOUCAEXIT,              webOUCAExitController,                              W_STANDBY,              WEB_IN_STANDBY,     nullptr,            nullptr,            D_GOTOSTANDBY,          RS_NEXT_ANY},
+};
+
+// D_ value to RunStateIndex lookup built from runStateTable at compile time, NUM_RUN_STATES for values not in the table
+struct RunStateLookup {
+    uint8_t index[D_MAX + 1];
+};
+
+constexpr RunStateLookup makeRunStateLookup()
+{
+    RunStateLookup lookup = {};
+    for (int i = 0; i <= D_MAX; i++) lookup.index[i] = NUM_RUN_STATES;
+    for (uint8_t i = 0; i < NUM_RUN_STATES; i++) lookup.index[runStateTable[i].state] = i;
+    return lookup;
+}
+
+constexpr RunStateLookup runStateLookup = makeRunStateLookup();
+
+// helper to return the RS_BIT mask of the web run states Remote_Admin can change to for the WEB_ commands V145
+constexpr uint32_t webCommandNext(uint16_t commands)
+{
+    return ((commands & WEB_STB) ? RS_BIT(RS_WEBGOTOSTANDBY) : 0) | ((commands & WEB_RST) ? RS_BIT(RS_WEBGOTORESTART) : 0) |
+           ((commands & WEB_HST) ? RS_BIT(RS_WEBGOTOHARDRESTART) : 0) | ((commands & WEB_TMC) ? RS_BIT(RS_WEBGOTOTIMED) : 0) |
+           ((commands & WEB_CNC) ? RS_BIT(RS_WEBGOTOON) : 0) | ((commands & WEB_OUC) ? RS_BIT(RS_WEBGOTOCHARGED) : 0) |
+           ((commands & WEB_USB) ? RS_BIT(RS_WEBGOTOCHARGEDUSBC) : 0) | ((commands & WEB_HIB) ? RS_BIT(RS_WEBGOTOHIBERNATE) : 0);
+}
+
+// compile time checks of runStateTable - entries in RunStateIndex order with unique D_ values, resume states are go to states in the table
+// and the next masks agree with the web commands, power on and sleep resume
+constexpr bool isRunStateTableValid()
+{
+    for (uint8_t i = 0; i < NUM_RUN_STATES; i++)
+    {
+        const RunStateDescriptor &d = runStateTable[i];
+        if (d.index != i) return false;                                         //missing or out of order entry
+        if (d.state < 0 || d.state > D_MAX) return false;                       //D_ value outside the lookup
+        if (runStateLookup.index[d.state] != i) return false;                   //duplicate D_ value
+        if (d.resume < 0 || d.resume > D_MAX) return false;
+        if (runStateLookup.index[d.resume] == NUM_RUN_STATES) return false;     //resume state not in the table
+        if (runStateTable[runStateLookup.index[d.resume]].resume != D_GOTOSTANDBY) return false;    //resume must be to a go to state
+        if ((d.webState == W_STANDBY) != ((d.webCommands & WEB_STB) == 0)) return false;          //standby states cannot go to standby and vice versa
+        if (d.exit != nullptr && d.webState == W_STANDBY) return false;         //nothing to stop in standby states
+        if (d.entry == entryNotStandby && d.webState == W_STANDBY) return false;    //firmware updates stay enabled in standby states
+        if (d.entry == entryStandby && d.webState != W_STANDBY) return false;
+        if (d.next == 0 || (d.next & ~RS_NEXT_ANY) != 0) return false;        //no way out or a bit past the table
+        if ((d.next & webCommandNext(d.webCommands)) != webCommandNext(d.webCommands)) return false;   //web commands allowed in this state must be allowed changes
+        if (d.next != RS_NEXT_ANY && (d.next & webCommandNext(WEB_IN_STANDBY | WEB_NOT_STANDBY) & ~webCommandNext(d.webCommands)) != 0) return false;  //and refused ones not
+        if ((d.next & RS_NEXT_WEB_OUC) != RS_NEXT_WEB_OUC) return false;      //auo and aux are not limited by run state
+        if ((d.webState == W_STANDBY) != ((d.next & RS_BIT(RS_WEBGOTOAUTO)) != 0)) return false;  //auo schedule only in standby
+        if ((runStateTable[RS_STARTUP].next & RS_BIT(runStateLookup.index[d.resume])) == 0) return false;    //power on state must be allowed from startup
+        if (d.resume != D_GOTOSTANDBY && (runStateTable[RS_SLEEPING].next & RS_BIT(i)) == 0) return false;  //resumable states must be allowed after sleep
+    }
+    return true;
+}
+
+static_assert(sizeof(runStateTable) / sizeof(runStateTable[0]) == NUM_RUN_STATES, "runStateTable size");
+static_assert(NUM_RUN_STATES <= 32, "runStateTable next masks are 32 bits");
+static_assert(isRunStateTableValid(), "runStateTable entries are invalid");
+
+// helper to return the descriptor for a D_ run state or nullptr if it is not in runStateTable
+const RunStateDescriptor* findRunState(int state)
+{
+    if (state < 0 || state > D_MAX) return nullptr;
+    uint8_t i = runStateLookup.index[state];
+    return (i < NUM_RUN_STATES) ? &runStateTable[i] : nullptr;
+}
+
+// helper to change runState if the current state's next mask in runStateTable allows it, otherwise log and keep the current state V145
+bool setRunState(int state)
+{
+    if (state == runState) return true;
+    const RunStateDescriptor* from = findRunState(runState);
+    const RunStateDescriptor* to = findRunState(state);
+    if (from == nullptr || to == nullptr || (from->next & RS_BIT(to->index)) == 0)
+    {
+        Log.error("Run state change %i to %i refused", (int) runState, state);
+        return false;
+    }
+    runState = state;
+    return true;
+}
+
+// helper to return true if a web command is allowed in the current run state (unknown states are treated as standby)
+bool isWebCommandAllowed(uint16_t command)
+{
+    const RunStateDescriptor* d = findRunState(runState);
+    uint16_t allowed = (d != nullptr) ? d->webCommands : WEB_IN_STANDBY;
+    return (allowed & command) != 0;
+}
+
 void setup()
 {
     System.on(out_of_memory, outOfMemoryHandler);   // If system runs out of memory a System.reset() is done.
@@ -915,17 +1672,42 @@ void setup()
     // This allows a graceful shutdown on System.reset()
     Particle.setDisconnectOptions(CloudDisconnectOptions().graceful(true).timeout(3000));
 
+    #if PUBQ_THREAD
+    PublishQueuePosix::instance().withThread(true, PUBQ_HANDOFF);   //V148 must be before setup()
+    #endif // PUBQ_THREAD
+    PublishQueuePosix::instance().withEventPool(EVENT_BUFFERS, MAXDATA);   //V158 must be before any PublishQueueBuffer
 	PublishQueuePosix::instance().setup();
     PublishQueuePosix::instance().withRamQueueSize(0);
+    #if DRUP_DELTA || RATE_LIMIT
+    PublishQueuePosix::instance().withPublishCompleteUserCallback(publishCompleteCallback);    //V154 DRUP acknowledgements V159 budget count
+    #endif //DRUP_DELTA || RATE_LIMIT
+    #if RATE_LIMIT
+    PublishQueuePosix::instance().withPublishFilter(rateLimitFilter);                          //V159
+    #endif //RATE_LIMIT
+    #if EVENT_COALESCE
+    PublishQueuePosix::instance().withCoalesce(COALESCE_WINDOW, eventmultirec);     //V155 relay, DEST and DRUP bursts as one publish
+    #endif //EVENT_COALESCE
 
     // PublishQueuePosix::instance().clearQueues(); // may want to call this is hard reset
 
     setupMCP7940();
+    #if RTC_TICK
+    setupRtcTick();                                 // V149
+    #endif // RTC_TICK
 
-    Watchdog.init(WatchdogConfiguration().timeout(90s));    // V100 time increased to be more than 2x CONNECTION_TIMEOUT in ble_wifi_setup_manager  
-    Watchdog.start();                               // start the watchdog timer
+    Watchdog.init(WatchdogConfiguration().timeout(WATCHDOG_TIMEOUT));    // V100 time increased to be more than 2x CONNECTION_TIMEOUT in ble_wifi_setup_manager V141 reduced as no longer blocks in ble_wifi_setup_manager
+    watchdogStart();                                // start the watchdog timer V146
 
     restoreRestartDataFromRam();                    // restore restart data from RTC RAM
+    restoreWatchdogDataFromRam();                   // restore watchdog headroom data and count a watchdog reset V146
+    #if RATE_LIMIT
+    restoreBudgetDataFromRam();                     // restore this month's publish count V159
+    setupRateLimits();
+    #endif //RATE_LIMIT
+    #if DRUP_DELTA
+    restoreDrupDataFromRam();                       // continue the DRUP sequence numbers from before the restart V154
+    #endif //DRUP_DELTA
+    timerWatchdogMonitor.start();                   // V146
     Log.info("Resume Reason: %i Resume runstate: %i PowerOn State: %i Relay1234: %1i%1i%1i%1i HubBoard %c", restartdata.resumeReason, restartdata.resumeState, restartdata.powerOnState, restartdata.relayState[0], restartdata.relayState[1], restartdata.relayState[2], restartdata.relayState[3], restartdata.isHubBoard ? 'Y' : 'N'); //V076
 
     #if LVSUNCHARGER
@@ -936,6 +1718,9 @@ void setup()
     cloudconfigurationtodevice = Particle.ledger("zcloudconfigtodevice");   //V046
     cloudconfigurationtodevice.onSync(syncCallback);
     configurationstatus = Particle.ledger("zdeviceconfig"); //V046
+    #if STATUS_LEDGER
+    statusledger = Particle.ledger("zdevicestatus");        //V160
+    #endif //STATUS_LEDGER
 
     checkForConfiguration();
 
@@ -975,12 +1760,15 @@ void setup()
     #endif
 
     Particle.variable("LOOPC", loopRate);
+    Particle.variable("SSPRG", softStartProgress);  //V137
+    Particle.variable("TSRTT", timeSyncRTT);        //V142
+    Particle.variable("TSSTP", timeSyncStep);       //V142
 
     setupNetwork();                                 // setup the Etherwifi controller V033
 
     sensorReading();                                // read the current sensor
 
-    powerdata.isACsupply = isACSupplyPresent();     // check if AC supply is present
+    powerdata.isACsupply = isACSupplyPresent();     // check if AC supply is present (debounced state from interrupt V144)
 
 	provision_state = next_provision_state = STATE_IDLE;
     
@@ -1001,6 +1789,7 @@ void setup()
     #endif  //LVSUNCHARGER
 
     initTimers();
+    setupScheduler();                               // V138
     runStateInt = runState = prevRunState = D_STARTUP;
     lastLoop = micros();                            // set last loop time to current time
 }
@@ -1013,35 +1802,12 @@ int powerOnStateSelection()
     switch (param.powerOnState)
     {
         case POS_LAST:
+        {
             Log.info("Power On State: Last State %i", param.resumeState);
-            switch (param.resumeState)      //V104
-            {
-                case D_STANDBY:
-                    result = D_GOTOSTANDBY;
-                    break;
-                case D_TIMED_ON:
-                    result = D_GOTOTIMED_ON;
-                    break;
-                case D_ALWAYS_ON:
-                    result = D_GOTOALWAYS_ON;
-                    break;
-                case D_AUTO_OFF:
-                case D_AUTO_ON:
-                    result = D_GOTOAUTO;
-                    break;
-                case D_CHARGED_ON:
-                case D_CHARGED_ON_AUTO:
-                    result = D_GOTOCHARGED_ON;
-                    break;
-                case D_CHARGED_ON_USBC:
-                case D_CHARGED_ON_USBC_AUTO:
-                    result = D_GOTOCHARGED_ON_USBC;
-                    break;
-                default:
-                    result = D_GOTOSTANDBY;
-                    break;
-            }   
+            const RunStateDescriptor* d = findRunState(param.resumeState);     //V104 V145 resume state from runStateTable
+            result = (d != nullptr) ? d->resume : D_GOTOSTANDBY;
             break;
+        }
         case POS_STANDBY:
             Log.info("Power On State: Standby");
             result = D_GOTOSTANDBY;
@@ -1074,147 +1840,238 @@ void loop()
 {
     loopRate = (int) (micros() - lastLoop);         // calculate loop rate
     lastLoop = micros();                            // set last loop time to current time
+    #if LOOP_HISTOGRAM
+    latencyRecord(LS_LOOP, (uint32_t) loopRate);    // V139
+    #endif // LOOP_HISTOGRAM
 
-    Watchdog.refresh();                             // refresh the watchdog timer
+    watchdogRefresh();                              // refresh the watchdog timer and record the headroom V146
 
-    sensorReading();                                // read the sensors
+    mainsEventPoll();                               // handle mains on/off transitions queued by the interrupt V144
 
-    EthernetWiFi::instance().loop();                // required to manage network connection
-    checkNetworks();
+    loopStage(LS_SOFTSTART);                        // V139
+    softStartSequencer();                           // step any soft start of relays and LVSUN channels V137
 
-    configurationAvailableCheck();                  // check if configuration is available from Ledger update
+    runScheduler();                                 // run the periodic checks that are due V138
 
-    checkTimeSync();                                // check if time needs to be synchronized with cloud
-    clockTimeUpdate(false);                         // unforced check if time has changed and update if necessary V093
+    loopStage(LS_ETHERNET);                         // V139
+    EthernetWiFi::instance().loop();                // required to manage network connection
 
-    PublishQueuePosix::instance().loop();
+    loopStage(LS_PUBLISH);                          // V139
+    PublishQueuePosix::instance().loop();           // does nothing when the PUBQ_THREAD worker thread is running V148
 
     #if GOOGLE_LOCATE
     if (Particle.connected()) locator.loop();
     checkLocation();
     #endif  //GOOGLE_LOCATE
 
+    loopStage(LS_BLE);                              // V139
 	BLEWiFiSetupManager::instance().loop();
+    loopStage(LS_PROVISION);                        // V139
     wifiProvisioning();
 
-    checkScheduledStartUntilCharged();              //check if scheduled start smart charge needs to be actioned V111
-
+    loopStage(LS_CONTROLLER);                       // V139
     onViewRunState();                               //to present a usable runState to onView
 
-    switch (runState)                               //runState select action
-    {
-    case D_STARTUP:
-        startupController();
-        break;
-    case D_RESTART:
-        restartController();
-        break;
-    case D_GOTOSTANDBY:
-        goToStandbyController();
-        break;
-    case D_STANDBY:
-        standbyController();
-        break;
-    case D_WEBGOTORESTART:
-        webGoToRestartController();
-        break;
-    case D_GOTOTIMED_ON:
-        goToTimedOnController();
-        break;
-    case D_TIMED_ON:
-        timedOnController();
-        break;
-    case D_GOTOALWAYS_ON:
-        goToOnController();
-        break;
-    case D_ALWAYS_ON:
-        onController();
-        break;
-    case D_GOTOAUTO:
-        goToAutoController();
-        break;
-    case D_AUTO_OFF:
-    case D_AUTO_ON:
-        autoController();
-        break;
-    case D_GOTOCHARGED_ON:
-        goToChargedOnController();
-        break;
-    case D_GOTOCHARGED_ON_AUTO:
-        goToChargedOnAutoController();
-        break;
-    case D_CHARGED_ON:
-    case D_CHARGED_ON_AUTO:
-        chargedOnController();
-        break;
-    case D_GOTOCHARGED_ON_USBC:
-        #if LVSUNCHARGER
-        goToChargedOnUSBCController();
-        #endif //LVSUNCHARGER
-        break;
-    case D_GOTOCHARGED_ON_USBC_AUTO:
-        #if LVSUNCHARGER
-        goToChargedOnUSBCAutoController();
-        #endif //LVSUNCHARGER
-        break;
-    case D_CHARGED_ON_USBC:
-    case D_CHARGED_ON_USBC_AUTO:
-        #if LVSUNCHARGER
-        chargedOnUSBCController();
-        #endif //LVSUNCHARGER
-        break;
-    case D_GOTOSLEEP:
-        goToSleepController();
-        break;
-    case D_SLEEPING:
-        sleepingController();
-        break;
-    case D_WEBGOTOSTANDBY:
-        webGoToStandbyController();
-        break;
-    case D_WEBGOTOTIMED:
-        webGoToTimedController();
-        break;
-    case D_WEBGOTOAUTO:
-        webGoToAutoController();
-        break;
-    case D_WEBGOTOON:
-        webGoToOnController();
-        break;
-    case D_WEBGOTOCHARGED:
-    case D_WEBGOTOCHARGEDUSBC:
-        webGoToChargedController();
-        break;
-    case D_WEBGOTOHARDRESTART:
-        webGoToFactoryResetController();
-        break;
-    case D_WEBGOTOHIBERNATE:
-        webGoToHibernateController();
-        break;
-    case D_WEBOUCAUTO:
-        webGoToOUCAutoController();
-        break;
-    case D_WEBOUCAEXIT:
-        webOUCAExitController();
-        break;
-    default:
-        runState = D_STANDBY;
-    }
-
-    checkDeviceUpdate();
+    const RunStateDescriptor* rs = findRunState(runState);     //runState select action from runStateTable V145
+    if (runState != controllerCoState)              // each coroutine controller starts at its first step on entry V147
+    {
+        CO_RESET(controllerCo);
+        controllerCoState = runState;
+        if (rs != nullptr && rs->entry != nullptr) rs->entry();    // entry action from runStateTable V145
+    }
+    if (rs == nullptr)                  runState = D_STANDBY;
+    else if (rs->controller != nullptr) rs->controller();
+
+    loopStage(NUM_LOOP_STAGES);                     // end of loop stages V139
+}
+
+// periodic tasks run by runScheduler() in place of each function checking millis() itself on every loop V138
+Task tasks[] = {
+//   name   function                            stage               period                  tolerance   priority
+    {"SEN", sensorReading,                      LS_SENSORS,         SENSORCHK,              1000UL,     0},     // read the sensors
+    {"SUC", checkScheduledStartUntilCharged,    LS_TASKS,           TASKCHK,                1000UL,     1},     // check if scheduled start smart charge needs to be actioned V111
+    {"NET", checkNetworks,                      LS_TASKS,           NETWORK_CHECK_INTERVAL, 2000UL,     2},     // check network connections
+    {"DRU", checkDeviceUpdate,                  LS_DEVICEUPDATE,    TASKCHK,                1000UL,     3},     // check if device update DRUP is due (period depends upon runState)
+    {"CFG", configurationAvailableCheck,        LS_TASKS,           LAST_CONFIG,            5000UL,     4},     // check if configuration is available from Ledger update
+    {"CLK", clockTimeUpdate,                    LS_TASKS,           CLOCKUPDATE,            5000UL,     5},     // check if time has changed and update if necessary V093
+    {"TSY", checkTimeSync,                      LS_TASKS,           TIMESYNCCHK,            30000UL,    6},     // check if time needs to be synchronized with cloud
+    #if RATE_LIMIT
+    {"BUD", checkDataBudget,                    LS_TASKS,           BUDGETCHK,              5000UL,     7},     // add publishes to the monthly budget V159
+    #endif //RATE_LIMIT
+};
+
+const size_t NUM_TASKS = sizeof(tasks) / sizeof(tasks[0]);
 
+// setup the task scheduler - order the task table by priority and make all tasks due now
+void setupScheduler()
+{
+    for (size_t i = 1; i < NUM_TASKS; i++)          // insertion sort on priority, table is small and already in order
+    {
+        Task t = tasks[i];
+        size_t j = i;
+        while (j > 0 && tasks[j-1].priority > t.priority) {tasks[j] = tasks[j-1]; j--;}
+        tasks[j] = t;
+    }
+    timer_t now = millis();
+    for (size_t i = 0; i < NUM_TASKS; i++)
+    {
+        tasks[i].nextDue = now;
+        tasks[i].runs = tasks[i].lastMicros = tasks[i].worstMicros = 0;
+    }
+}
+
+// function called from loop() to run due tasks - the highest priority due task always runs, other due tasks run on this pass
+// only once they are later than their tolerance so the work is spread over loop passes rather than all in one
+void runScheduler()
+{
+    loopStage(LS_TASKS);                                            // V139
+    bool hasRun = false;
+    for (size_t i = 0; i < NUM_TASKS; i++)
+    {
+        Task &task = tasks[i];
+        long late = (long) (millis() - task.nextDue);
+        if (late < 0) continue;                                     // not yet due
+        if (hasRun && late < (long) task.tolerance) continue;       // can wait for a later pass
+
+        loopStage(task.stage);                                      // V139
+        uint32_t start = micros();
+        task.function();
+        task.lastMicros = micros() - start;
+        loopStage(LS_TASKS);                                        // V139 scheduler time after the task is not the task's
+        if (task.lastMicros > task.worstMicros) task.worstMicros = task.lastMicros;
+        task.runs++;
+        hasRun = true;
+
+        task.nextDue += task.period;                                // keep to the period rather than drift by the lateness
+        if ((long) (millis() - task.nextDue) >= 0) task.nextDue = millis() + task.period;   // more than a period behind so skip missed runs
+    }
+}
+
+// helper to return the milliseconds until the next task is due, 0 if one is due now
+timer_t schedulerIdleMillis()
+{
+    long idle = (long) ONE_DAY_MILLIS;
+    for (size_t i = 0; i < NUM_TASKS; i++)
+    {
+        long until = (long) (tasks[i].nextDue - millis());
+        if (until < idle) idle = until;
+    }
+    return (idle < 0) ? 0 : (timer_t) idle;
+}
+
+// function to mark the start of a loop() stage - the time since the previous mark is recorded against the previous stage V139
+void loopStage(uint8_t stage)
+{
+    if (stage == loopStageNow) return;
+    uint32_t now = micros();
+    #if LOOP_HISTOGRAM
+    if (loopStageNow < NUM_LOOP_STAGES) latencyRecord(loopStageNow, now - loopStageStart);
+    #endif // LOOP_HISTOGRAM
+    if (loopStageNow < NUM_LOOP_STAGES)             // V146
+    {
+        uint32_t us = now - loopStageStart;
+        passStageMicros += us;
+        if (us > passWorstMicros) {passWorstMicros = us; passWorstStage = loopStageNow;}
+    }
+    loopStageNow = stage;
+    loopStageStart = now;
+}
+
+#if LOOP_HISTOGRAM
+// helper to add a sample in microseconds to the latency histogram for a stage
+void latencyRecord(uint8_t stage, uint32_t us)
+{
+    LatencyHistogram &h = latency[stage];
+    uint8_t bucket = (uint8_t) (31 - __builtin_clz(us | 1));        // floor(log2(us)), 0 and 1 both go in bucket 0
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    h.count[bucket]++;
+    h.samples++;
+    if (us > h.maxMicros) h.maxMicros = us;
+}
+
+// helper to return the upper bound in microseconds of the bucket holding the percentile sample, limited to the maximum seen
+uint32_t latencyPercentile(const LatencyHistogram &h, uint8_t percent)
+{
+    if (h.samples == 0) return 0;
+    uint32_t target = (uint32_t) (((uint64_t) h.samples * percent + 99) / 100);   // rank of the percentile sample rounded up
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        cumulative += h.count[i];
+        if (cumulative >= target)
+        {
+            uint32_t upper = (i >= 31) ? UINT32_MAX : ((2UL << i) - 1);
+            return (upper < h.maxMicros) ? upper : h.maxMicros;
+        }
+    }
+    return h.maxMicros;
+}
+
+// helper to publish the p50/p99/max loop stage latencies in microseconds as a DIAG event and start new histograms
+void sendLatencyReport()
+{
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+    writer.beginObject();
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
+    writer.name("CX").value("Loop Latency");
+    writer.name("N").beginArray();
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) writer.value(loopStageNames[i]);
+    writer.endArray();
+    writer.name("C").beginArray();
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) writer.value((unsigned int) latency[i].samples);
+    writer.endArray();
+    writer.name("P50").beginArray();
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) writer.value((unsigned int) latencyPercentile(latency[i], 50));
+    writer.endArray();
+    writer.name("P99").beginArray();
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) writer.value((unsigned int) latencyPercentile(latency[i], 99));
+    writer.endArray();
+    writer.name("MX").beginArray();
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) writer.value((unsigned int) latency[i].maxMicros);
+    writer.endArray();
+    writer.endObject();
+    eventBuffer.publish(eventdiagnostic, PRIVATE);
+    memset(latency, 0, sizeof(latency));
+}
+#endif // LOOP_HISTOGRAM
+
+// helper to publish task run counts and durations (last and worst case in microseconds) as a DIAG event
+void sendTaskReport()
+{
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+    writer.beginObject();
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
+    writer.name("CX").value("Task Report");
+    writer.name("IDL").value((int) schedulerIdleMillis());
+    writer.name("T").beginArray();
+    for (size_t i = 0; i < NUM_TASKS; i++)
+    {
+        writer.beginObject();
+        writer.name("N").value(tasks[i].name);
+        writer.name("C").value((unsigned int) tasks[i].runs);
+        writer.name("L").value((unsigned int) tasks[i].lastMicros);
+        writer.name("W").value((unsigned int) tasks[i].worstMicros);
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+    eventBuffer.publish(eventdiagnostic, PRIVATE);
 }
 
 // helper to manage the restart (immediate post setup())
 void startupController()
 {
-    clockTimeUpdate(true);      // force check if date/time needs to be updated for DST V093
+    clockTimeUpdate();          // check if date/time needs to be updated for DST V093
     sendDESTevent();
 
     param.resumeFlag = 0;       // V097
     putParameters();
     
-    runState = powerOnStateSelection(); //V078 - select the power on state based on the parameter setting
+    setRunState(powerOnStateSelection()); //V078 - select the power on state based on the parameter setting
 }
 
 // helper to format and send DEST event at startup and on configuration change
@@ -1287,10 +2144,11 @@ void sendDESTevent()
     for (int i = 0; i < 6; i++) {param.bleA[i] = bacAddress[5-i];}  //V114
     snprintf(bleAddr, sizeof(bleAddr), "%02X:%02X:%02X:%02X:%02X:%02X", param.bleA[0], param.bleA[1], param.bleA[2], param.bleA[3], param.bleA[4], param.bleA[5]);
     
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("F").value(firmware);
     writer.name("V").value(softwarebuild);
     writer.name("H").value(hardwarebuild);
@@ -1356,8 +2214,60 @@ void sendDESTevent()
     writer.name("POS").value(param.powerOnState);
     if (bleAddr[0] != 0) writer.name("BLE").value((const char*)bleAddr);
     writer.name("LOC").value(param.isLocalMode);    //V128
+    #if RATE_LIMIT
+    writer.name("BUD").beginArray();                // month's publishes, budget, budget level and drops V159 - in DEST as DIAG is dropped once the budget is used
+    writer.value((unsigned) budgetdata.used);
+    writer.value((unsigned) DATAOPS_BUDGET);
+    writer.value((int) budgetLevel);
+    writer.value((unsigned) budgetdata.dropped);
+    writer.endArray();
+    writer.name("RLD").beginArray();                // drops since reset for each rateLimits[] row V159
+    for (size_t i = 0; i < NUM_RATE_LIMITS; i++) writer.value((unsigned) rateLimits[i].dropped);
+    writer.endArray();
+    #endif //RATE_LIMIT
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventstartupdat, dataStr, 50, PRIVATE);
+    if (writer.dataSize() > writer.bufferSize())
+    {
+        Log.error("DEST %u bytes does not fit", (unsigned) writer.dataSize());
+        return;
+    }
+    eventBuffer.publish(eventstartupdat, PRIVATE);
+    sendHealthReport();
+}
+
+// helper to publish the watchdog, sensor cache, event buffer and status Ledger counters as a DIAG event, they do not fit in DEST
+void sendHealthReport()
+{
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+    writer.beginObject();
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
+    writer.name("CX").value("Health Report");
+    writer.name("WDG").beginArray();                // worst watchdog refresh intervals ms and loopStageNames index, then watchdog resets V146
+    for (int i = 0; i < WATCHDOG_OFFENDERS; i++) {writer.value((int) watchdogdata.worstMs[i]); writer.value((int) watchdogdata.stage[i]);}
+    writer.value((int) watchdogdata.resets);
+    writer.endArray();
+    writer.name("SNC").beginArray();                // sensor cache hits and misses for CUR, TMP, XTP and BMS V151
+    for (int i = 0; i < NUM_SENSOR_CACHE; i++) {writer.value((int) sensorCache[i].hits); writer.value((int) sensorCache[i].misses);}
+    writer.endArray();
+    #if EVENT_COALESCE
+    writer.name("COA").value((unsigned) PublishQueuePosix::instance().getCoalesced());    //events merged into MREC publishes V155
+    #endif //EVENT_COALESCE
+    writer.name("EBM").value((unsigned) PublishQueuePosix::instance().getPoolMisses());   //event buffers from the heap as the pool was in use V158
+    #if STATUS_LEDGER
+    writer.name("SLS").beginArray();                // status Ledger sets and DRUPs not published since reset V160
+    writer.value((unsigned) statusSetCount);
+    writer.value((unsigned) statusSkipCount);
+    writer.endArray();
+    #endif //STATUS_LEDGER
+    writer.endObject();
+    if (writer.dataSize() > writer.bufferSize())
+    {
+        Log.error("Health Report %u bytes does not fit", (unsigned) writer.dataSize());
+        return;
+    }
+    eventBuffer.publish(eventdiagnostic, PRIVATE);
 }
 
 #if GOOGLE_LOCATE
@@ -1391,12 +2301,19 @@ void locationCallback(float lat, float lon, float accuracy)
 void setupTemperatureSensor()
 {
     fault[0] = tmpSensor.begin(0);
+    #if TEMP_CONTINUOUS
+    tmpSensor.setContinuous(true);                  //V143
+    #else
+    tmpSensor.startConversion();                    //first conversion ready for the first reading V143
+    #endif // TEMP_CONTINUOUS
 }
 
 // returns temperature at the sensor as smoothed float oC (sensor accuracy is +/- 1 oC)
+// collects the conversion started by the previous call and starts the next so there is no wait for the conversion V143
 float temperatureFromSensor()
 {
-    int _temp = tmpSensor.readTemperature();
+    int _temp = tmpSensor.collectTemperature();
+    tmpSensor.startConversion();
     _temp -= TEMPOFFSET;
     return smoothTemperature(_temp);
 }
@@ -1425,57 +2342,32 @@ void setupExternalTempSensor()
 {
     if (param.tempSensors == 0) return; // no external sensors to setup
 
-    int sensor = 1;
-    while(param.tempSensors >= sensor)
+    for (int sensor = 1; sensor <= param.tempSensors && sensor <= 4; sensor++)
     {
-        switch (sensor)
-        {
-            case 1:
-                fault[sensor] = extSensor1.begin(0);
-                break;
-            case 2:
-                fault[sensor] = extSensor2.begin(1);
-                break;
-            case 3:
-                fault[sensor] = extSensor3.begin(2);
-                break;
-            case 4:
-                fault[sensor] = extSensor4.begin(3);
-                break;
-            default:
-                break;
-        }
-        sensor++;
+        fault[sensor] = extSensors[sensor-1]->begin((uint8_t) (sensor-1));
+        if (fault[sensor] != 0) continue;
+        #if TEMP_CONTINUOUS
+        extSensors[sensor-1]->setContinuous(true);      //V143
+        #else
+        extSensors[sensor-1]->startConversion();        //all sensors convert in parallel V143
+        #endif // TEMP_CONTINUOUS
     }
 }
 
 // returns temperature at the external sensor as smoothed float oC (sensor accuracy is +/- 1 oC)
+// collects the conversions started by the previous call and starts the next for all sensors together V143
 float temperatureFromXSensor()
 {
     if (param.tempSensors == 0) return 0.0; // no external sensors to read
     int _temp[5] = {0};
-    int sensor = 1;
 
-    while (param.tempSensors >= sensor)
+    for (int sensor = 1; sensor <= param.tempSensors && sensor <= 4; sensor++)
     {
-        switch (sensor)
-        {
-            case 1:
-                if (fault[sensor] == 0) {_temp[sensor] = extSensor1.readTemperature();}
-                break;
-            case 2:
-                if (fault[sensor] == 0) {_temp[sensor] = extSensor2.readTemperature();}
-                break;
-            case 3:
-                if (fault[sensor] == 0) {_temp[sensor] = extSensor3.readTemperature();}
-                break;
-            case 4:
-                if (fault[sensor] == 0) {_temp[sensor] = extSensor4.readTemperature();}
-                break;
-            default:
-                break;
-        }
-        sensor++;
+        if (fault[sensor] == 0) {_temp[sensor] = extSensors[sensor-1]->collectTemperature();}
+    }
+    for (int sensor = 1; sensor <= param.tempSensors && sensor <= 4; sensor++)
+    {
+        if (fault[sensor] == 0) {extSensors[sensor-1]->startConversion();}
     }
 
     if      (param.tempSensors == 1)        // one external sensor
@@ -1532,6 +2424,28 @@ void saveRestartDataToRam()
     Log.info("Saved restart data to MCP7940 RAM %02x %02x %02x %02x %02x %02x %02x %02x", serializedRData[0], serializedRData[1], serializedRData[2], serializedRData[3], serializedRData[4], serializedRData[5], serializedRData[6], serializedRData[7]);
 }
 
+#if RATE_LIMIT
+// save the data operations budget to RTC RAM V159
+void saveBudgetDataToRam()
+{
+    std::memcpy(serializedBData, &budgetdata, sizeof(budgetData));
+    (void) MCP7940.writeRAM(BUDGETDATA_ADDR, serializedBData);
+}
+
+// restore the data operations budget from RTC RAM, counts start from zero if it is not valid V159
+void restoreBudgetDataFromRam()
+{
+    (void) MCP7940.readRAM(BUDGETDATA_ADDR, serializedBData);
+    std::memcpy(&budgetdata, serializedBData, sizeof(budgetData));
+    if (budgetdata.magic != BUDGET_MAGIC)
+    {
+        std::memset(&budgetdata, 0, sizeof(budgetData));
+        budgetdata.magic = BUDGET_MAGIC;
+    }
+    Log.info("Budget %lu publishes %lu dropped in %u/%u", budgetdata.used, budgetdata.dropped, budgetdata.month, budgetdata.year);
+}
+#endif //RATE_LIMIT
+
 // when AB1805 is enabled it's battery backed RAM can be used to restore restart data
 void restoreRestartDataFromRam()
 {
@@ -1540,6 +2454,114 @@ void restoreRestartDataFromRam()
     std::memcpy(&restartdata, serializedRData, sizeof(restartData));
 }
 
+// save the watchdog headroom data to RTC RAM V146
+void saveWatchdogDataToRam()
+{
+    std::memcpy(serializedWData, &watchdogdata, sizeof(watchdogData));
+    (void) MCP7940.writeRAM(WATCHDOGDATA_ADDR, serializedWData);
+}
+
+// restore the watchdog headroom data from RTC RAM, after a watchdog reset the stage saved by the monitor is recorded as a full timeout V146
+void restoreWatchdogDataFromRam()
+{
+    (void) MCP7940.readRAM(WATCHDOGDATA_ADDR, serializedWData);
+    std::memcpy(&watchdogdata, serializedWData, sizeof(watchdogData));
+    if (watchdogdata.magic != WATCHDOG_MAGIC)
+    {
+        std::memset(&watchdogdata, 0, sizeof(watchdogData));
+        watchdogdata.magic = WATCHDOG_MAGIC;
+        for (int i = 0; i < WATCHDOG_OFFENDERS; i++) watchdogdata.stage[i] = NUM_LOOP_STAGES;
+        watchdogdata.stallStage = NUM_LOOP_STAGES;
+    }
+    if (System.resetReason() == RESET_REASON_WATCHDOG)
+    {
+        uint8_t stage = (retainedStallMagic == WATCHDOG_MAGIC) ? retainedStallStage : NUM_LOOP_STAGES;
+        if (watchdogdata.resets < 255) watchdogdata.resets++;
+        watchdogdata.stallStage = stage;            // kept in RTC RAM as retained RAM is lost at power off
+        (void) watchdogRecord(WATCHDOG_TIMEOUT, stage);
+        Log.warn("Watchdog reset %i in loop stage %s", watchdogdata.resets, (stage < NUM_LOOP_STAGES) ? loopStageNames[stage] : "?");
+    }
+    retainedStallMagic = 0;
+    saveWatchdogDataToRam();
+}
+
+// helper to add a refresh interval to the worst offenders - each stage keeps only its worst interval, returns true if the offenders changed
+bool watchdogRecord(uint32_t ms, uint8_t stage)
+{
+    if (ms > UINT16_MAX) ms = UINT16_MAX;
+    int slot = WATCHDOG_OFFENDERS - 1;              // replace the least worst unless the stage is already there
+    for (int i = 0; i < WATCHDOG_OFFENDERS; i++)
+    {
+        if (watchdogdata.worstMs[i] > 0 && watchdogdata.stage[i] == stage) {slot = i; break;}
+    }
+    if (ms <= watchdogdata.worstMs[slot]) return false;
+    watchdogdata.worstMs[slot] = (uint16_t) ms;
+    watchdogdata.stage[slot] = stage;
+    for (; slot > 0 && watchdogdata.worstMs[slot] > watchdogdata.worstMs[slot-1]; slot--)     // keep longest first
+    {
+        std::swap(watchdogdata.worstMs[slot], watchdogdata.worstMs[slot-1]);
+        std::swap(watchdogdata.stage[slot], watchdogdata.stage[slot-1]);
+    }
+    return true;
+}
+
+// helper to start the watchdog, also after sleep, without the time stopped counting against the headroom V146
+void watchdogStart()
+{
+    watchdogLastRefresh = millis();
+    passStageMicros = passWorstMicros = 0;
+    passWorstStage = NUM_LOOP_STAGES;
+    Watchdog.start();
+    isWatchdogRunning = true;
+}
+
+// helper to stop the watchdog before sleep V146
+void watchdogStop()
+{
+    isWatchdogRunning = false;
+    Watchdog.stop();
+}
+
+// function called from loop() to refresh the watchdog and record the interval since the last refresh against the stage that took longest,
+// time outside the loop stages (system thread and before the first stage) is put against LS_LOOP V146
+void watchdogRefresh()
+{
+    Watchdog.refresh();
+    if (!isWatchdogRunning) return;                 // stopped for sleep and not started again
+    uint32_t now = millis();
+    uint32_t interval = now - watchdogLastRefresh;
+    uint32_t outside = interval * 1000UL - ((interval * 1000UL > passStageMicros) ? passStageMicros : interval * 1000UL);
+    uint8_t stage = (outside > passWorstMicros) ? LS_LOOP : passWorstStage;
+    bool isStalled = isWatchdogStallSaved;
+    if (isStalled) stage = watchdogStallStage;      // the monitor saw which stage was running when the interval became long
+
+    watchdogLastRefresh = now;
+    isWatchdogStallSaved = false;
+    passStageMicros = passWorstMicros = 0;
+    passWorstStage = NUM_LOOP_STAGES;
+
+    if (watchdogRecord(interval, stage) || isStalled)
+    {
+        if (isStalled) Log.warn("Watchdog refresh after %lu ms in loop stage %s", interval, (stage < NUM_LOOP_STAGES) ? loopStageNames[stage] : "?");
+        saveWatchdogDataToRam();
+    }
+    if (isStalled) retainedStallMagic = 0;          // loop() has recovered so the saved stage no longer applies
+}
+
+// handler for timerWatchdogMonitor - runs in the timer thread so it still runs while loop() is blocked, when the refresh interval passes
+// WATCHDOG_STALL_WARN the active loop stage is written to retained RAM so it is known after a watchdog reset V146
+// no I2C here as the timer could cut into a loop() transaction on the same bus, restoreWatchdogDataFromRam() copies it to RTC RAM
+void watchdogMonitor()
+{
+    if (!isWatchdogRunning || isWatchdogStallSaved) return;
+    if (millis() - watchdogLastRefresh < WATCHDOG_STALL_WARN) return;
+    uint8_t stage = loopStageNow;
+    watchdogStallStage = stage;
+    retainedStallStage = stage;
+    retainedStallMagic = WATCHDOG_MAGIC;            // after the stage so a reset between the two is not misread
+    isWatchdogStallSaved = true;
+}
+
 // when AB1805 is enabled it's battery backed RAM can be used to save time (and other) settings
 void saveTimeSettingsToRam()
 {
@@ -1585,53 +2607,68 @@ void restoreTimeSettingsFromRam()
 }
 
 // helper function to regularly check and update local time (if cloud connected or has been set before)
-void clockTimeUpdate(bool _forceUpdate)
+void clockTimeUpdate()
 {
-    static unsigned long lastclockupdate = 0;
-    if ((millis() - lastclockupdate >= CLOCKUPDATE) || _forceUpdate)    //V093
+    if (Time.isValid()) // only do this if RTC Time is valid
     {
-        lastclockupdate = millis();
-        if (Time.isValid()) // only do this if RTC Time is valid
+        if (param.isAutoDst) // only check automatically for change in DST if param.isAutoDst is true
         {
-            if (param.isAutoDst) // only check automatically for change in DST if param.isAutoDst is true
+            if (isDSTactive()) // true if changed, false if no change in DST - this is so it is only reported once
             {
-                if (isDSTactive()) // true if changed, false if no change in DST - this is so it is only reported once
-                {
-                    memset(dataStr, 0, sizeof(dataStr));
-                    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
-                    writer.beginObject();
-                    writer.name("date").value((const char*)getCreatedTime());
-                    writer.name("J").value((int)(param.isDst?1:0));
-                    writer.name("JC").value((int)(param.isAutoDst?2:0));
-                    writer.endObject();
-                    PublishQueuePosix::instance().publish(eventvarchanged, dataStr, 50, PRIVATE);
-                    saveTimeSettingsToRam();
-                }
+                PublishQueueBuffer eventBuffer;                 //V158
+                EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+                writer.beginObject();
+                char createdAt[CREATED_AT_SIZE];
+                writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
+                writer.name("J").value((int)(param.isDst?1:0));
+                writer.name("JC").value((int)(param.isAutoDst?2:0));
+                writer.endObject();
+                eventBuffer.publish(eventvarchanged, PRIVATE);
+                saveTimeSettingsToRam();
             }
         }
-        else
-        {
-            restoreTimeSettingsFromRam(); // restore time settings from RTC RAM
-        }
+    }
+    else
+    {
+        restoreTimeSettingsFromRam(); // restore time settings from RTC RAM
     }
 }
 
 // function to check if last sync with Particle Cloud is more than one day and if so then request time sync and update MCP7940 RTC
+// the request is not waited for, completion is checked on the next call and then the MCP7940 RTC is updated V142
 void checkTimeSync()
 {
+    static bool isSyncRequested = false;
+    static unsigned long syncRequested = 0;
+
+    if (isSyncRequested)
+    {
+        if (!Particle.syncTimeDone()) return;                                   //Time not yet received from Particle Device Cloud (done also if connection lost)
+        isSyncRequested = false;
+        unsigned long lastSync = Particle.timeSyncedLast();
+        if (lastSync >= syncRequested)                                          //Check if synchronized successfully
+        {
+            timeSyncRTT = (int) (lastSync - syncRequested);
+            timeSyncStep = (int) ((time_t) MCP7940.now().unixtime() - Time.now());
+            MCP7940.adjust(Time.now());                                         //Set the RTC to the current time
+            Log.info("Time sync round trip %i ms RTC corrected by %i s", timeSyncRTT, timeSyncStep);
+        }
+        else
+        {
+            Log.info("Time sync not completed");
+        }
+        return;
+    }
+
     if (Particle.connected())                                                   //Only time sync when Cloud connected V288
     {
         time_t lastSyncTimestamp;
         unsigned long lastSync = Particle.timeSyncedLast(lastSyncTimestamp);
         if (millis() - lastSync >= ONE_DAY_MILLIS)                              //More than one day since last time sync
         {
-            unsigned long cur = millis();
+            syncRequested = millis();
             Particle.syncTime();                                                //Request time synchronization from Particle Device Cloud
-            waitUntil(Particle.syncTimeDone);                                   //Wait until device receives time from Particle Device Cloud (or connection to Particle Device Cloud is lost)
-            if (Particle.timeSyncedLast() >= cur)                               //Check if synchronized successfully
-            {
-                MCP7940.adjust(Time.now());                                     //Set the RTC to the current time
-            }
+            isSyncRequested = true;
         }
     }
 }
@@ -1709,12 +2746,16 @@ bool isDSTactive()
     }
 }
 
-// helper to return created time in format for event "date" field
-char* getCreatedTime()
+#if TIMESTAMP_CACHE
+TimestampCache createdAtCache;              //V157 Time.format() text of the local time without strftime or a heap String
+Mutex createdAtMutex;                       //events are composed on loop(), Timer and system threads
+#endif //TIMESTAMP_CACHE
+
+// helper to write created time in format for event "date" field to the caller's buffer, returns the buffer
+const char* getCreatedTime(char* createdAt, size_t size)
 {
     time_t localTime = 0;
-    static char createdAt[28];
-    memset(createdAt, 0, sizeof(createdAt));
+    memset(createdAt, 0, size);
 
     if (!Time.isValid())
     {
@@ -1722,7 +2763,12 @@ char* getCreatedTime()
     }
     localTime = Time.now();
 
-    strcpy(createdAt, Time.format(localTime, "%Y-%m-%dT%H:%M:%S"));
+    #if TIMESTAMP_CACHE
+    size_t len = 0;
+    WITH_LOCK(createdAtMutex) {len = createdAtCache.format((int64_t) Time.local(), createdAt, size);}
+    if (len != 0) return createdAt;
+    #endif //TIMESTAMP_CACHE
+    strncpy(createdAt, Time.format(localTime, "%Y-%m-%dT%H:%M:%S"), size - 1);
     return createdAt;
 }
 
@@ -1780,6 +2826,8 @@ void setupPins()
     pinMode(P2_PDU_WAKE, INPUT_PULLDOWN);
 
   	pinMode(P2_PDU_SUPPLY_DETECT, INPUT);
+    isMainsPresent = digitalRead(P2_PDU_SUPPLY_DETECT);                 // initial state before edges are tracked V144
+    attachInterrupt(P2_PDU_SUPPLY_DETECT, mainsDetectISR, CHANGE);      // Attach interrupt to P2_PDU_SUPPLY_DETECT for mains on/off V144
 
   	pinMode(P2_PDU_BATT_CHARGING1, INPUT);
   	pinMode(P2_PDU_BATT_CHARGING2, INPUT);
@@ -1813,7 +2861,7 @@ void setupMCP7940()
                 Log.info("MCP7940 RTC is set");
                 time_t rtctime = MCP7940.now().unixtime();  // Get the time from the RTC as a time_t value
                 Time.setTime(rtctime);               // set the P2 time/date to the RTC time/date
-                sampleBMS(); // Sample the BMS to get the initial state
+                sampleBMS(SENSOR_AGE_NOW); // Sample the BMS to get the initial state V151
                 if (!batterydata.isFault)
                 {
                     if (MCP7940.getBattery())
@@ -1862,7 +2910,7 @@ void setupMCP7940()
                     time_t rtctime = MCP7940.now().unixtime();  // Get the time from the RTC as a time_t value
                     Time.setTime(rtctime);               // set the P2 time/date to the RTC time/date
                     Log.info("MCP7940 RTC is set update P2 time to %llu", rtctime);
-                    sampleBMS(); // Sample the BMS to get the initial state
+                    sampleBMS(SENSOR_AGE_NOW); // Sample the BMS to get the initial state V151
                     if (!batterydata.isFault)
                     {
                         if (MCP7940.getBattery())
@@ -1924,9 +2972,51 @@ void checkAlarm()
 // MFP interrupt handler for MCP7940
 void rtcMFP()
 {
+    #if RTC_TICK
+    if (isRtcTickEnabled)                           // 1 Hz square wave falling edge V149
+    {
+        rtcMFPMillis = millis();
+        rtcTick();
+        return;
+    }
+    #endif // RTC_TICK
     mfpPinTriggered = true;
 }
 
+#if RTC_TICK
+// call from setup() after setupMCP7940() to put the MFP into 1 Hz square wave mode and start the fallback V149
+void setupRtcTick()
+{
+    rtcMFPMillis = millis();
+    if (fault[5] == 0)                              // RTC found and running
+    {
+        MCP7940.setSQWSpeed(0, true);               // 1 Hz
+        isRtcTickEnabled = MCP7940.getSQWState();
+    }
+    Log.info("RTC 1 Hz tick %s", isRtcTickEnabled ? "from MFP" : "not available, using fallback");
+    timerTickFallback.start();
+}
+
+// one second tick from rtcMFP() or rtcTickFallback() with interrupts disabled - steps the minute timers
+void rtcTick()
+{
+    rtcTicks++;
+    timerCountdown.tick();
+    timerCharging.tick();
+}
+
+// handler for timerTickFallback - ticks only when the MFP ticks have stopped
+void rtcTickFallback()
+{
+    if (millis() - rtcMFPMillis < RTC_TICK_LOST) return;
+    ATOMIC_BLOCK()
+    {
+        rtcTick();
+        rtcTickFallbacks++;
+    }
+}
+#endif // RTC_TICK
+
 // call from setup() to initialise the ACS37800 current sensor
 void setupACS37800()
 {
@@ -1956,72 +3046,82 @@ void setupNetwork()
     else                   EthernetWiFi::instance().setAutomaticInterface(true);   //select according to what is available Ethernet or WiFi to connect
 
     connectTime = millis();
-    eventdelay = checknetwork = millis();
+    eventdelay = millis();
     wasEthernetConnected = false;
     wasWiFiConnected = false;
     wasCloudConnected = false;
 }
 
-// check network connection
-void checkNetworks()
-{    
-    if (millis() - checknetwork > NETWORK_CHECK_INTERVAL) //V089
+// check network connection
+void checkNetworks()
+{    
+    int activenetwork = EthernetWiFi::instance().getActiveInterface();
+
+    if ((activenetwork == (int) EthernetWiFi::ActiveInterface::OFF) && !param.isLocalMode) // V128
+    {
+        Log.info("Switched to local mode update parameters");
+        param.isLocalMode = true;
+        putParameters();
+    }
+    else if ((activenetwork != (int) EthernetWiFi::ActiveInterface::OFF) && param.isLocalMode)
+    {
+        Log.info("Switched to connected mode update parameters");
+        param.isLocalMode = false;
+        putParameters();
+    }
+
+    if (param.isLocalMode)
+    {
+        Log.info("Operating in local mode - no cloud connection attempts");
+    }
+    else
     {
-        checknetwork = millis();
+        isEthernetConnected = Ethernet.ready();
 
-        int activenetwork = EthernetWiFi::instance().getActiveInterface();
+        if      (isEthernetConnected && !wasEthernetConnected)  {wasEthernetConnected = true; }
+        else if (!isEthernetConnected && wasEthernetConnected)  {wasEthernetConnected = false;}
 
-        if ((activenetwork == (int) EthernetWiFi::ActiveInterface::OFF) && !param.isLocalMode) // V128
-        {
-            Log.info("Switched to local mode update parameters");
-            param.isLocalMode = true;
-            putParameters();
-        }
-        else if ((activenetwork != (int) EthernetWiFi::ActiveInterface::OFF) && param.isLocalMode)
+        if      (!isEthernetConnected)
         {
-            Log.info("Switched to connected mode update parameters");
-            param.isLocalMode = false;
-            putParameters();
+            isWiFiConnected = WiFi.ready();
+            
+            if      (isWiFiConnected && !wasWiFiConnected)      {wasWiFiConnected = true; }
+            else if (!isWiFiConnected && wasWiFiConnected)      {wasWiFiConnected = false;}
         }
 
-        if (param.isLocalMode)
-        {
-            Log.info("Operating in local mode - no cloud connection attempts");
-        }
-        else
+        if (isEthernetConnected || isWiFiConnected)
         {
-            isEthernetConnected = Ethernet.ready();
-
-            if      (isEthernetConnected && !wasEthernetConnected)  {wasEthernetConnected = true; }
-            else if (!isEthernetConnected && wasEthernetConnected)  {wasEthernetConnected = false;}
-
-            if      (!isEthernetConnected)
+            bool isCloudConnected = Particle.connected();
+            if (!isCloudConnected && wasNotCalledConnect) {wasNotCalledConnect = false; Particle.connect();}
+            if      (isCloudConnected && !wasCloudConnected)
             {
-                isWiFiConnected = WiFi.ready();
-                
-                if      (isWiFiConnected && !wasWiFiConnected)      {wasWiFiConnected = true; }
-                else if (!isWiFiConnected && wasWiFiConnected)      {wasWiFiConnected = false;}
+                wasCloudConnected = true;
+                connectedSince = millis();
+                MCP7940.adjust(Time.now());             // RTC updated with current time once cloud connected V093
             }
-
-            if (isEthernetConnected || isWiFiConnected)
+            else if (!isCloudConnected && wasCloudConnected)
             {
-                bool isCloudConnected = Particle.connected();
-                if (!isCloudConnected && wasNotCalledConnect) {wasNotCalledConnect = false; Particle.connect();}
-                if      (isCloudConnected && !wasCloudConnected)
-                {
-                    wasCloudConnected = true;
-                    connectedSince = millis();
-                    MCP7940.adjust(Time.now());             // RTC updated with current time once cloud connected V093
-                }
-                else if (!isCloudConnected && wasCloudConnected)
-                {
-                    wasCloudConnected = false;
-                    ethernetConnectedCount++;
-                    connectedSince = 0UL;
-                }
+                wasCloudConnected = false;
+                ethernetConnectedCount++;
+                connectedSince = 0UL;
             }
+        }
 
-            networkInfoEvent(); // publish network info event V070
+        static int prevActiveNetwork = -1;              //V150 only publish network info when the interface or WiFi network changes
+        static bool prevWiFiConnected = false;
+        static char prevSSID[33] = {0};                 //maximum SSID length is 32 char plus \0 terminator
+        char ssid[33] = {0};
+        if (activenetwork == (int) EthernetWiFi::ActiveInterface::WIFI && isWiFiConnected) strncpy(ssid, WiFi.SSID(), sizeof(ssid) - 1);
+        if (activenetwork != prevActiveNetwork || isWiFiConnected != prevWiFiConnected || strcmp(ssid, prevSSID) != 0)
+        {
+            prevActiveNetwork = activenetwork;
+            prevWiFiConnected = isWiFiConnected;
+            strcpy(prevSSID, ssid);
+            BusMessage msg;
+            msg.topic = BUS_INTERFACE;
+            msg.network.active = activenetwork;
+            msg.network.isWiFiConnected = isWiFiConnected;
+            busPublish(msg);
         }
     }
 }
@@ -2029,33 +3129,210 @@ void checkNetworks()
 // read sensor data
 void sensorReading()
 {
-    static unsigned long lastSensorRead = 0;
-    if (millis() - lastSensorRead > 10000UL) // every 10 seconds
-    {
-        lastSensorRead = millis();
+    mainsDetectReconcile();                         // catch any transition missed by the interrupt V144
 
-        powerdata.isACsupply = digitalRead(P2_PDU_SUPPLY_DETECT);
+    sampleBMS(SENSOR_AGE_CONTROL);                  //V151 sensor cache, a reading in the last second is reused
+        
+    sensorSample(SC_TEMPERATURE, SENSOR_AGE_CONTROL);
 
-        sampleBMS();
-            
-        boardTemp = temperatureFromSensor();
-        bTemp = (double) boardTemp;
+    #if EXT_TEMP_SENSOR
+    sensorSample(SC_XTEMPERATURE, SENSOR_AGE_CONTROL);
+    #endif
 
-        #if EXT_TEMP_SENSOR
-        xtemp = temperatureFromXSensor();
-        xTemps = (double) xtemp;
-        #endif
+    sampleCurrent(SENSOR_AGE_CONTROL);
+
+    //Log.info("Volts (RMS): %4.1f Amps(RMS): %5.3f Active Power(W): %4.2f Reactive Power(W): %4.2f", voltsrms, powerdata.ampsrms, powerdata.apowerwatt, powerdata.rpowerwatt);
+
+    #if SENSOR_STATS
+    sensorStatsAdd(SS_CURRENT, powerdata.ampsrms);  //V161
+    sensorStatsAdd(SS_VOLTAGE, powerdata.voltsrms);
+    #endif //SENSOR_STATS
+
+    BusMessage currentMsg;                          //V150
+    currentMsg.topic = BUS_CURRENT_SAMPLE;
+    currentMsg.current.amps = powerdata.ampsrms;
+    currentMsg.current.volts = powerdata.voltsrms;
+    busPublish(currentMsg);
 
-        sampleCurrent();
+    float maxtemp = boardTemp;
+    #if EXT_TEMP_SENSOR
+    maxtemp = max(boardTemp, xtemp);
+    #endif // EXT_TEMP_SENSOR
+    #if SENSOR_STATS
+    sensorStatsAdd(SS_TEMPERATURE, maxtemp);        //V161 the DRUP TMP
+    #endif //SENSOR_STATS
+
+    static bool isBusTemp = false;                  //V150/V151 only what was last published is kept, the readings themselves are in the sensor cache
+    static float busTemp = 0.0;                     //maxtemp when BUS_TEMPERATURE was last published
+    static int busMaxTemp = 0;                      //param.maxTemp when BUS_TEMPERATURE was last published, a new limit is re-evaluated at once
+    bool isCrossed = (maxtemp >= (float) param.maxTemp) != (busTemp >= (float) param.maxTemp)
+                  || (maxtemp < (float) (param.maxTemp - 10)) != (busTemp < (float) (param.maxTemp - 10));
+    if (!isBusTemp || fabsf(maxtemp - busTemp) >= BUS_TEMP_DELTA || isCrossed || param.maxTemp != busMaxTemp)
+    {
+        isBusTemp = true;
+        busTemp = maxtemp;
+        busMaxTemp = param.maxTemp;
+        BusMessage msg;                             //V150
+        msg.topic = BUS_TEMPERATURE;
+        msg.temperature.board = boardTemp;
+        msg.temperature.external = xtemp;
+        busPublish(msg);
+    }
+}
 
-        //Log.info("Volts (RMS): %4.1f Amps(RMS): %5.3f Active Power(W): %4.2f Reactive Power(W): %4.2f", voltsrms, powerdata.ampsrms, powerdata.apowerwatt, powerdata.rpowerwatt);
+// deliver a message to every subscriber of its topic in table order - called from loop() context only V150
+void busPublish(BusMessage& msg)
+{
+    if (msg.topic >= NUM_BUS_TOPICS) return;
+    msg.time = millis();
+    busCount[msg.topic]++;
+    for (size_t i = 0; i < NUM_BUS_SUBSCRIBERS; i++)
+    {
+        if (busSubscribers[i].topic == msg.topic) busSubscribers[i].handler(msg);
     }
 }
 
-// helper to return true if AC supply is present
+// bus subscriber - new current sample for the smart charge current check, the message carries powerdata.ampsrms and voltsrms V150
+void onBusCurrentSample(const BusMessage& msg)
+{
+    isCurrentSampleReady = true;
+}
+
+// bus subscriber - the temperature has moved so re-evaluate overheated from boardTemp and xtemp, the message carries the same readings V150
+void onBusTemperature(const BusMessage& msg)
+{
+    checkOverheated();
+}
+
+// bus subscriber - mains lost or restored V150, on loss the resume cause and state are saved when mainsEventPoll() takes the edge
+// off the queue at the start of the next loop() pass, ahead of the controller's own mains off handling on that pass V144
+void onBusMains(const BusMessage& msg)
+{
+    powerdata.isACsupply = msg.mains.isOn;
+    if (msg.mains.isOn) return;
+    const RunStateDescriptor* rs = findRunState(runState);
+    if (rs != nullptr && rs->resume != D_GOTOSTANDBY) prevRunState = runState;   //a running state is the one to resume, as its controller sets before D_GOTOSLEEP
+    param.resumeCause = RESUME_MAINS_OFF;       //what powerOnStateSelection() and the controllers resume from
+    param.resumeState = prevRunState;
+    putParameters();
+    restartdata.resumeReason = RESUME_MAINS_OFF;
+    restartdata.resumeState = prevRunState;
+    restartdata.powerOnState = param.powerOnState;
+    restartdata.isHubBoard = param.hubBoard == 1;
+    saveRestartDataToRam();
+}
+
+// bus subscriber - Hub port sample finished V150
+void onBusHubStatus(const BusMessage& msg)
+{
+    #if LVSUNCHARGER
+    hubAllGreenOrOff = msg.hub.allGreenOrOff;
+    isHubSampleReady = true;
+    #endif // LVSUNCHARGER
+}
+
+// bus subscriber - active interface or WiFi connection changed V150
+void onBusInterface(const BusMessage& msg)
+{
+    Log.info("Interface changed to %i WiFi %s", msg.network.active, msg.network.isWiFiConnected ? "connected" : "not connected");
+    networkInfoEvent(); // publish network info event V070
+}
+
+// helper to return true if AC supply is present - debounced state maintained by mainsDetectISR() V144
 bool isACSupplyPresent()
 {
-    return digitalRead(P2_PDU_SUPPLY_DETECT);
+    return isMainsPresent;
+}
+
+// interrupt handler for a change on P2_PDU_SUPPLY_DETECT - note the first edge and restart the debounce timer so the level is checked
+// once the pin has been quiet for MAINS_DEBOUNCE, a glitch shorter than that is then ignored rather than its return edge V144
+void mainsDetectISR()
+{
+    if (!isMainsPending)
+    {
+        isMainsPending = true;
+        mainsPendingEdge = millis();
+    }
+    timerMainsDebounce.resetFromISR();
+}
+
+// timer callback MAINS_DEBOUNCE after the last edge - accept the transition only if the pin still differs from the debounced state V144
+void mainsDebounceCheck()
+{
+    bool level = pinReadFast(P2_PDU_SUPPLY_DETECT);
+    ATOMIC_BLOCK()
+    {
+        isMainsPending = false;
+        if (level != isMainsPresent)
+        {
+            mainsLastEdge = mainsPendingEdge;
+            isMainsPresent = level;
+            mainsQueuePush(level, mainsPendingEdge);
+        }
+    }
+}
+
+// helper to add a transition to the mains event queue - single producer so only called with interrupts disabled V144
+void mainsQueuePush(bool isOn, uint32_t time)
+{
+    uint8_t next = (mainsQueueHead + 1) & (MAINS_QUEUE_SIZE - 1);
+    if (next == mainsQueueTail)                             // full
+    {
+        mainsQueueOverflow++;
+        return;
+    }
+    mainsQueue[mainsQueueHead].isOn = isOn;
+    mainsQueue[mainsQueueHead].time = time;
+    mainsQueueHead = next;
+}
+
+// function called from loop() to take transitions off the mains event queue so the controllers see them on this pass V144
+void mainsEventPoll()
+{
+    uint8_t head;
+    bool isPresent;
+    ATOMIC_BLOCK()                                          // the queue and the state it ends in, a later edge is left for the next pass
+    {
+        head = mainsQueueHead;
+        isPresent = isMainsPresent;
+    }
+    while (mainsQueueTail != head)
+    {
+        bool isOn = mainsQueue[mainsQueueTail].isOn;
+        uint32_t time = mainsQueue[mainsQueueTail].time;
+        mainsQueueTail = (mainsQueueTail + 1) & (MAINS_QUEUE_SIZE - 1);
+        mainsLastChange = time;
+        Log.info("Mains supply %s %lu ms ago", isOn ? "restored" : "lost", millis() - time);
+        BusMessage msg;                                     //V150
+        msg.topic = BUS_MAINS;
+        msg.mains.isOn = isOn;
+        msg.mains.edge = time;
+        busPublish(msg);
+    }
+    if (powerdata.isACsupply != isPresent)                  //queue overflowed so publish the debounced state V150
+    {
+        BusMessage msg;
+        msg.topic = BUS_MAINS;
+        msg.mains.isOn = isPresent;
+        msg.mains.edge = mainsLastEdge;
+        busPublish(msg);
+    }
+}
+
+// helper to compare the debounced state with the pin in case an edge was missed during sleep V144
+void mainsDetectReconcile()
+{
+    bool level = digitalRead(P2_PDU_SUPPLY_DETECT);
+    ATOMIC_BLOCK()
+    {
+        if (!isMainsPending && level != isMainsPresent && (millis() - mainsLastEdge) >= MAINS_DEBOUNCE)    //a pending edge is left to mainsDebounceCheck()
+        {
+            mainsLastEdge = millis();
+            isMainsPresent = level;
+            mainsQueuePush(level, mainsLastEdge);
+        }
+    }
+    mainsEventPoll();
 }
 
 // loop function to handle WiFi provisioning
@@ -2088,7 +3365,7 @@ void wifiProvisioning()
                 if (WiFi.ready() && !(Particle.connected()))
                 {
                     Log.info("WiFi connected - let the BLE mobile app know");
-                    cloudConnected();
+                    startCloudConnect();                                            //V140
                     BLEWiFiSetupManager::instance().status_message("Connected to WAP");
                     BLEWiFiSetupManager::instance().status_message("Connecting to Cloud..."); // let the BLE mobile app know WiFi is connected
                 }
@@ -2123,8 +3400,7 @@ void wifiProvisioning()
                     Log.info("WiFi but not Cloud connected");
                     WiFi.listen(false); //stop listening V105
                     wasBLEinformed = false; //V101
-                    cloudConnected();
-                    next_provision_state = STATE_IDLE;
+                    startCloudConnect();                    //V140
                 }
                 else
                 {
@@ -2149,20 +3425,14 @@ void wifiProvisioning()
                     Log.info("WiFi credentials available, connecting to WiFi");
                     wasBLEinformed = false; //V101
                     WiFi.connect();
-                    waitFor(WiFi.ready, 20000);
-                    if (WiFi.ready())
-                    {
-                        WiFi.listen(false); //stop listening V105
-                        cloudConnected();
-                        next_provision_state = STATE_IDLE;
-                    }
+                    provisionStart = millis();              //V140 wait for WiFi.ready() in STATE_WIFI_CONNECTING
+                    next_provision_state = STATE_WIFI_CONNECTING;
                 }
                 else if (WiFi.ready() && !(Particle.connected()))
                 {
                     Log.info("WiFi but not Cloud connected");
                     wasBLEinformed = false; //V101
-                    cloudConnected();
-                    next_provision_state = STATE_IDLE;
+                    startCloudConnect();                    //V140
                 }
                 else
                 {
@@ -2173,31 +3443,61 @@ void wifiProvisioning()
             }
             break;
         }
+
+        case STATE_WIFI_CONNECTING:                     //V140 set in STATE_CREDENTIALS after WiFi.connect()
+        {
+            if (WiFi.ready())
+            {
+                Log.info("WiFi connected after %lu ms", millis() - provisionStart);
+                WiFi.listen(false); //stop listening V105
+                startCloudConnect();
+            }
+            else if (millis() - provisionStart >= WIFI_CONNECT_TIMEOUT)
+            {
+                Log.info("WiFi connection timeout");
+                next_provision_state = STATE_CREDENTIALS;   //try again as before
+            }
+            break;
+        }
+
+        case STATE_CLOUD_CONNECTING:                    //V140 set by startCloudConnect()
+        {
+            if (Particle.connected())
+            {
+                Log.info("Cloud connected after %lu ms", millis() - provisionStart);
+                connectedStatus = 1;
+                next_provision_state = STATE_IDLE;
+            }
+            else if (millis() - provisionStart >= CLOUD_CONNECT_TIMEOUT)
+            {
+                Log.info("Cloud connection timeout");
+                next_provision_state = STATE_IDLE;
+            }
+            break;
+        }
     }
     if (provision_state != next_provision_state) provision_state = next_provision_state;
 }
 
-// Function to handle waiting for Particle connected
-void cloudConnected()
+// Function to start a Particle Cloud connection, the result is handled by STATE_CLOUD_CONNECTING without blocking V140
+void startCloudConnect()
 {
     Particle.connect();
-    waitFor(Particle.connected, 20000);
-    if (Particle.connected())
-    {
-        connectedStatus = 1;
-    }
+    provisionStart = millis();
+    next_provision_state = STATE_CLOUD_CONNECTING;
 }
 
 // send event DEUP to indicate that the device was connected/disconnected to BLE Central for WiFi provisioning V071
 void sendBLEProvisioningEvent(bool isConnected)
 {
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("BTC").value(isConnected?1:0); // 1 = connected, 0 = disconnected
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventvarchanged, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventvarchanged, PRIVATE);
 }
 
 // entry from: runState has been set to D_RESTART by a web command
@@ -2229,8 +3529,6 @@ void restartController()
 // exit to   : runState = D_STANDBY
 void goToStandbyController()
 {
-    System.enableUpdates();             //re-enable firmware updates when in D_STANDBY 
-
     if (param.isOUCMonitoring)          //if background monitoring for OUC start true 
     {
         if (param.hubBoard == 0)    oucState = ON_UNTIL_AUTO;   //no hub board fitted Smart AC charge V111
@@ -2243,7 +3541,7 @@ void goToStandbyController()
 
     if (powerState == W_MAINS_OFF)
     {
-        runState = D_GOTOSLEEP;
+        setRunState(D_GOTOSLEEP);
     }
     else
     {
@@ -2256,7 +3554,7 @@ void goToStandbyController()
         param.resumeMinutes = -1;
         param.resumeCause = 0;                              //reset resume cause V092
         putParameters();
-        runState = D_STANDBY;
+        setRunState(D_STANDBY);
     }
 }
 
@@ -2270,7 +3568,6 @@ void standbyController()
     {
         //runState = D_STANDBY;                      //stay in standby V124
         prevRunState = runState;                     //save previous run state for resume V124
-        checkOverheated();
         if (isOverheated && !wasOverheated)          //if overheated then set flag
         {
             wasOverheated = true;                       //set flag to true not acted upon
@@ -2291,12 +3588,13 @@ void standbyController()
         param.resumeMinutes = -1;
         putParameters();
         prevRunState = runState;                    //save previous run state for resume
-        runState = D_GOTOSLEEP;
+        setRunState(D_GOTOSLEEP);
     }
     else                                            //this is an error condition as neither MAINS_ON or OFF
     {
-        snprintf(dataStr, MAXDATA, "{\"CX\":\"Error Power %i Run %i charge %i prevrun %i ouc %i mins %i trace %i\"}", powerState, runState, chargeState, prevRunState, oucState, chargeMins, trace);
-        PublishQueuePosix::instance().publish(eventdiagnostic, dataStr, 50, PRIVATE);
+        PublishQueueBuffer eventBuffer;             //V158
+        snprintf(eventBuffer.data(), eventBuffer.size(), "{\"CX\":\"Error Power %i Run %i charge %i prevrun %i ouc %i mins %i trace %i\"}", powerState, runState, chargeState, prevRunState, oucState, chargeMins, trace);
+        eventBuffer.publish(eventdiagnostic, PRIVATE);
         powerState = W_MAINS_ON;
         chargeState = C_NOT_CHARGING;
     }
@@ -2328,7 +3626,6 @@ void checkOverheated()
 // exit to   : runState = D_TIMED_ON
 void goToTimedOnController()
 {
-    System.disableUpdates();                                //disable firmware updates when not in D_STANDBY
     powerState = powerStateCheck();                         //check power supply V104 
     Log.info("goToTimedOnController powerState %i", powerState);
     if (powerState == W_MAINS_ON)
@@ -2345,11 +3642,11 @@ void goToTimedOnController()
         chargingDevices = -1;                               //means web app will display "not measured"
         mainsofftime = 0UL;                                 //reset the time the mains power is lost
         helperDelayDRUP();                                  //V116
-        runState = D_TIMED_ON;
+        setRunState(D_TIMED_ON);
     }
     else
     {
-        runState = D_GOTOSTANDBY;
+        setRunState(D_GOTOSTANDBY);
     }
 }
 
@@ -2361,8 +3658,6 @@ void timedOnController()
     powerState = powerStateCheck();
     if (runState == D_TIMED_ON)                             //avoid this code if user has signalled exit to standby
     {
-        checkOverheated();
-
         helperCheckFirstDRUP();                             //V116
 
         if (isUpdateCountdown)                              //minute timer has ended - check if countdown has ended
@@ -2384,7 +3679,7 @@ void timedOnController()
             param.resumeMinutes = -1;
             param.resumeCause = 0;
             ACRelaysOff(R_TIMED);                           //turn off relays and send event
-            runState = D_GOTOSTANDBY;
+            setRunState(D_GOTOSTANDBY);
         }
         else if (!timerCountdown.isActive() && powerState != W_MAINS_OFF && !isOverheated)   //Mains Power and suspended/not yet started/not overheated
         {
@@ -2438,7 +3733,7 @@ void timedOnController()
         else if (powerState == W_MAINS_OFF && ((millis() - mainsofftime) > GOTOSLEEPDELAY))
         {
             Log.info("Timed Mains Power Off Detected and GOTOSLEEPDELAY reached");
-            runState = D_GOTOSLEEP;
+            setRunState(D_GOTOSLEEP);
         }
     }
 }
@@ -2460,7 +3755,7 @@ void goToAutoController()
     chargingDevices = -1; 
     mainsofftime = 0UL;                                     //reset the time the mains power is lost
     Log.info("Go to Auto Controller");
-    runState = D_AUTO_OFF;
+    setRunState(D_AUTO_OFF);
 }
 
 // entry from: runState = D_AUTO_ON or D_AUTO_OFF (following D_GOTOAUTO) web command
@@ -2478,19 +3773,19 @@ void autoController()
         if (hasScheduleExpired())                           //schedule has expired
         {
             ACRelaysOff(R_NONE);                            //turn off relays and send event
-            memset(dataStr, 0, sizeof(dataStr));
-            JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+            PublishQueueBuffer eventBuffer;                 //V158
+            EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
             writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
+            char createdAt[CREATED_AT_SIZE];
+            writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
             writer.name("R").value(W_STANDBY);
             writer.name("CX").value("Schedule Expired go to standby");
             writer.endObject();
-            PublishQueuePosix::instance().publish(eventschedulexp, dataStr, 50, PRIVATE);
-            runState = D_GOTOSTANDBY;
+            eventBuffer.publish(eventschedulexp, PRIVATE);
+            setRunState(D_GOTOSTANDBY);
         }
         else
         {
-            checkOverheated();
             int i = 6*(Time.weekday()-1)+(Time.hour()/4);
             block = param.schedule[i];                          //find the byte in the schedule array for the weekday and 4 hour block
             int j = 7-(2*(Time.hour()%4)+(Time.minute()>29?1:0));
@@ -2520,7 +3815,7 @@ void autoController()
                                 break;
                         }
                         context = X_AUTO;
-                        runState = D_AUTO_ON;
+                        setRunState(D_AUTO_ON);
                         chargeMins = param.resumeMinutes;       //set minutes counted to value at reset
                         helperCleanUpResumeData();
                     }
@@ -2528,7 +3823,7 @@ void autoController()
                     {
                         Log.info("Auto On first time start");
                         chargeMins = 0;
-                        runState = D_AUTO_ON;
+                        setRunState(D_AUTO_ON);
                     }
                     starttimerCharging();                       //start charge timer
                     isChargingStarted = true;                   //indicate charging has started to reset the update event timer V108    
@@ -2551,7 +3846,7 @@ void autoController()
                     param.resumeState = D_AUTO_ON;              //added so that if mains off then after a period it will sleep and may go off if no battery power
                     param.resumeMinutes = chargeMins;
                     putParameters();
-                    runState = D_GOTOSLEEP;
+                    setRunState(D_GOTOSLEEP);
                 }
 
                 helperCheckFirstDRUP();                         //V131
@@ -2567,7 +3862,7 @@ void autoController()
                 if (powerState == W_CHARGING)                   //and currently relay is ON then switch OFF 
                 {
                     Log.info("Auto Schedule Off end charging");
-                    runState = D_AUTO_OFF;
+                    setRunState(D_AUTO_OFF);
                     stoptimerCharging(); 
                     ACRelaysOff(R_AUTO);                        //turn off relays and send event
                     prevRunState = runState;
@@ -2592,13 +3887,13 @@ void autoController()
                             default:
                                 break;
                         }
-                        runState = D_AUTO_OFF;
+                        setRunState(D_AUTO_OFF);
                         helperCleanUpResumeData(); 
                     }
                     else                                        //whilst schedule is off/mains on and not overheated loop will go thru here every time
                     {
                         chargeMins = 0;
-                        runState = D_AUTO_OFF;
+                        setRunState(D_AUTO_OFF);
                     }
                 }
 
@@ -2617,7 +3912,7 @@ void autoController()
                     Log.info("Auto Off Mains Power Off Detected and GOTOSLEEPDELAY reached");
                     param.resumeState = D_AUTO_OFF;             //added so that if mains off then after a period it will sleep and may go off if no battery power left
                     putParameters();
-                    runState = D_GOTOSLEEP;
+                    setRunState(D_GOTOSLEEP);
                 }
                 else if (prevRunState == D_GOTOAUTO)            //update the schedule screen now next On time available - just once
                 {
@@ -2637,14 +3932,15 @@ void autoController()
         {
             ACRelaysOff(T_AUTO);                                //turn off relays and send event
             isAutoTimeInValidSent = true;
-            memset(dataStr, 0, sizeof(dataStr));
-            JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+            PublishQueueBuffer eventBuffer;                 //V158
+            EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
             writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
+            char createdAt[CREATED_AT_SIZE];
+            writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
             writer.name("R").value(W_STANDBY);
             writer.name("CX").value("Suspended Time Invalid");
             writer.endObject();
-            PublishQueuePosix::instance().publish(eventscheduloff, dataStr, 50, PRIVATE);
+            eventBuffer.publish(eventscheduloff, PRIVATE);
         }
     }
 }
@@ -2748,8 +4044,6 @@ void helperCheckFirstDRUP()
 // exit to   : runState = D_ALWAYS_ON
 void goToOnController()
 {
-    System.disableUpdates();    //disable firmware updates when not in D_STANDBY
-
     powerState = powerStateCheck();                     //check power supply
     Log.info("Go to On Controller powerState %i", powerState);
     if (powerState == W_MAINS_ON)
@@ -2759,7 +4053,7 @@ void goToOnController()
         if (chargeMins <= 0)   chargeMins = 0;
         chargingDevices = -1;                           //means web app will display "not measured"
         helperDelayDRUP();                              //V116
-        runState = D_ALWAYS_ON;
+        setRunState(D_ALWAYS_ON);
     }
 }
 
@@ -2771,7 +4065,6 @@ void onController()
     powerState = powerStateCheck();                         //check power supply
     if (runState == D_ALWAYS_ON)                            //avoid this code if user has signalled exit to standby
     {
-        checkOverheated();
         prevRunState = runState;                            //have done continuous on at least once
 
         helperCheckFirstDRUP();                             //V116
@@ -2798,7 +4091,7 @@ void onController()
         if (istimerCountdown_ended)                         //maximum time on charge reached
         {
             ACRelaysOff(M_ONC);                             //turn off relays and send event
-            runState = D_GOTOSTANDBY;
+            setRunState(D_GOTOSTANDBY);
         }
         else if (!timerCharging.isActive() && powerState != W_MAINS_OFF && !isOverheated) //Mains Power and suspended/not yet started
         {
@@ -2856,7 +4149,7 @@ void onController()
         else if (powerState == W_MAINS_OFF && ((millis() - mainsofftime) > GOTOSLEEPDELAY))
         {
             Log.info("onController Mains Power Off Detected and GOTOSLEEPDELAY reached");
-            runState = D_GOTOSLEEP;
+            setRunState(D_GOTOSLEEP);
         }
     }
 }
@@ -2910,7 +4203,7 @@ void goToChargedOnAutoController()
             {
             case D_GOTOCHARGED_ON_AUTO:
                 helperGoToCharged(R_ONTIL);
-                runState = D_CHARGED_ON_AUTO;
+                setRunState(D_CHARGED_ON_AUTO);
                 break;
             default:
                 break;
@@ -2920,18 +4213,18 @@ void goToChargedOnAutoController()
         else                                                                    //CHARGED_ON
         {
             helperGoToCharged(R_ONTIL);
-            if (runState == D_GOTOCHARGED_ON) runState = D_CHARGED_ON;          //traps the condition that the web command standby has been sent during smart charge startup
+            if (runState == D_GOTOCHARGED_ON) setRunState(D_CHARGED_ON);        //traps the condition that the web command standby has been sent during smart charge startup
         }
     }
     else
     {
         if (runState == D_GOTOCHARGED_ON)
         {
-            runState = D_GOTOSTANDBY;
+            setRunState(D_GOTOSTANDBY);
         }
         else
         {
-            runState = prevRunState;                                            //go back to previous state and handle the MAINS_OFF there, userState unchanged
+            setRunState(prevRunState);                                          //go back to previous state and handle the MAINS_OFF there, userState unchanged
         }
     }
 }
@@ -2976,14 +4269,14 @@ void chargedOnController()
             stoptimerCharging();
             ACRelaysOff(M_ONTIL);                                               //turn off relays and send event
             putParameters(); 
-            runState = D_GOTOSTANDBY;                                           //max time reached switching off
+            setRunState(D_GOTOSTANDBY);                                         //max time reached switching off
         }
         else if (oucState == ON_UNTIL_OFF)                                      //web 'aux' command received
         {
             Log.info("smart AC charge web command to go to standby received");
             stoptimerCharging();                                                //stop the charging timer   
             ACRelaysOff(W_ONTIL);                                               //turn off relays and send event
-            runState = D_GOTOSTANDBY;                                           //standby
+            setRunState(D_GOTOSTANDBY);                                         //standby
         }
         else if (oucState == ON_UNTIL_WARM && chargeMins >= param.warmupMins)   //warmup period has ended
         {
@@ -2991,7 +4284,7 @@ void chargedOnController()
             chargeState = C_CHARGING_FULL;                                      //set chargeState to full charge V130
             iStep = 0;
             chargingDevices = 0;
-            sampleCurrent();
+            isCurrentSampleReady = false;                                       //the first current check waits for a sample after warmup V150
             currentupdate = millis();
             param.numDevices = numberOfAdaptors();                             //get number of devices connected V119
             Log.info("smart AC charge WARMUP ended after %i minutes ChargeState %i CAmps %f", chargeMins, chargeState, powerdata.ampsrms);
@@ -3015,8 +4308,8 @@ void chargedOnController()
                     else                                                        //mains restored (even if a short time off)
                     {
                         mainsPowerRestoredEvent();                              //send mains restored event
-                        if (param.resumeState == D_CHARGED_ON_AUTO) runState = D_GOTOCHARGED_ON_AUTO;       //restart the smart charge auto cycle
-                        else                                        runState = D_GOTOCHARGED_ON;            //restart the smart charge cycle
+                        if (param.resumeState == D_CHARGED_ON_AUTO) setRunState(D_GOTOCHARGED_ON_AUTO);     //restart the smart charge auto cycle
+                        else                                        setRunState(D_GOTOCHARGED_ON);          //restart the smart charge cycle
                         helperCleanUpResumeData();
                         return;                                                 //get out of the function
                     }
@@ -3037,7 +4330,7 @@ void chargedOnController()
             {
                 wasOverheated = true;
                 helperSmartMainsOffOverheated(X_ONTIL);
-                runState = D_GOTOSTANDBY;
+                setRunState(D_GOTOSTANDBY);
             }
             else if (powerState == W_MAINS_OFF && ((millis() - mainsofftime) > GOTOSLEEPDELAY)) //mains off for delay period
             {
@@ -3046,16 +4339,16 @@ void chargedOnController()
                 param.resumeState = runState;                                   //added so that if mains off then after a period it will sleep and may go off if no battery power left
                 param.resumeMinutes = 0;                                        //smart charge and auto smart will always need to restart the cycle
                 putParameters();
-                runState = D_GOTOSLEEP;
+                setRunState(D_GOTOSLEEP);
             }
             else if (powerState != W_MAINS_OFF && !isOverheated)                //only do this checking if not mains off AND not overheated
             {
                 if (oucState == ON_UNTIL_CHARGE)
                 {
-                    if (millis() - currentupdate > CCCHK)                       //time to check the charging current
+                    if (millis() - currentupdate > CCCHK && isCurrentSampleReady)   //time to check the charging current and BUS_CURRENT_SAMPLE has a new sample V150
                     {
                         int lastChargeState = chargeState;                      //get last charge state for comparison V103
-                        sampleCurrent();                                        //sample current and updates amps global variable
+                        isCurrentSampleReady = false;                           //powerdata.ampsrms is the sample sensorReading() published
                         Log.info("determineChargeState CAmps %f", powerdata.ampsrms); 
                         chargeState = determineChargeState(chargeState, cSlope, powerdata.ampsrms, param.numDevices, chargeMins);     //set chargeState value
                         if (chargeState == C_RATE_CHARGING) //V130
@@ -3107,7 +4400,7 @@ void chargedOnController()
                         isTriedAutoOUConce = true;                  //if Auto OuC Monitoring and ends normally then stop restart
                         wasSmartChargeEndedThisHalfHour = true;
                     }
-                    runState = D_GOTOSTANDBY;                       //really should send a special event for this - devices charged
+                    setRunState(D_GOTOSTANDBY);                     //really should send a special event for this - devices charged
                 }
             }
         }
@@ -3118,51 +4411,54 @@ void chargedOnController()
 void helperSendFullRateChargingEvent()
 {
     Log.info("helperSendFullRateChargingEvent");
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Full rate Charging Smart AC"); //V130
     writer.name("R").value(runStateInt);
     writer.name("LA").value((double) powerdata.ampsrms,3);
     writer.name("LV").value((double) powerdata.voltsrms,3);
     writer.name("KL").value(chargeState);   //V130
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventvarchanged,dataStr, 50, PRIVATE);        //send smart charge data
+    eventBuffer.publish(eventvarchanged, PRIVATE);        //send smart charge data
 }
 
 // helper to send rate monitoring charging event V130
 void helperSendRateMonitoringChargingEvent()
 {
     Log.info("helperSendRateMonitoringChargingEvent");
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Rate monitoring started"); //V130
     writer.name("R").value(runStateInt);
     writer.name("LA").value((double) powerdata.ampsrms,3);
     writer.name("LV").value((double) powerdata.voltsrms,3);
     writer.name("KL").value(chargeState);   //V130
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventvarchanged,dataStr, 50, PRIVATE);        //send smart charge data
+    eventBuffer.publish(eventvarchanged, PRIVATE);        //send smart charge data
 }
 
 // helper to send charging done event V130
 void helperSendChargingDoneEvent()
 {
     Log.info("helperSendChargingDoneEvent");
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Rate Monitoring Done"); //V130
     writer.name("R").value(runStateInt);
     writer.name("LA").value((double) powerdata.ampsrms,3);
     writer.name("LV").value((double) powerdata.voltsrms,3);
     writer.name("KL").value(chargeState);   //V130
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventvarchanged,dataStr, 50, PRIVATE);        //send smart charge data
+    eventBuffer.publish(eventvarchanged, PRIVATE);        //send smart charge data
 }
 
 // helper Smart AC/USBC Charging for Mains Off or Overheated
@@ -3228,13 +4524,13 @@ void goToChargedOnUSBCAutoController()
             }
 
             helperGoToUSBCCharged(R_USBC);
-            runState = D_CHARGED_ON_USBC_AUTO;
+            setRunState(D_CHARGED_ON_USBC_AUTO);
             prevRunState = runState;            
         }
         else                                                                    //CHARGED_ON_USBC
         {
             helperGoToUSBCCharged(R_USBC); 
-            if (runState == D_GOTOCHARGED_ON_USBC) runState = D_CHARGED_ON_USBC;//traps the condition that the web command standby has been sent during smart charge startup
+            if (runState == D_GOTOCHARGED_ON_USBC) setRunState(D_CHARGED_ON_USBC);//traps the condition that the web command standby has been sent during smart charge startup
             prevRunState = runState;                                            //V104
         }
     }
@@ -3242,11 +4538,11 @@ void goToChargedOnUSBCAutoController()
     {
         if (runState == D_GOTOCHARGED_ON_USBC)
         {
-            runState = D_GOTOSTANDBY;
+            setRunState(D_GOTOSTANDBY);
         }
         else
         {
-            runState = prevRunState;                                            //go back to previous state and handle the MAINS_OFF there, userState unchanged
+            setRunState(prevRunState);                                          //go back to previous state and handle the MAINS_OFF there, userState unchanged
         }
     }
 }
@@ -3264,6 +4560,7 @@ void helperGoToUSBCCharged(int _context)
     starttimerCharging();
     isChargingStarted = true;                //indicate charging has started to reset the update event timer V108    
     hubupdate = millis();                    //set the hub update time
+    hubSample = HS_IDLE;                     //abandon any Hub port sample from an earlier cycle V147
     charginginitialupdate = millis();            //set the initial update time V107
     Log.info("helperGoToUSBCCharged exit oucState %i resume mins %i", oucState, param.resumeMinutes);
 }
@@ -3292,7 +4589,7 @@ void chargedOnUSBCController()
                 stoptimerCharging();
                 ACRelaysOff(M_USBC);                                            //turn off relays and send event
                 chargeState = C_NOT_CHARGING;                                   //set chargeState to C_NOT_CHARGING
-                runState = D_GOTOSTANDBY;                                       //max time reached switching off
+                setRunState(D_GOTOSTANDBY);                                     //max time reached switching off
             }
         }
         else if (oucState == ON_UNTIL_OFF)                                      //web 'aux' command received
@@ -3301,7 +4598,7 @@ void chargedOnUSBCController()
             stoptimerCharging();
             ACRelaysOff(W_USBC);                                                //turn off relays and send event
             chargeState = C_NOT_CHARGING;                                       //V106
-            runState = D_GOTOSTANDBY;                                           //standby
+            setRunState(D_GOTOSTANDBY);                                         //standby
         }
         else                                                                    //maximum time not exceeded or suspended/not yet started
         {
@@ -3321,8 +4618,8 @@ void chargedOnUSBCController()
                     else                                                        //mains restored (even if a short time off)
                     {
                         mainsPowerRestoredEvent();                                   //send mains restored event
-                        if (param.resumeState == D_CHARGED_ON_USBC_AUTO) runState = D_GOTOCHARGED_ON_USBC_AUTO;       //restart the smart charge auto cycle
-                        else                                             runState = D_GOTOCHARGED_ON_USBC;            //restart the smart charge cycle
+                        if (param.resumeState == D_CHARGED_ON_USBC_AUTO) setRunState(D_GOTOCHARGED_ON_USBC_AUTO);     //restart the smart charge auto cycle
+                        else                                             setRunState(D_GOTOCHARGED_ON_USBC);          //restart the smart charge cycle
                         helperCleanUpResumeData();
                         return;                                                 //get out of the function 
                     }
@@ -3345,7 +4642,7 @@ void chargedOnUSBCController()
             {
                 wasOverheated = true;
                 helperSmartMainsOffOverheated(X_USBC);
-                runState = D_GOTOSTANDBY;
+                setRunState(D_GOTOSTANDBY);
             }
             else if (powerState == W_MAINS_OFF && ((millis() - mainsofftime) > GOTOSLEEPDELAY))
             {
@@ -3353,17 +4650,18 @@ void chargedOnUSBCController()
                 param.resumeMinutes = 0;                                        //smart charge and auto smart will always need to restart the cycle
                 putParameters();
                 Log.info("chargedOnUSBCController go to sleep runState %i", runState);
-                runState = D_GOTOSLEEP;
+                setRunState(D_GOTOSLEEP);
             }
             else if (powerState != W_MAINS_OFF && !isOverheated)                //only do this checking if not mains off AND not overheated
             {
                 if (oucState == ON_UNTIL_USBC)
                 {
-                    if (millis() - hubupdate >= HUB_UPDATE_INTERVAL)            //time to check the charging port status V106
+                    if (hubSample != HS_CHARGING && millis() - hubupdate >= HUB_UPDATE_INTERVAL) //time to check the charging port status V106
                     {
                         hubupdate = millis();
-                        if (chargeMins > 0 && sampleHubPorts()) {Log.info("charging done"); chargeState = C_CHARGING_DONE; oucState = ON_UNTIL_CHARGE;}    //sample Hub port statuses if all off or green then chargeState = C_CHARGING_DONE
+                        if (chargeMins > 0) startHubSample(HS_CHARGING);        //sample Hub port statuses over the next loop passes V147
                     }
+                    if (isHubSampleDone(HS_CHARGING) && hubAllGreenOrOff) {Log.info("charging done"); chargeState = C_CHARGING_DONE; oucState = ON_UNTIL_CHARGE;}    //if all off or green then chargeState = C_CHARGING_DONE
                 }
 
                 if (chargeState == C_CHARGING_ENDED)                            //charging completed for USBC V106
@@ -3377,14 +4675,18 @@ void chargedOnUSBCController()
                         wasSmartChargeEndedThisHalfHour = true;
                     }
                     chargeState = C_NOT_CHARGING;                               //set chargeState to C_NOT_CHARGING
-                    runState = D_GOTOSTANDBY;                                   //really should send a special event for this - devices charged
+                    setRunState(D_GOTOSTANDBY);                                 //really should send a special event for this - devices charged
                 }
                 else if (chargeState == C_CHARGING_DONE)                        //fully charged, now checked again after HUB_COMPLETION_DELAY
                 {
-                    if (millis() - hubupdate >= HUB_COMPLETION_DELAY)           //time to recheck the charging port status for completion V106
+                    if (hubSample != HS_COMPLETION && millis() - hubupdate >= HUB_COMPLETION_DELAY) //time to recheck the charging port status for completion V106
                     {
                         hubupdate = millis();
-                        if (sampleHubPorts())                                   //if all off or green then chargeState = C_CHARGING_DONE
+                        startHubSample(HS_COMPLETION);                          //V147
+                    }
+                    if (isHubSampleDone(HS_COMPLETION))                         //V147
+                    {
+                        if (hubAllGreenOrOff)                                   //if all off or green then chargeState = C_CHARGING_DONE
                         {
                             oucState = ON_UNTIL_END;
                             chargeState = C_CHARGING_ENDED;                     //set chargeState to C_CHARGING_ENDED V106
@@ -3403,34 +4705,59 @@ void chargedOnUSBCController()
     }
 }
 
-// helper to sample all configured Hub ports and return false if any are red
-bool sampleHubPorts()
+// helper to start sampling all configured Hub ports, any sample in progress for the other check is abandoned V147
+void startHubSample(uint8_t sample)
 {
-    bool allGreenOrOff = true;
+    CO_RESET(hubSampleCo);
+    hubSample = sample;
+    isHubSampleReady = false;
+}
 
-    char lvsun[4][17] = {0};
-    unsigned long timeout = millis();
+// helper to run the next step of the Hub port sample, returns true once when the sample started for this check has ended V147
+bool isHubSampleDone(uint8_t sample)
+{
+    if (hubSample != sample) return false;
+    if (!isHubSampleReady) sampleHubPorts();
+    if (!isHubSampleReady) return false;
+    hubSample = HS_IDLE;
+    return true;
+}
 
-    for (int8_t ch = 0; ch < hubdata.channelsIn; ch++)
-    {
-        while(isHUBbusy(I2C_ADDRESS) && (millis() - timeout < 500)) {delay(50);}
-        strcpy(&lvsun[ch][0], receiveMessage(I2C_ADDRESS, ch+1).c_str());
-        timeout = millis();
-    }
+// coroutine to sample all configured Hub ports, hubAllGreenOrOff is false if any are red - waits for the Hub between loop() passes V147
+void sampleHubPorts()
+{
+    CO_BEGIN(hubSampleCo);
+    hubAllGreenOrOff = true;
+    hubBusyStart = millis();
 
-    for (int8_t ch = 0; ch < hubdata.channelsIn; ch++)
+    for (hubSampleChannel = 0; hubSampleChannel < hubdata.channelsIn; hubSampleChannel++)
     {
-        for (int8_t p = 0; p < hubdata.portsIn; p++)
+        while (isHUBbusy(I2C_ADDRESS) && (millis() - hubBusyStart < HUB_BUSY_TIMEOUT)) CO_SLEEP(hubSampleCo, HUB_BUSY_POLL);
+
+        if (requestMessage(I2C_ADDRESS, hubSampleChannel+1) == 0)
         {
-            if (lvsun[ch][p] == 'R') //if any port is red
+            CO_SLEEP(hubSampleCo, HUB_MESSAGE_DELAY);       // Wait for the slave to process the command
+            String message = readMessage(I2C_ADDRESS);
+            for (int8_t p = 0; p < hubdata.portsIn && p < (int8_t) message.length(); p++)
             {
-                allGreenOrOff = false;
-                break;              //break out of the port loop
+                if (message.charAt(p) == 'R') //if any port is red
+                {
+                    hubAllGreenOrOff = false;
+                    break;              //break out of the port loop
+                }
             }
-        }   
+        }
+        hubBusyStart = millis();
+    }
+    Log.info("sampleHubPorts allGreenOrOff %c", hubAllGreenOrOff ? 'Y' : 'N');  //V106
+    {
+        BusMessage msg;                                 //V150 onBusHubStatus sets isHubSampleReady
+        msg.topic = BUS_HUB_STATUS;
+        msg.hub.allGreenOrOff = hubAllGreenOrOff;
+        msg.hub.channels = hubdata.channelsIn;
+        busPublish(msg);
     }
-    Log.info("sampleHubPorts allGreenOrOff %c", allGreenOrOff ? 'Y' : 'N');  //V106
-    return allGreenOrOff;
+    CO_END(hubSampleCo);
 }
 
 #endif // LVSUNCHARGER
@@ -3446,16 +4773,17 @@ void webGoToTimedController()
         putParameters();
     }
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("R").value((int)W_TIMED_ON);
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventtimedweb, dataStr, 50, PRIVATE); 
+    eventBuffer.publish(eventtimedweb, PRIVATE); 
     previousStateHandler(prevRunState);
     prevRunState = runState; 
-    runState = D_GOTOTIMED_ON;
+    setRunState(D_GOTOTIMED_ON);
     isChargingStarted = true;                //reset update event timer so that DRUP isn't sent V131    
 
 }
@@ -3471,16 +4799,17 @@ void webGoToAutoController()
         putParameters();
     }
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("R").value((int)W_AUTO_OFF);
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventautoweb, dataStr, 50, PRIVATE); 
+    eventBuffer.publish(eventautoweb, PRIVATE); 
     previousStateHandler(prevRunState);
     prevRunState = AUTOANDOFF; 
-    runState = D_GOTOAUTO;
+    setRunState(D_GOTOAUTO);
 }
 
 // entry from: runState = D_WEBGOTOON in Remote_Admin
@@ -3494,16 +4823,17 @@ void webGoToOnController()
         putParameters();
     }
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("R").value((int)W_ON);
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventonweb, dataStr, 50, PRIVATE); 
+    eventBuffer.publish(eventonweb, PRIVATE); 
     previousStateHandler(prevRunState);
     prevRunState = runState; 
-    runState = D_GOTOALWAYS_ON;
+    setRunState(D_GOTOALWAYS_ON);
     isChargingStarted = true;                //reset update event timer so that DRUP isn't sent V131    
 }
 
@@ -3518,18 +4848,19 @@ void webGoToChargedController()
         putParameters();
     }
     Log.info("webGoToChargedController");
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     if (runState == D_WEBGOTOCHARGED)   writer.name("R").value((int) W_CHARGED_ON);
     else                                writer.name("R").value((int) W_CHARGED_ON_USBC);
     //writer.name("KL").value((int) C_CHARGING);  //V103/V130
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventchargeweb, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventchargeweb, PRIVATE);
     previousStateHandler(prevRunState);
-    if (runState == D_WEBGOTOCHARGED)   runState = D_GOTOCHARGED_ON;
-    else                                runState = D_GOTOCHARGED_ON_USBC;
+    if (runState == D_WEBGOTOCHARGED)   setRunState(D_GOTOCHARGED_ON);
+    else                                setRunState(D_GOTOCHARGED_ON_USBC);
     isChargingStarted = true;                //reset update event timer so that DRUP isn't sent V131    
 }
 
@@ -3538,14 +4869,15 @@ void webGoToChargedController()
 // exit to   : runState = previous runState
 void webGoToOUCAutoController()
 {
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Enable");
     writer.name("AO").value(1);
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventoucautoweb, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventoucautoweb, PRIVATE);
     helperAutoSetup();
 }
 
@@ -3554,7 +4886,7 @@ void helperAutoSetup()
 {
     param.isOUCMonitoring = true;
     putParameters();
-    runState = prevRunState;                                        //go back to what it was doing and wait for auto green schedule check to pick up start
+    setRunState(prevRunState);                                      //go back to what it was doing and wait for auto green schedule check to pick up start
     isTriedAutoOUConce = false;                                     //need to clear this flag when Auto Smart Charge
     if (param.hubBoard == 0)    oucState = ON_UNTIL_AUTO;           //set value of oucState if Smart AC charging V111
     else                        oucState = ON_UNTIL_USBC;           //set value of oucState if Smart USBC charging V111
@@ -3567,22 +4899,26 @@ void webOUCAExitController()
 {
     previousStateHandler(prevRunState);
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("R").value(W_STANDBY);
     writer.name("AO").value(0);
     writer.name("CX").value("Disable");
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventoucstopweb, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventoucstopweb, PRIVATE);
 
     isTriedAutoOUConce = false;
-    runState = prevRunState;
     oucState = ON_UNTIL_OFF;
-    if (runState == D_TIMED_ON || runState == D_ALWAYS_ON || runState == D_CHARGED_ON)
+    if (prevRunState == D_TIMED_ON || prevRunState == D_ALWAYS_ON || prevRunState == D_CHARGED_ON)
+    {
+        setRunState(D_GOTOSTANDBY);                             //standby in the cases where these states and was monitoring for auto start smart charge
+    }
+    else
     {
-        runState = D_GOTOSTANDBY;                               //standby in the cases where these states and was monitoring for auto start smart charge
+        setRunState(prevRunState);
     }
 }
 
@@ -3591,6 +4927,8 @@ void webOUCAExitController()
 // exit to   : runStart = D_RESTART
 void webGoToFactoryResetController()
 {
+    CO_BEGIN(controllerCo);                 //V147
+    {
     resetParametersToDefault();            //reset parameters to defaults V135
     bool result = performConfiguration(); // perform the factory reset V062
     param.resumeFlag = HARD_RESET_CMD; 
@@ -3601,18 +4939,21 @@ void webGoToFactoryResetController()
     restartdata.resumeState = prevRunState;
     saveRestartDataToRam();
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Web Factory Reset");
     writer.name("CX").value(result ? "success" : "failed");
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventrestartweb, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventrestartweb, PRIVATE);
+    }
 
-    waitForQueueToEmpty();      //wait for the queue to empty if possible before going to sleep
+    CO_AWAIT_TIMEOUT(controllerCo, PublishQueuePosix::instance().getCanSleep(), QUEUE_EMPTY_TIMEOUT);  //wait for the queue to empty if possible before restart V147
 
-    runState = D_RESTART;
+    setRunState(D_RESTART);
+    CO_END(controllerCo);
 }
 
 // entry from: runState = D_WEBGOTOHIBERNATE in Remote_Admin
@@ -3620,31 +4961,37 @@ void webGoToFactoryResetController()
 // exit to   : Hibernating until WKP pin pulse V081
 void webGoToHibernateController()
 {
+    CO_BEGIN(controllerCo);                 //V147
+    {
     param.resumeCause = RESTART_HIBERNATE;
     putParameters();
     restartdata.resumeReason = RESTART_HIBERNATE;
     restartdata.resumeState = param.powerOnState;
     saveRestartDataToRam();
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Web Hibernate");
     writer.name("R").value((int)W_SLEEPING);
     writer.name("C").value(0); 
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventrestartweb, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventrestartweb, PRIVATE);
+    }
 
-    waitForQueueToEmpty();      //wait for the queue to empty if possible before going to sleep
+    CO_AWAIT_TIMEOUT(controllerCo, PublishQueuePosix::instance().getCanSleep(), QUEUE_EMPTY_TIMEOUT);  //wait for the queue to empty if possible before going to sleep V147
 
-    delay (1s);
+    CO_SLEEP(controllerCo, 1000UL);             //V147
 
-    Watchdog.stop();                            //stop watchdog timer
+    {
+    watchdogStop();                             //stop watchdog timer V146
     SystemSleepConfiguration config;
     config.mode(SystemSleepMode::HIBERNATE).gpio(P2_PDU_WAKE, RISING);
     System.sleep(config);
-
+    }
+    CO_END(controllerCo);
 }
 
 // entry from: runState = D_WEBGOTORESTART in Remote_Admin
@@ -3665,14 +5012,15 @@ void webGoToRestartController()
     restartdata.resumeState = prevRunState;
     param.resumeCause = RESTART_WEBCMD; //V076
     putParameters();
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Web Restart");
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventrestartweb, dataStr, 50, PRIVATE);
-    runState = D_RESTART;
+    eventBuffer.publish(eventrestartweb, PRIVATE);
+    setRunState(D_RESTART);
 }
 
 // entry from: runState = D_WEBGOTOSTANDBY in Remote_Admin V363
@@ -3681,15 +5029,16 @@ void webGoToRestartController()
 void webGoToStandbyController()
 {
     previousStateHandler(prevRunState);                                         //moved here before acknowledgement of web command so that XXSE event sent with Auto Off state consistent with ACRelaysOff() not needing another context
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("R").value((int)W_STANDBY);                                     //V056
     writer.name("CX").value("Web Cmd Standby");
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventstandbyweb, dataStr, 50, PRIVATE);
-    runState = D_GOTOSTANDBY;
+    eventBuffer.publish(eventstandbyweb, PRIVATE);
+    setRunState(D_GOTOSTANDBY);
 }
 
 // entry from: runState = D_GOTOSLEEP
@@ -3697,15 +5046,16 @@ void webGoToStandbyController()
 // exit to   : runState = D_SLEEPING
 void goToSleepController()
 {
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("CX").value("Go to Sleep");
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventsleep, dataStr, 50, PRIVATE); 
+    eventBuffer.publish(eventsleep, PRIVATE); 
     chargeState = 0;                    //to avoid endless looping with powerState being set as W_CHARGING when just W_MAINS_ON
-    runState = D_SLEEPING;
+    setRunState(D_SLEEPING);
 }
 
 // entry from: runState = D_SLEEPING
@@ -3713,27 +5063,41 @@ void goToSleepController()
 // exit to   : runState = D_RESTART
 void sleepingController()
 {
+    CO_BEGIN(controllerCo);                             //V147
     powerState = powerStateCheck();                     //check power supply just before sleep in case power has come back on
-    if (powerState == W_MAINS_OFF)                      //definitely no mains power
+    if (powerState == W_MAINS_ON)                       //powerState = MAINS_ON just before sleep called so recover as if sleep had been called and ended
+    {
+        helperAfterSleep();
+        return;
+    }
+    else if (powerState != W_MAINS_OFF)                 //not definitely no mains power so check again next time
+    {
+        return;
+    }
+
     {
         float maxtemp = boardTemp; // default to board temperature
         #if EXT_TEMP_SENSOR
         maxtemp = max(boardTemp, xtemp); // take the maximum of the two sensors
         #endif // EXT_TEMP_SENSOR
         connectedStatus = 0; 
-        memset(dataStr, 0, sizeof(dataStr));
-        JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+        PublishQueueBuffer eventBuffer;                 //V158
+        EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
         writer.beginObject();
-        writer.name("date").value((const char*)getCreatedTime());
+        char createdAt[CREATED_AT_SIZE];
+        writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
         writer.name("C").value(connectedStatus);
         writer.name("R").value(W_SLEEPING);
         writer.name("TMP").value(maxtemp,1);
         writer.name("POS").value(param.powerOnState);   //V072
         writer.name("CX").value("Sleep until AC power restored");
         writer.endObject();
-        PublishQueuePosix::instance().publish(eventvarchanged,dataStr, 50, PRIVATE);
-        waitForQueueToEmpty();                              //wait for the queue to empty if possible before going to sleep
+        eventBuffer.publish(eventvarchanged, PRIVATE);
+    }
 
+    CO_AWAIT_TIMEOUT(controllerCo, PublishQueuePosix::instance().getCanSleep(), QUEUE_EMPTY_TIMEOUT);  //wait for the queue to empty if possible before going to sleep V147
+
+    {
         if (powerStateCheck() == W_MAINS_OFF)               //check again that mains is still off
         {
             restartdata.resumeReason = RESUME_MAINS_OFF;    //save to backup RAM in case it never wakes up and is restarted
@@ -3749,7 +5113,7 @@ void sleepingController()
 
             BLEWiFiSetupManager::instance().stopStartAdvertising(false); //stop BLE advertising V063
 
-            Watchdog.stop();                                //stop watchdog timer
+            watchdogStop();                                 //stop watchdog timer V146
             System.enableUpdates();                         //enable firmware updates
 
             if (powerStateCheck() == W_MAINS_OFF)
@@ -3771,7 +5135,7 @@ void sleepingController()
             }
         }
 
-        Watchdog.start();                               //start watchdog timer V045
+        watchdogStart();                                //start watchdog timer V045 V146
         restoreRestartDataFromRam();                    //restore the restart data from backup RAM V072
 
         BLEWiFiSetupManager::instance().stopStartAdvertising(true); //restart BLE advertising V063
@@ -3801,12 +5165,12 @@ void sleepingController()
             if (param.resumeMinutes >= 0)
             {
                 System.disableUpdates();                //disable firmware updates when not in D_STANDBY
-                runState = param.resumeState;           //go directly back to charging controller to resume charging
+                setRunState(param.resumeState);         //go directly back to charging controller to resume charging
             }
             else
             {
                 isSleepWake = true;                     //set the flag to indicate that this is a wake from sleep and not a restart V072
-                runState = D_GOTOSTANDBY;               //go to standby
+                setRunState(D_GOTOSTANDBY);             //go to standby
             }
             mainsPowerRestoredEvent();
         }
@@ -3818,10 +5182,11 @@ void sleepingController()
             saveRestartDataToRam();                     //save the restart data to backup RAM V072
             param.resumeCause = RESTART_DEEP_POWER_DOWN;//V076
             putParameters();                            //save the parameters to flash V072
-            Watchdog.stop();                            //stop watchdog timer
+            watchdogStop();                             //stop watchdog timer V146
             SystemSleepConfiguration config;
             config.mode(SystemSleepMode::STOP).gpio(WKP, RISING); //was HIBERNATE
             System.sleep(config);
+            mainsDetectReconcile();                         //mains detect edges may be missed while sleeping V144
             restoreRestartDataFromRam();                    //restore the restart data from backup RAM V072
 
             BLEWiFiSetupManager::instance().stopStartAdvertising(true); //restart BLE advertising V063
@@ -3835,34 +5200,18 @@ void sleepingController()
                 if (param.resumeMinutes >= 0)
                 {
                     System.disableUpdates();                //disable firmware updates when not in D_STANDBY
-                    runState = param.resumeState;           //go directly back to charging controller to resume charging
+                    setRunState(param.resumeState);         //go directly back to charging controller to resume charging
                 }
                 else
                 {
                     isSleepWake = true;                     //set the flag to indicate that this is a wake from sleep and not a restart V072
-                    runState = D_GOTOSTANDBY;               //go to standby
+                    setRunState(D_GOTOSTANDBY);             //go to standby
                 }
                 mainsPowerRestoredEvent();
             }
         }
     }
-    else if (powerState == W_MAINS_ON)                  //powerState = MAINS_ON just before sleep called so recover as if sleep had been called and ended
-    {
-        helperAfterSleep();
-    }
-}
-
-// helper to check for event queue empty or timeout
-void waitForQueueToEmpty()
-{
-    unsigned long startchecking = millis();
-    const unsigned long TIMEOUT = 5000UL;
-
-    while ((!PublishQueuePosix::instance().getCanSleep()) && (millis() - startchecking < TIMEOUT))         //wait for the queue to empty before going to sleep
-    {
-        PublishQueuePosix::instance().loop();
-        delay(1);
-    }
+    CO_END(controllerCo);
 }
 
 // wake after gotoSleep either because mains restored just before sleep called or mains restored after sleep
@@ -3874,7 +5223,7 @@ void helperAfterSleep()
 
     if (param.resumeState > D_STANDBY)              //mains outage during charging and power now restored signalled
     {
-        runState = param.resumeState;               //go directly back to charging controller to resume charging and send WAKE/RESUME message
+        setRunState(param.resumeState);             //go directly back to charging controller to resume charging and send WAKE/RESUME message
     }
 }
 
@@ -3910,12 +5259,12 @@ void checkScheduledStartUntilCharged()
                         if (hasScheduleExpired())                               //schedule for OUC starting has expired V085 V090B V185
                         {
                             oucState = ON_UNTIL_OFF;
-                            memset(dataStr, 0, sizeof(dataStr));
-                            JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+                            PublishQueueBuffer eventBuffer;                 //V158
+                            EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
                             writer.beginObject();
                             writer.name("CX").value("Smart AC or USBC Schedule Expired");
                             writer.endObject();
-                            PublishQueuePosix::instance().publish(eventschedulexp, dataStr, 50, PRIVATE);
+                            eventBuffer.publish(eventschedulexp, PRIVATE);
                             param.isOUCMonitoring = false;                      //stop checking
                             putParameters();
                         }
@@ -3932,8 +5281,8 @@ void checkScheduledStartUntilCharged()
                                 if (!isTriedAutoOUConce)                        //not started once but exited due to no devices to charge under the same schedule block
                                 {
                                     prevRunState = runState;                    //save current runState as goToChargedOnAutoController or goToChargedOnUSBCAutoController will handle the stopping of current activity
-                                    if (param.hubBoard == 0)    runState = D_GOTOCHARGED_ON_AUTO;   //V111
-                                    else                        runState = D_GOTOCHARGED_ON_USBC_AUTO;
+                                    if (param.hubBoard == 0)    setRunState(D_GOTOCHARGED_ON_AUTO); //V111
+                                    else                        setRunState(D_GOTOCHARGED_ON_USBC_AUTO);
                                 }
                             }
                             else                                                //start cleared so clear flag to avoid never restarting
@@ -3947,12 +5296,12 @@ void checkScheduledStartUntilCharged()
                         if (!isAutoTimeInValidSent)                                         //just do once
                         {
                             isAutoTimeInValidSent = true;
-                            memset(dataStr, 0, sizeof(dataStr));
-                            JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+                            PublishQueueBuffer eventBuffer;                 //V158
+                            EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
                             writer.beginObject();
                             writer.name("CX").value("Time invalid");
                             writer.endObject();
-                            PublishQueuePosix::instance().publish(eventschedulexp, dataStr, 50, PRIVATE);
+                            eventBuffer.publish(eventschedulexp, PRIVATE);
                         }
                     }
                 }
@@ -4115,36 +5464,55 @@ int powerStateCheck()
 void previousStateHandler(int _prev)
 {
     Log.info("previousStateHandler: %i", _prev);
-    switch (_prev)
-    {
-        case D_AUTO_ON:
-            stoptimerCharging();
-            ACRelaysOff(W_AUTO); //was R_AUTO ?
-            break;
-        case D_AUTO_OFF:
-            ACRelaysOff(W_AUTO); //was R_AUTO ?
-            break;
-        case D_TIMED_ON:
-            stoptimerCountdown();
-            ACRelaysOff(W_TIMED);
-            break;
-        case D_ALWAYS_ON:
-            stoptimerCharging();
-            ACRelaysOff(W_ONC); 
-            break;
-        case D_GOTOCHARGED_ON: 
-        case D_CHARGED_ON:
-            stoptimerCharging();
-            ACRelaysOff(W_ONTIL);   //What if _ON_AUTO?
-            break;
-        case D_GOTOCHARGED_ON_USBC:
-        case D_CHARGED_ON_USBC:
-            stoptimerCharging();
-            ACRelaysOff(W_USBC);    //What if _ON_USBC_AUTO?
-            break;
-        default:
-            break;
-    }
+    const RunStateDescriptor* d = findRunState(_prev);         //exit action from runStateTable V145
+    if (d != nullptr && d->exit != nullptr) d->exit();
+}
+
+// exit actions for runStateTable when the run state is left by a web command V145
+void exitAutoOn()
+{
+    stoptimerCharging();
+    ACRelaysOff(W_AUTO); //was R_AUTO ?
+}
+
+void exitAutoOff()
+{
+    ACRelaysOff(W_AUTO); //was R_AUTO ?
+}
+
+void exitTimedOn()
+{
+    stoptimerCountdown();
+    ACRelaysOff(W_TIMED);
+}
+
+void exitAlwaysOn()
+{
+    stoptimerCharging();
+    ACRelaysOff(W_ONC); 
+}
+
+void exitChargedOn()
+{
+    stoptimerCharging();
+    ACRelaysOff(W_ONTIL);   //What if _ON_AUTO?
+}
+
+void exitChargedOnUSBC()
+{
+    stoptimerCharging();
+    ACRelaysOff(W_USBC);    //What if _ON_USBC_AUTO?
+}
+
+// entry actions for runStateTable called once by loop() when runState changes V145
+void entryStandby()
+{
+    System.enableUpdates();             //re-enable firmware updates when in D_STANDBY
+}
+
+void entryNotStandby()
+{
+    System.disableUpdates();            //disable firmware updates when not in D_STANDBY
 }
 
 // Linear Regression function V050
@@ -4176,28 +5544,30 @@ float linearRegression(int n, float x[], float y[])
 void mainsPowerOffEvent()
 {
     powerStateInt = powerState;
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("C").value(1);
     writer.name("Z").value(W_MAINS_OFF);
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventmainsoff, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventmainsoff, PRIVATE);
 }
 
 // helper to send message Mains Power Resumed
 void mainsPowerRestoredEvent()
 {
     powerStateInt = powerState;
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    PublishQueueBuffer eventBuffer;                 //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
     writer.beginObject();
-    writer.name("date").value((const char*)getCreatedTime());
+    char createdAt[CREATED_AT_SIZE];
+    writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
     writer.name("C").value(1);
     writer.name("Z").value(W_MAINS_ON);
     writer.endObject();
-    PublishQueuePosix::instance().publish(eventmainsresum, dataStr, 50, PRIVATE);
+    eventBuffer.publish(eventmainsresum, PRIVATE);
 }
 
 // helper clean up resume Minutes and State after a resume
@@ -4270,119 +5640,123 @@ void initTimers()
 }
 
 // switch AC solenoids on if off (with phased start) and publish event depending upon context - timed/auto/etc.
+// the phased start is run by softStartSequencer() from loop() and the event is sent by helperSoftStartDone() when complete V137
 void ACRelaysOn(int context)
 {
     prevPowerState = powerState;  
     powerState = powerStateInt = W_CHARGING;
-    for (size_t i = 0; i < sizeof(P2_PDU_RELAYS) / sizeof(P2_PDU_RELAYS[0]); i++)
-    {
-        pinSetFast(P2_PDU_RELAYS[i]);
-        delay(1000 * SSDELAY);  // phased start of relays to avoid inrush current issues V126
-    }
-
-    #if LVSUNCHARGER
-    delay(5s); // wait for LVSUN chargers to start up V059
-    for (int8_t i = 0; i < hubdata.channelsIn; i++)
-    {
-        LVSUNInputChannelsOnOff(I2C_ADDRESS, (uint8_t) i+1, true); // turn on LVSUN input channels V059
-        delay(1000 * SSDELAY);  // phased start of relays to avoid inrush current issues V126
-    }
-    if (hubdata.channelsIn > 0) Log.info("LVSUN Input Channels turned on");
-    #endif // LVSUNCHARGER
-
-    chargeState = C_CHARGING;
 
-    float maxtemp = boardTemp; // default to board temperature
-    #if EXT_TEMP_SENSOR
-    maxtemp = max(boardTemp, xtemp); // take the maximum of the two sensors
-    #endif // EXT_TEMP_SENSOR
+    softStart.state = SS_RELAYS;
+    softStart.step = 0;
+    softStart.context = context;
+    softStart.nextStep = millis();                  // first relay on the next sequencer pass
+    softStartProgress = 0;
+    softStartSequencer();                           // switch the first relay on now as before V137
+}
 
-    onViewRunState();
+// helper to return true while a soft start sequence is in progress V137
+bool isSoftStartActive()
+{
+    return softStart.state != SS_IDLE;
+}
 
-    sampleCurrent();                                                    //update ampsrms for use in events
+// function to step the soft start of AC relays and LVSUN input channels without blocking loop() V137
+// replaces delay(SSDELAY) per relay, delay(5s) and delay(SSDELAY) per LVSUN channel that were in ACRelaysOn()
+void softStartSequencer()
+{
+    if (softStart.state == SS_IDLE) return;
+    if ((long) (millis() - softStart.nextStep) < 0) return;     // next step not yet due
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    const uint8_t relays = (uint8_t) (sizeof(P2_PDU_RELAYS) / sizeof(P2_PDU_RELAYS[0]));
+    uint8_t channels = 0;
+    #if LVSUNCHARGER
+    if (hubdata.channelsIn > 0) channels = (uint8_t) hubdata.channelsIn;
+    #endif // LVSUNCHARGER
 
-    switch (context)
+    switch (softStart.state)
     {
-        case X_ONC:
-        case X_AUTO:
-        case X_TIMED:
-        case X_ONTIL:
-        case X_USBC:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            if (context == X_ONTIL) writer.name("CX").value("Resume Warm-up Smart AC"); //V130
-            else                    writer.name("CX").value("Resume After Suspend"); //V130
-            writer.name("R").value(runStateInt);
-            writer.name("Z").value(powerStateInt);
-            writer.name("LA").value((double) powerdata.ampsrms,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V113
-            if (context == X_ONTIL) writer.name("KL").value(chargeState);   //V130
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.endObject();
-        break;
-        case R_AUTO:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            writer.name("CX").value("Normal Start");
-            writer.name("R").value(W_AUTO_ON);
-            writer.name("Z").value(powerStateInt);
-            writer.name("LA").value((double) powerdata.ampsrms,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V113
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(chargeState);
-            writer.endObject();
+        case SS_RELAYS:
+            pinSetFast(P2_PDU_RELAYS[softStart.step]);
+            Log.info("Soft start relay %i on", softStart.step + 1);
+            softStart.step++;
+            softStart.nextStep = millis() + 1000 * SSDELAY;     // phased start of relays to avoid inrush current issues V126
+            if (softStart.step >= relays)
+            {
+                softStart.step = 0;
+                #if LVSUNCHARGER
+                softStart.state = SS_HUB_WAIT;
+                #else
+                softStart.state = SS_DONE;
+                #endif // LVSUNCHARGER
+            }
             break;
-        case R_ONTIL:
-        case R_USBC:
-        case R_ONC:
-        default:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            if (context == R_ONTIL) writer.name("CX").value("Normal Warm-up Smart AC"); //V130
-            else if (context == R_USBC) writer.name("CX").value("Normal Start USB-C");
-            else writer.name("CX").value("Normal Start");
-            writer.name("R").value(runStateInt);
-            writer.name("Z").value(powerStateInt);
-            writer.name("LA").value((double) powerdata.ampsrms,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V113
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(chargeState);
-            writer.endObject();
+        #if LVSUNCHARGER
+        case SS_HUB_WAIT:
+            softStart.nextStep = millis() + SSHUBDELAY;         // wait for LVSUN chargers to start up V059
+            softStart.state = (channels > 0) ? SS_HUB_CHANNELS : SS_DONE;
+            break;
+        case SS_HUB_CHANNELS:
+            LVSUNInputChannelsOnOff(I2C_ADDRESS, (uint8_t) softStart.step + 1, true); // turn on LVSUN input channels V059
+            Log.info("Soft start LVSUN Input Channel %i on", softStart.step + 1);
+            softStart.step++;
+            softStart.nextStep = millis() + 1000 * SSDELAY;     // phased start of channels to avoid inrush current issues V126
+            if (softStart.step >= channels)
+            {
+                Log.info("LVSUN Input Channels turned on");
+                softStart.state = SS_DONE;
+            }
             break;
+        #endif // LVSUNCHARGER
+        case SS_DONE:
+            softStart.state = SS_IDLE;
+            softStartProgress = 100;
+            helperSoftStartDone(softStart.context);
+            return;
+        default:
+            softStart.state = SS_IDLE;
+            return;
     }
 
-    switch (context)
-    {
-        case X_AUTO:
-        case R_AUTO:
-            PublishQueuePosix::instance().publish(eventscheduleon,dataStr, 50, PRIVATE);
-            break;
-        case X_ONC:
-        case R_ONC:
-            PublishQueuePosix::instance().publish(eventonstart,dataStr, 50, PRIVATE);
-            helperDelayDRUP();                              //V116
-            break;
-        case X_TIMED:
-        case R_TIMED:
-            PublishQueuePosix::instance().publish(eventtimerstart,dataStr, 50, PRIVATE);
-            helperDelayDRUP();                              //V116
-            break;
-        case X_ONTIL:
-        case R_ONTIL:
-        case X_USBC:
-        case R_USBC:
-            PublishQueuePosix::instance().publish(eventontilstart,dataStr, 50, PRIVATE);
-            helperDelayDRUP();                              //V116
-            break;
-    }
+    int done = relays;                              // steps completed for the progress variable
+    if (softStart.state == SS_RELAYS)               done = softStart.step;
+    else if (softStart.state == SS_HUB_CHANNELS)    done += softStart.step;
+    else if (softStart.state == SS_DONE)            done += channels;
+    softStartProgress = (100 * done) / (relays + channels + 1);        // +1 so 100 is only reported once the event is sent
+}
+
+// helper called by softStartSequencer() when the soft start is complete to publish the start event depending upon context V137
+void helperSoftStartDone(int context)
+{
+    chargeState = C_CHARGING;
+
+    float maxtemp = boardTemp; // default to board temperature
+    #if EXT_TEMP_SENSOR
+    maxtemp = max(boardTemp, xtemp); // take the maximum of the two sensors
+    #endif // EXT_TEMP_SENSOR
+
+    onViewRunState();
+
+    sampleCurrent(SENSOR_AGE_CONTROL);                                  //update ampsrms for use in events V151
+
+    const EventSchema* schema = findEventSchema(relayOnSchema, sizeof(relayOnSchema) / sizeof(relayOnSchema[0]), context);    //V152
+    if (schema == nullptr) return;
+
+    char createdAt[CREATED_AT_SIZE];
+    EventValues values = relayEventValues(createdAt, sizeof(createdAt), 0, maxtemp);
+    PublishQueueBuffer eventBuffer;                                     //V158
+    EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+    renderRelayEvent(writer, *schema, values);
+    eventBuffer.publish(schema->event, PRIVATE);
+    if (schema->isDelayDRUP) helperDelayDRUP();                         //V116
 }
 
 // switch AC solenoids off if on and publish event depending upon context - timed/auto/none - V409 added last charge data
 void ACRelaysOff(int context)
 {
+    if (isSoftStartActive()) Log.info("Soft start abandoned at state %i step %i", softStart.state, softStart.step);   //V137
+    softStart.state = SS_IDLE;                      // abandon any soft start in progress so no further relays or channels are switched on V137
+    softStartProgress = 100;
+
     for (size_t i = 0; i < sizeof(P2_PDU_RELAYS) / sizeof(P2_PDU_RELAYS[0]); i++)
     {
         pinResetFast(P2_PDU_RELAYS[i]);
@@ -4410,321 +5784,32 @@ void ACRelaysOff(int context)
     maxtemp = max(boardTemp, xtemp); // take the maximum of the two sensors
     #endif // EXT_TEMP_SENSOR
 
-    memset(dataStr, 0, sizeof(dataStr));
-    JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+    if (context == X_TIMED || context == R_TIMED || context == W_TIMED) kvalue = timerMins;
 
-    switch (context)
+    const EventSchema* schema = findEventSchema(relayOffSchema, sizeof(relayOffSchema) / sizeof(relayOffSchema[0]), context);  //V152
+    PublishQueueBuffer eventBuffer;                                     //V158
+    if (schema != nullptr)
     {
-        case R_NONE:
-        break;
-        case X_ONC:
-        case X_AUTO:
-        case X_TIMED:
-        case X_ONTIL:
-        case X_USBC:
-            if (context == X_TIMED) kvalue = timerMins;
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            writer.name("CX").value("Suspended Mains Off or Overheated");
-            writer.name("R").value(runStateInt);
-            writer.name("Z").value(powerStateInt);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("K").value(kvalue);
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(chargeState);
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case Z_ONC:
-        case Z_TIMED:
-        case Z_ONTIL:
-        case Z_USBC:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            writer.name("CX").value("Stopped for Auto Smart Charge");
-            writer.name("R").value(W_STANDBY);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        /*case M_ONC:*/
-        case M_ONTIL:
-        case M_USBC:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            writer.name("CX").value("Stopped at Maximum Time Charging");
-            writer.name("R").value(W_STANDBY);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("KL").value(chargeState);   //V130
-            writer.name("K").value(param.maxTimeOn);
-            writer.name("TMP").value((double)maxtemp,1);
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case W_ONC:
-        case R_ONC:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            if (context == R_ONC) writer.name("CX").value("Normal");
-            else writer.name("CX").value("Web Cmd Standby");
-            writer.name("R").value(W_STANDBY);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("K").value(chargeMins);
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(0);
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case R_AUTO:
-        case W_AUTO:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            if (context == R_AUTO) writer.name("CX").value("Normal");
-            else writer.name("CX").value("Web Cmd Standby");
-            writer.name("R").value(W_AUTO_OFF);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("K").value(kvalue);     //V097
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(0);
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case W_TIMED:
-        case R_TIMED:
-            kvalue = timerMins;
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            if (context == R_TIMED) writer.name("CX").value("Normal Period");
-            else writer.name("CX").value("Web Cmd Standby");
-            writer.name("R").value(W_STANDBY);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("K").value(kvalue);
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(0);
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case R_ONTIL:
-        case W_ONTIL:
-        case R_USBC:
-        case W_USBC:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            if (context == R_ONTIL) writer.name("CX").value("Extra time ended");
-            else writer.name("CX").value("Normal end");
-            writer.name("R").value(W_STANDBY);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(/*(double) powerdata.ampsrms*/0.0,3);   //V121
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("K").value(kvalue);
-            writer.name("TMP").value((double)maxtemp,1);
-            writer.name("KL").value(C_CHARGING_ENDED); //V130
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case T_AUTO:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            writer.name("CX").value("Suspended as no valid time");
-            writer.name("R").value(W_STANDBY);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
-        case AUTOANDOFF:
-            writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
-            writer.name("CX").value("Auto Control with schedule off");
-            writer.name("R").value(W_AUTO_OFF);
-            writer.name("Z").value(W_MAINS_ON);
-            writer.name("LA").value(0.0,3);
-            writer.name("LV").value((double) powerdata.voltsrms,3);         //V121
-            writer.name("TMP").value((double)maxtemp,1);
-            #if LVSUNCHARGER
-            if (hubdata.channelsIn > 0)                     //V091
-            {
-                writer.name("LV0").beginArray();
-                writer.value(1);
-                writer.value((const char*) &lvsun[0][0]);
-                writer.value(2);
-                writer.value((const char*) &lvsun[1][0]);
-                writer.value(3);
-                writer.value((const char*) &lvsun[2][0]);
-                writer.value(4);
-                writer.value((const char*) &lvsun[3][0]);
-                writer.endArray();
-            }
-            #endif //LVSUNCHARGER
-            writer.endObject();
-            break;
+        char createdAt[CREATED_AT_SIZE];
+        EventValues values = relayEventValues(createdAt, sizeof(createdAt), kvalue, maxtemp);
+        #if LVSUNCHARGER
+        if (hubdata.channelsIn > 0) values.lvsun = lvsun;              //V091
+        #endif // LVSUNCHARGER
+        EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+        renderRelayEvent(writer, *schema, values);
     }
 
     if (chargeState != C_NOT_CHARGING) chargeState = C_NOT_CHARGING;
 
-    switch (context)
-    {
-        case R_NONE:
-        break;
-        case X_TIMED:
-        case R_TIMED:
-        case Z_TIMED:
-        case W_TIMED:
-            PublishQueuePosix::instance().publish(eventtimerended, dataStr, 50, PRIVATE);
-            break;
-        case R_ONTIL:
-        case X_ONTIL:
-        case M_ONTIL:
-        case W_ONTIL:
-        case Z_ONTIL:
-        case R_USBC:
-        case X_USBC:
-        case M_USBC:
-        case W_USBC:
-        case Z_USBC:
-            PublishQueuePosix::instance().publish(eventontilended, dataStr, 50, PRIVATE);
-            break;
-        case X_ONC:
-        case R_ONC:
-        case M_ONC:
-        case Z_ONC:
-        case W_ONC:
-            PublishQueuePosix::instance().publish(eventonended, dataStr, 50, PRIVATE);
-            break;
-        case T_AUTO:
-            PublishQueuePosix::instance().publish(eventschedulexp, dataStr, 50, PRIVATE);
-            break;
-        case R_AUTO:
-        case X_AUTO:
-        case W_AUTO:
-        case AUTOANDOFF:
-            PublishQueuePosix::instance().publish(eventscheduloff, dataStr, 50, PRIVATE);
-            break;
-    }
+    if (schema != nullptr) eventBuffer.publish(schema->event, PRIVATE);
+}
+
+// helper to collect the values a relay event is rendered from, the date is written to createdAt V152
+EventValues relayEventValues(char* createdAt, size_t size, int kvalue, float maxtemp)
+{
+    EventValues values = {getCreatedTime(createdAt, size), runStateInt, powerStateInt, powerdata.ampsrms, powerdata.voltsrms,
+                          kvalue, chargeMins, param.maxTimeOn, maxtemp, chargeState, nullptr};
+    return values;
 }
 
 // helper function to test if valid auto schedule i.e. not expired and not all zero = none
@@ -4776,10 +5861,18 @@ byte decodeBase64(char b64chr)
     return index;
 }
 
-// helper function to read the current from power sensor
-void sampleCurrent()
+// helper to read the power sensor for the sensor cache V151
+void readCurrentSensor()
+{
+    mySensor.readRMS(&rawVoltsRMS, &rawAmpsRMS);                    // Read the RMS voltage and current
+}
+
+// helper function to read the current from power sensor - the sensor is read if the cached reading is older than maxAge V151
+void sampleCurrent(uint32_t maxAge)
 {
-    mySensor.readRMS(&powerdata.voltsrms, &powerdata.ampsrms);      // Read the RMS voltage and current
+    sensorSample(SC_CURRENT, maxAge);
+    powerdata.voltsrms = rawVoltsRMS;
+    powerdata.ampsrms = rawAmpsRMS;
     //mySensor.readPowerActiveReactive(&powerdata.apowerwatt, &powerdata.rpowerwatt); // Read the active power
     //powerdata.rpowerwatt -= RPOWER_OFFSET;                          // remove offset from reactive power reading
     if (powerdata.voltsrms < 100.0) powerdata.voltsrms = 0.0;       // if voltage is less than noise then no voltage
@@ -4802,7 +5895,7 @@ void sampleCurrent()
 // Charging               HIGH     LOW
 // Recoverable fault      LOW      HIGH
 // Non-recoverable fault  LOW      LOW
-void sampleBMS()
+void readBMS()
 {
     bool isCharging1 = digitalRead(P2_PDU_BATT_CHARGING1);
     bool isCharging2 = digitalRead(P2_PDU_BATT_CHARGING2);
@@ -4815,6 +5908,78 @@ void sampleBMS()
     battv = (double) batterydata.batvolts;
 }
 
+// helper to update batterydata if the cached reading is older than maxAge V151
+void sampleBMS(uint32_t maxAge)
+{
+    sensorSample(SC_BMS, maxAge);
+}
+
+// helper to read the board temperature for the sensor cache V151
+void readTemperatureSensor()
+{
+    boardTemp = temperatureFromSensor();
+    bTemp = (double) boardTemp;
+}
+
+// helper to read the external temperature sensors for the sensor cache V151
+void readXTemperatureSensor()
+{
+    #if EXT_TEMP_SENSOR
+    xtemp = temperatureFromXSensor();
+    xTemps = (double) xtemp;
+    #endif
+}
+
+// sensor cache - read the hardware only if the cached sample is older than maxAge, returns true if the hardware was read V151
+bool sensorSample(uint8_t sensor, uint32_t maxAge)
+{
+    if (sensor >= NUM_SENSOR_CACHE) return false;
+    SensorCache& sc = sensorCache[sensor];
+    if (sc.isValid && maxAge != SENSOR_AGE_NOW && millis() - sc.time < maxAge)
+    {
+        sc.hits++;
+        return false;
+    }
+    sc.read();
+    sc.time = millis();
+    sc.isValid = true;
+    sc.misses++;
+    return true;
+}
+
+#if SENSOR_STATS
+// add a sample to the window with Welford's update, no sums of squares to lose precision V161
+void sensorStatsAdd(uint8_t stat, float x)
+{
+    if (stat >= NUM_SENSOR_STATS) return;
+    SensorStats& st = sensorStats[stat];
+    st.count++;
+    if (st.count == 1) {st.min = x; st.max = x;}
+    else {if (x < st.min) st.min = x; if (x > st.max) st.max = x;}
+    double delta = (double) x - st.mean;
+    st.mean += delta / st.count;
+    st.m2 += delta * ((double) x - st.mean);
+}
+
+// sample standard deviation of the window, 0 for fewer than two samples V161
+double sensorStatsDeviation(const SensorStats& st)
+{
+    if (st.count < 2) return 0.0;
+    return sqrt(st.m2 / (st.count - 1));
+}
+
+// start a new window once the DRUP is published V161
+void sensorStatsReset()
+{
+    for (uint8_t i = 0; i < NUM_SENSOR_STATS; i++)
+    {
+        sensorStats[i].count = 0;
+        sensorStats[i].mean = 0.0;
+        sensorStats[i].m2 = 0.0;
+    }
+}
+#endif //SENSOR_STATS
+
 // helper function to test if valid schedule and returns type C, O or N if none or expired schedule
 char validSchedule()
 {
@@ -4846,6 +6011,9 @@ void checkDeviceUpdate()
 
     if (deviceupdate == 0 || (millis()-deviceupdate) >= DUPCHK)             //Slow down DEUP send rate when in standby or Auto_off but first time immediately
     {
+        #if STATUS_LEDGER
+        bool isForced = deviceupdate == 0;                                  //V160 first time, wake or charging just started is always history
+        #endif //STATUS_LEDGER
         deviceupdate = millis();                                            //moved here to keep the timing precise
         int mcd = 0;                                                        //V090 default to 0 
         int door = isDoorLocked?1:0;
@@ -4908,7 +6076,10 @@ void checkDeviceUpdate()
             }
         }
 
-        boardTemp = temperatureFromSensor();
+        sensorSample(SC_TEMPERATURE, SENSOR_AGE_REPORT);                    //V151 read only if sensorReading() has not sampled recently
+        #if EXT_TEMP_SENSOR
+        sensorSample(SC_XTEMPERATURE, SENSOR_AGE_REPORT);
+        #endif // EXT_TEMP_SENSOR
 
         float maxtemp = boardTemp; // default to board temperature
         
@@ -4953,13 +6124,11 @@ void checkDeviceUpdate()
         }
         #endif //LVSUNCHARGER
 
-        sampleCurrent();                                                    //update powerdata
+        sampleCurrent(SENSOR_AGE_REPORT);                                   //update powerdata if the cached sample is stale V151
 
-        sampleBMS();                                                        //update batterydata
-
-        memset(dataStr, 0, sizeof(dataStr));
-        JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+        sampleBMS(SENSOR_AGE_REPORT);                                       //update batterydata V151
 
+        bool isActive = false;                                              //V154 the charging and on states send LV0 rather than J and ST
         switch (runState) 
         {
             case D_TIMED_ON:
@@ -4970,92 +6139,417 @@ void checkDeviceUpdate()
             case D_CHARGED_ON_USBC_AUTO:
             case D_AUTO_ON:
             case D_AUTO_OFF:
-                writer.beginObject();
-                writer.name("date").value((const char*)getCreatedTime());
-                writer.name("C").value(connectedStatus);
-                writer.name("R").value(runStateInt);
-                writer.name("Z").value(powerStateInt);
-                writer.name("D").value(door);
-
-                if (wifi_rssi < 0)                  //V090 do not include in JSON if values 0
-                {
-                    writer.name("Q").value(wifi_rssi);
-                    writer.name("SS").value(strength, 2);
-                    writer.name("SQ").value(quality, 2);
-                }
-
-                writer.name("TMP").value((double)maxtemp,1);
-                writer.name("AO").value(ouc);
-                writer.name("KL").value(chargeState);
-                writer.name("MCD").value(mcd);
-                /*writer.name("J").value(jst);*/
-                writer.name("LA").value((double)powerdata.ampsrms,3);
-                writer.name("LV").value((double)powerdata.voltsrms, 1);     //V113
-                /*writer.name("AP").value((double)powerdata.apowerwatt, 2);*/
-                /*writer.name("RP").value((double)powerdata.rpowerwatt, 2);*/
-                writer.name("VBT").value((double)batterydata.batvolts, 3);
-                writer.name("CHG").value(batterydata.isCharging);
-                writer.name("CHD").value(batterydata.isCharged);
-                writer.name("BFT").value(batterydata.isFault);
-                writer.name("RBF").value(batterydata.isFaultRecoverable);
-                #if LVSUNCHARGER
-                if (powerStateInt != W_MAINS_OFF && hubdata.channelsIn > 0)
-                {
-                    writer.name("LV0").beginArray();
-                    writer.value(1);
-                    writer.value((const char*) &lvsun[0][0]);
-                    writer.value(2);
-                    writer.value((const char*) &lvsun[1][0]);
-                    writer.value(3);
-                    writer.value((const char*) &lvsun[2][0]);
-                    writer.value(4);
-                    writer.value((const char*) &lvsun[3][0]);
-                    writer.endArray();
-                }
-                #endif //LVSUNCHARGER
-                writer.endObject();
+                isActive = true;
                 break;
             default:
-                writer.beginObject();
-                writer.name("date").value((const char*)getCreatedTime());
-                writer.name("C").value(connectedStatus);
-                writer.name("R").value(runStateInt);
-                writer.name("Z").value(powerStateInt);
-                writer.name("D").value(door);
+                break;
+        }
 
-                if (wifi_rssi < 0)                  //V090 do not include in JSON if values 0
-                {
-                    writer.name("Q").value(wifi_rssi);
-                    writer.name("SS").value(strength, 2);
-                    writer.name("SQ").value(quality, 2);
-                }
+        DrupSnapshot cur = {};                                              //V154
+        drupSet(cur, DF_C, connectedStatus);
+        drupSet(cur, DF_R, runStateInt);
+        drupSet(cur, DF_Z, powerStateInt);
+        drupSet(cur, DF_D, door);
+        drupSet(cur, DF_Q, wifi_rssi);
+        drupSet(cur, DF_SS, strength);
+        drupSet(cur, DF_SQ, quality);
+        #if GOOGLE_LOCATE 
+        drupSet(cur, DF_Y, latitude);
+        drupSet(cur, DF_X, longitude);
+        #endif //GOOGLE_LOCATE
+        drupSet(cur, DF_TMP, maxtemp);
+        drupSet(cur, DF_AO, ouc);
+        drupSet(cur, DF_KL, chargeState);
+        drupSet(cur, DF_MCD, mcd);
+        drupSet(cur, DF_LA, powerdata.ampsrms);
+        drupSet(cur, DF_LV, powerdata.voltsrms);                            //V113
+        drupSet(cur, DF_J, jst);
+        drupSet(cur, DF_ST, temp[0]);
+        drupSet(cur, DF_VBT, batterydata.batvolts);
+        drupSet(cur, DF_CHG, batterydata.isCharging);
+        drupSet(cur, DF_CHD, batterydata.isCharged);
+        drupSet(cur, DF_BFT, batterydata.isFault);
+        drupSet(cur, DF_RBF, batterydata.isFaultRecoverable);
+
+        uint8_t mode = isActive ? DF_ACTIVE : DF_IDLE;
+        for (uint8_t i = 0; i < NUM_DRUP_FIELDS; i++)
+        {
+            uint8_t flags = drupFields[i].flags;
+            if ((flags & mode) == 0) continue;
+            if ((flags & DF_SIGNAL) && wifi_rssi >= 0) continue;            //V090 do not include in JSON if values 0
+            if ((flags & DF_LOCATE) && !GOOGLE_LOCATE) continue;
+            cur.present |= 1UL << i;
+        }
 
-                #if GOOGLE_LOCATE 
-                writer.name("Y").value((double)latitude, 4);
-                writer.name("X").value((double)longitude, 4);
-                #endif //GOOGLE_LOCATE
-
-                writer.name("TMP").value((double)maxtemp,1);
-                writer.name("AO").value(ouc);
-                writer.name("KL").value(chargeState);
-                writer.name("MCD").value(mcd);
-                writer.name("LA").value((double)powerdata.ampsrms, 3);
-                writer.name("LV").value((double)powerdata.voltsrms, 1); //V113
-                //writer.name("AP").value((double)powerdata.apowerwatt, 2);
-                //writer.name("RP").value((double)powerdata.rpowerwatt, 2);
-                writer.name("J").value(jst);
-                writer.name("ST").value((const char*)temp);
-                writer.name("VBT").value((double)batterydata.batvolts, 3);
-                writer.name("CHG").value(batterydata.isCharging);
-                writer.name("CHD").value(batterydata.isCharged);
-                writer.name("BFT").value(batterydata.isFault);
-                writer.name("RBF").value(batterydata.isFaultRecoverable);
-                writer.endObject();
-                break;
+        #if LVSUNCHARGER
+        if (isActive && powerStateInt != W_MAINS_OFF && hubdata.channelsIn > 0)
+        {
+            cur.hasHubPorts = true;
+            memcpy(cur.lvsun, lvsun, sizeof(cur.lvsun));
+        }
+        #endif //LVSUNCHARGER
+
+        #if STATUS_LEDGER
+        bool isLedgerCurrent = isStatusSet && !statusChanged(cur, statusSet, false);    //V160
+        if (!isLedgerCurrent && statusLedgerSet(cur)) {statusSet = cur; isStatusSet = isLedgerCurrent = true;}
+        bool isHistory = isForced || statusHistoryTime == 0 || (millis() - statusHistoryTime) >= STATUS_HISTORY_TIME || statusChanged(cur, statusHistory, true);
+        if (isLedgerCurrent && !isHistory && isStatusLedgerSynced()) {statusSkipCount++; return;}    //a failed or unsynced set falls back to DRUP
+        statusHistory = cur;
+        statusHistoryTime = millis();
+        #endif //STATUS_LEDGER
+
+        #if DRUP_DELTA
+        drupHandleAck();
+        bool isKeyframe = drupAckedSeq == 0 || drupSinceKeyframe + 1 >= DRUP_KEYFRAME_COUNT || (millis() - drupKeyframeTime) >= DRUP_KEYFRAME_TIME;
+        const DrupSnapshot& base = drupAcked;
+        drupSeq++;
+        saveDrupDataToRam();
+        #else
+        bool isKeyframe = true;
+        const DrupSnapshot& base = cur;
+        #endif //DRUP_DELTA
+
+        PublishQueueBuffer eventBuffer;                 //V158
+        #if TELEMETRY_CBOR
+        PublishQueueBuffer cborBuffer;                  //V158 CBOR before it is base85 wrapped into eventBuffer
+        TelemetryCBOR writer((uint8_t*) cborBuffer.data(), TELEMETRY_CBOR_SIZE);    //V153 same calls as JSONBufferWriter
+        #else
+        EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+        #endif //TELEMETRY_CBOR
+
+        writer.beginObject();
+        #if DRUP_DELTA
+        writer.name("SEQ").value((unsigned) drupSeq);                       //first so the publish complete callback can find it
+        if (isKeyframe) writer.name("KF").value(1);
+        else            writer.name("BS").value((unsigned) drupAckedSeq);
+        #endif //DRUP_DELTA
+        char createdAt[CREATED_AT_SIZE];
+        writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
+        for (uint8_t i = 0; i < NUM_DRUP_FIELDS; i++)
+        {
+            const DrupFieldDesc& f = drupFields[i];
+            bool isPresent = (cur.present >> i) & 1;
+            bool wasPresent = (base.present >> i) & 1;
+            if (!isKeyframe && isPresent == wasPresent && (!isPresent || cur.value[i] == base.value[i])) continue;  //unchanged
+            if (!isPresent)
+            {
+                if (!isKeyframe) writer.name(f.name).nullValue();           //no longer sent
+                continue;
+            }
+            writer.name(f.name);
+            if      (f.flags & DF_BOOL)     writer.value(cur.value[i] != 0);
+            else if (f.flags & DF_CHAR)     {char c[2] = {(char) cur.value[i], 0}; writer.value((const char*) c);}
+            else if (f.decimals > 0)        {double d = (double) cur.value[i]; for (uint8_t k = 0; k < f.decimals; k++) d /= 10.0; writer.value(d, f.decimals);}
+            else                            writer.value((int) cur.value[i]);
+        }
+        if (cur.hasHubPorts && (isKeyframe || !base.hasHubPorts || memcmp(cur.lvsun, base.lvsun, sizeof(cur.lvsun)) != 0))
+        {
+            writer.name("LV0").beginArray();
+            for (int ch = 0; ch < 4; ch++) {writer.value(ch + 1); writer.value((const char*) cur.lvsun[ch]);}
+            writer.endArray();
+        }
+        else if (!cur.hasHubPorts && base.hasHubPorts && !isKeyframe) writer.name("LV0").nullValue();
+        #if SENSOR_STATS
+        for (uint8_t i = 0; i < NUM_SENSOR_STATS; i++)                      //V161 always sent, a window is not part of the delta state
+        {
+            const SensorStats& st = sensorStats[i];
+            if (st.count == 0 || ((cur.present >> st.field) & 1) == 0) continue;
+            uint8_t decimals = drupFields[st.field].decimals;
+            writer.name(st.name).beginArray();
+            writer.value((unsigned) st.count);
+            writer.value((double) st.min, decimals);
+            writer.value((double) st.max, decimals);
+            writer.value(st.mean, decimals);
+            writer.value(sensorStatsDeviation(st), decimals);
+            writer.endArray();
+        }
+        #endif //SENSOR_STATS
+        writer.endObject();
+
+        #if TELEMETRY_CBOR
+        if (!telemetryPack(writer, (const uint8_t*) cborBuffer.data(), eventBuffer)) return;    //V153/V158
+        #endif //TELEMETRY_CBOR
+
+        #if DRUP_DELTA
+        if (isKeyframe) {drupSinceKeyframe = 0; drupKeyframeTime = millis();}
+        else            drupSinceKeyframe++;
+        drupAddPending(drupSeq, cur);
+        #endif //DRUP_DELTA
+        #if SENSOR_STATS
+        if (eventBuffer.publish(eventregularupd, PRIVATE)) sensorStatsReset();  //V161 a DRUP that is not queued keeps its window
+        #else
+        eventBuffer.publish(eventregularupd, PRIVATE);
+        #endif //SENSOR_STATS
+    }
+}
+
+// helper to set a DRUP snapshot value scaled by 10^decimals of the field V154
+void drupSet(DrupSnapshot& snap, uint8_t field, double value)
+{
+    for (uint8_t k = 0; k < drupFields[field].decimals; k++) value *= 10.0;
+    snap.value[field] = (int32_t) lround(value);
+}
+
+#if STATUS_LEDGER
+// helper to check whether a snapshot differs materially from an earlier one, or only in its state fields if isStateOnly V160
+bool statusChanged(const DrupSnapshot& cur, const DrupSnapshot& last, bool isStateOnly)
+{
+    if (cur.present != last.present) return true;
+    if (cur.hasHubPorts != last.hasHubPorts) return true;
+    if (cur.hasHubPorts && memcmp(cur.lvsun, last.lvsun, sizeof(cur.lvsun)) != 0) return true;
+    for (uint8_t i = 0; i < NUM_DRUP_FIELDS; i++)
+    {
+        if (((cur.present >> i) & 1) == 0) continue;
+        int32_t band = drupFields[i].band;
+        if (isStateOnly && band > 0) continue;                  //measurements are history only in the hourly DRUP
+        if (abs(cur.value[i] - last.value[i]) > band) return true;
+    }
+    return false;
+}
+
+// helper to replace the status Ledger contents with the snapshot, the fields as DRUP would send them V160
+bool statusLedgerSet(const DrupSnapshot& cur)
+{
+    if (!statusledger.isValid()) return false;
+
+    Variant data;
+    char createdAt[CREATED_AT_SIZE];
+    data.set("date", getCreatedTime(createdAt, sizeof(createdAt)));
+    for (uint8_t i = 0; i < NUM_DRUP_FIELDS; i++)
+    {
+        if (((cur.present >> i) & 1) == 0) continue;
+        const DrupFieldDesc& f = drupFields[i];
+        if      (f.flags & DF_BOOL)     data.set(f.name, cur.value[i] != 0);
+        else if (f.flags & DF_CHAR)     {char c[2] = {(char) cur.value[i], 0}; data.set(f.name, (const char*) c);}
+        else if (f.decimals > 0)        {double d = (double) cur.value[i]; for (uint8_t k = 0; k < f.decimals; k++) d /= 10.0; data.set(f.name, d);}
+        else                            data.set(f.name, (int) cur.value[i]);
+    }
+    if (cur.hasHubPorts)
+    {
+        Variant ports;
+        for (int ch = 0; ch < 4; ch++) ports.append(Variant((const char*) cur.lvsun[ch]));
+        data.set("LV0", ports);
+    }
+
+    int err = statusledger.set(data);
+    if (err < 0)
+    {
+        Log.info("Status Ledger set failed: %i - DRUP sent instead", err);
+        return false;
+    }
+    statusSetCount++;
+    return true;
+}
+
+// helper to check the cloud has the last set, a Ledger not yet created in the console never syncs so DRUPs keep going V160
+bool isStatusLedgerSynced()
+{
+    int64_t synced = statusledger.lastSynced();
+    return synced != 0 && synced >= statusledger.lastUpdated();
+}
+#endif //STATUS_LEDGER
+
+#if DRUP_DELTA || RATE_LIMIT
+// publish complete callback - may run on the publish thread so only the acknowledged sequence number and publish count are recorded V154/V159
+void publishCompleteCallback(bool succeeded, const char *eventName, const char *eventData)
+{
+    if (!succeeded || eventName == nullptr || eventData == nullptr) return;
+    #if RATE_LIMIT
+    budgetPublished++;                                          //V159 a coalesced MREC burst is one data operation
+    #endif //RATE_LIMIT
+    #if DRUP_DELTA
+    if (strcmp(eventName, eventregularupd) == 0)
+    {
+        uint32_t seq = drupSequenceOf(eventData);
+        if (seq != 0) drupAckSeq.store(seq);
+    }
+    #if EVENT_COALESCE
+    else if (strcmp(eventName, eventmultirec) == 0)             //V155 DRUP records of a coalesced burst, the last is the newest
+    {
+        size_t nameLen = strlen(eventregularupd);
+        for (const char* rec = eventData; rec != nullptr; rec = strchr(rec, '\n'))
+        {
+            if (*rec == '\n') rec++;
+            if (strncmp(rec, eventregularupd, nameLen) != 0 || rec[nameLen] != '\t') continue;
+            uint32_t seq = drupSequenceOf(rec + nameLen + 1);
+            if (seq != 0) drupAckSeq.store(seq);
+        }
+    }
+    #endif //EVENT_COALESCE
+    #endif //DRUP_DELTA
+}
+#endif //DRUP_DELTA || RATE_LIMIT
+
+#if DRUP_DELTA
+
+// helper to return the SEQ at the start of DRUP event data or 0 if there is none V154
+uint32_t drupSequenceOf(const char* data)
+{
+    if (data == nullptr) return 0;
+    #if TELEMETRY_CBOR
+    uint32_t seq = 0;
+    if (telemetryPeekUint(data, "SEQ", &seq)) return seq;
+    #endif //TELEMETRY_CBOR
+    if (strncmp(data, "{\"SEQ\":", 7) != 0) return 0;
+    return (uint32_t) strtoul(data + 7, nullptr, 10);
+}
+
+// helper called before each DRUP to move the acknowledged baseline on, a keyframe follows if the acknowledged DRUP is no longer held V154
+void drupHandleAck()
+{
+    uint32_t ack = drupAckSeq.load();
+    if (ack == 0 || ack == drupAckHandled) return;
+    drupAckHandled = ack;
+
+    uint8_t i = 0;
+    while (i < drupPendingCount && drupPending[i].seq != ack) i++;
+    if (i == drupPendingCount)
+    {
+        drupAckedSeq = 0;                                       //not held, the cloud state is unknown
+        Log.info("DRUP %lu acknowledged but not held - next DRUP is a keyframe", ack);
+        return;
+    }
+    drupAcked = drupPending[i].snap;
+    drupAckedSeq = ack;
+    i++;                                                        //drop this and any older DRUPs
+    for (uint8_t j = i; j < drupPendingCount; j++) drupPending[j - i] = drupPending[j];
+    drupPendingCount -= i;
+}
+
+// helper to hold a published DRUP until it is acknowledged, the oldest is dropped if full V154
+void drupAddPending(uint32_t seq, const DrupSnapshot& snap)
+{
+    if (drupPendingCount == DRUP_PENDING)
+    {
+        for (uint8_t j = 1; j < DRUP_PENDING; j++) drupPending[j - 1] = drupPending[j];
+        drupPendingCount--;
+    }
+    drupPending[drupPendingCount].seq = seq;
+    drupPending[drupPendingCount].snap = snap;
+    drupPendingCount++;
+}
+
+// save the last DRUP sequence number to RTC RAM V154
+void saveDrupDataToRam()
+{
+    drupdata.magic = DRUP_MAGIC;
+    drupdata.seq = drupSeq;
+    std::memcpy(serializedDData, &drupdata, sizeof(drupData));
+    (void) MCP7940.writeRAM(DRUPDATA_ADDR, serializedDData);
+}
+
+// restore the last DRUP sequence number from RTC RAM, the sequence starts from zero if it is not valid V154
+void restoreDrupDataFromRam()
+{
+    (void) MCP7940.readRAM(DRUPDATA_ADDR, serializedDData);
+    std::memcpy(&drupdata, serializedDData, sizeof(drupData));
+    drupSeq = (drupdata.magic == DRUP_MAGIC) ? drupdata.seq : 0;
+    Log.info("DRUP sequence continues from %lu", drupSeq);
+}
+#endif //DRUP_DELTA
+
+#if RATE_LIMIT
+// fill every rate limit bucket V159
+void setupRateLimits()
+{
+    timer_t now = millis();
+    for (size_t i = 0; i < NUM_RATE_LIMITS; i++)
+    {
+        rateLimits[i].tokens = rateLimits[i].burst;
+        rateLimits[i].lastRefill = now;
+        rateLimits[i].dropped = 0;
+        rateLimits[i].logged = 0;
+    }
+}
+
+// publish filter - false drops the event if its bucket is empty or the budget level stops its priority V159
+bool rateLimitFilter(const char* eventName)
+{
+    size_t i = 0;
+    while (i < NUM_RATE_LIMITS - 1 && strncmp(eventName, rateLimits[i].prefix, strlen(rateLimits[i].prefix)) != 0) i++;
+    RateLimit& rl = rateLimits[i];
+    if (rl.priority == RL_CRITICAL) return true;
+
+    bool isAllowed = false;
+    WITH_LOCK(rateLimitMutex)
+    {
+        timer_t refillMs = rl.refillMs;
+        if (budgetLevel >= BL_AHEAD && rl.priority == RL_LOW)    refillMs *= BUDGET_SLOWDOWN;
+        if (budgetLevel >= BL_OVER && rl.priority == RL_NORMAL)  refillMs *= BUDGET_SLOWDOWN;
+
+        timer_t now = millis();
+        uint32_t add = (now - rl.lastRefill) / refillMs;
+        if (add > 0)
+        {
+            rl.tokens = (uint8_t) min((uint32_t) rl.burst, (uint32_t) rl.tokens + add);
+            rl.lastRefill = (rl.tokens == rl.burst) ? now : rl.lastRefill + add * refillMs;
+        }
+        isAllowed = rl.tokens > 0 && !(budgetLevel >= BL_OVER && rl.priority == RL_LOW);
+        if (isAllowed)  rl.tokens--;
+        else            rl.dropped++;
+    }
+    if (!isAllowed) budgetDropped++;            //logged as a summary by checkDataBudget() so a burst does not flood the log
+    return isAllowed;
+}
+
+// add the publishes since the last check to the month's count, start a new month and set the budget level from the
+// share of the budget for the days of the month so far V159
+void checkDataBudget()
+{
+    static const uint8_t monthDays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    uint32_t published = budgetPublished.exchange(0);
+    uint32_t dropped = budgetDropped.exchange(0);
+    bool isChanged = (published != 0 || dropped != 0);
+    uint8_t level = budgetLevel;
+
+    if (dropped != 0)
+    {
+        for (size_t i = 0; i < NUM_RATE_LIMITS; i++)
+        {
+            uint32_t drops = 0;
+            WITH_LOCK(rateLimitMutex) {drops = rateLimits[i].dropped - rateLimits[i].logged; rateLimits[i].logged = rateLimits[i].dropped;}
+            if (drops != 0) Log.warn("Rate limit dropped %lu %s events", drops, rateLimits[i].prefix[0] != 0 ? rateLimits[i].prefix : "other");
         }
-        PublishQueuePosix::instance().publish(eventregularupd, dataStr, 50, PRIVATE);
     }
+
+    if (Time.isValid())
+    {
+        int month = Time.month();
+        int year = Time.year();
+        if (budgetdata.month != month || budgetdata.year != year)
+        {
+            if (budgetdata.month != 0)                                  //counts from before the time was valid are kept for this month
+            {
+                Log.info("Budget %lu publishes %lu dropped in %u/%u", budgetdata.used, budgetdata.dropped, budgetdata.month, budgetdata.year);
+                budgetdata.used = budgetdata.dropped = 0;
+            }
+            budgetdata.month = (uint8_t) month;
+            budgetdata.year = (uint16_t) year;
+            isChanged = true;
+        }
+        budgetdata.used += published;
+        budgetdata.dropped += dropped;
+        uint32_t days = monthDays[month - 1] + ((month == 2 && year % 4 == 0) ? 1 : 0);
+        uint32_t pace = (uint32_t) ((uint64_t) DATAOPS_BUDGET * Time.day() / days);
+        if      (budgetdata.used >= DATAOPS_BUDGET) level = BL_OVER;
+        else if (budgetdata.used > pace)            level = BL_AHEAD;
+        else                                        level = BL_NORMAL;
+    }
+    else
+    {
+        budgetdata.used += published;
+        budgetdata.dropped += dropped;
+        if (budgetdata.used >= DATAOPS_BUDGET) level = BL_OVER;
+    }
+
+    if (level != budgetLevel)
+    {
+        Log.warn("Budget level %u to %u at %lu publishes", budgetLevel, level, budgetdata.used);
+        WITH_LOCK(rateLimitMutex) {budgetLevel = level;}
+    }
+    if (isChanged) saveBudgetDataToRam();
 }
+#endif //RATE_LIMIT
 
 // network information event when there is a change V069/070
 void networkInfoEvent()
@@ -5079,8 +6573,13 @@ void networkInfoEvent()
 
         if ((activenetwork == (int) EthernetWiFi::ActiveInterface::ETHERNET) || (activenetwork == (int) EthernetWiFi::ActiveInterface::WIFI))  //to avoid an event with only C=1 V072
         {
-            memset(dataStr, 0, sizeof(dataStr));
-            JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+            PublishQueueBuffer eventBuffer;                 //V158
+            #if TELEMETRY_CBOR
+            PublishQueueBuffer cborBuffer;                  //V158
+            TelemetryCBOR writer((uint8_t*) cborBuffer.data(), TELEMETRY_CBOR_SIZE);    //V153
+            #else
+            EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
+            #endif //TELEMETRY_CBOR
             char macAddr[18] = {0};
             char ethAddr[18] = {0};
             char locIP[16] = {0};
@@ -5106,7 +6605,8 @@ void networkInfoEvent()
             }
 
             writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
+            char createdAt[CREATED_AT_SIZE];
+            writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
             writer.name("C").value(1);
             if (macAddr[0] != 0) writer.name("M").value((const char*)macAddr);  //V076
             if (conSSID[0] != 0) writer.name("W").value((const char*)conSSID);
@@ -5115,21 +6615,40 @@ void networkInfoEvent()
             if (bleAddr[0] != 0) writer.name("BLE").value((const char*)bleAddr); //V095
             if (wifiChannel != 0) writer.name("CH").value(wifiChannel);
             writer.endObject();
-            PublishQueuePosix::instance().publish(eventvarchanged, dataStr, 50, PRIVATE);
+            #if TELEMETRY_CBOR
+            if (!telemetryPack(writer, (const uint8_t*) cborBuffer.data(), eventBuffer)) return;    //V153/V158
+            #endif //TELEMETRY_CBOR
+            eventBuffer.publish(eventvarchanged, PRIVATE);
         }
         else    //V089
         {
-            memset(dataStr, 0, sizeof(dataStr));
-            JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+            PublishQueueBuffer eventBuffer;                 //V158
+            EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
             writer.beginObject();
-            writer.name("date").value((const char*)getCreatedTime());
+            char createdAt[CREATED_AT_SIZE];
+            writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
             writer.name("C").value(0);
             writer.endObject();
-            PublishQueuePosix::instance().publish(eventvarchanged, dataStr, 50, PRIVATE);
+            eventBuffer.publish(eventvarchanged, PRIVATE);
         }
     }
 }
 
+#if TELEMETRY_CBOR
+// helper to wrap the CBOR from writer in base85 in the event buffer with the TELEMETRY_PREFIX, returns false if it did not fit V153/V158
+bool telemetryPack(const TelemetryCBOR& writer, const uint8_t* cbor, PublishQueueBuffer& eventBuffer)
+{
+    char* data = eventBuffer.data();
+    data[0] = TELEMETRY_PREFIX;
+    if (writer.isOverflow() || base85Encode(cbor, writer.dataSize(), data + 1, eventBuffer.size() - 1) == 0)
+    {
+        Log.error("Telemetry CBOR %u bytes does not fit", (unsigned) writer.dataSize());
+        return false;
+    }
+    return true;
+}
+#endif //TELEMETRY_CBOR
+
 // this function is automagically called upon a matching POST request aligns with product specification
 int remoteAdmin(const char * command)
 {
@@ -5138,23 +6657,23 @@ int remoteAdmin(const char * command)
     strncpy(num, command, sizeof(num)-1);
     if      (strncmp(command, "stb", 3) == 0)
     {
-        if (runStateInt == W_STANDBY)                           //command not allowed due to runState
+        if (!isWebCommandAllowed(WEB_STB))                      //command not allowed due to runState V145
         {
             return -1;                                          // command error
         }
         else
         {
             prevRunState = runState;
-            runState = D_WEBGOTOSTANDBY;
+            setRunState(D_WEBGOTOSTANDBY);
             return 1;                                           // command OK
         }
     }
     else if (strncmp(command, "rst", 3) == 0)
     {
-        if (runStateInt == W_STANDBY)                           //command only allowed when in standby
+        if (isWebCommandAllowed(WEB_RST))                       //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTORESTART;
+            setRunState(D_WEBGOTORESTART);
             return 3;                                           // command OK
         }
         else
@@ -5164,10 +6683,10 @@ int remoteAdmin(const char * command)
     }
     else if (strncmp(command, "hst", 3) == 0)                   //web factory reset
     {
-        if (runStateInt == W_STANDBY)                           //command only allowed when in standby
+        if (isWebCommandAllowed(WEB_HST))                       //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTOHARDRESTART;
+            setRunState(D_WEBGOTOHARDRESTART);
             return 88;                                          // command OK
         }
         else
@@ -5189,7 +6708,7 @@ int remoteAdmin(const char * command)
                 if (runStateInt == W_STANDBY)                   //command only allowed when in standby
                 {
                     prevRunState = runState;
-                    runState = D_WEBGOTOAUTO;
+                    setRunState(D_WEBGOTOAUTO);
                     return 4;                                   // command OK
                 }
                 else
@@ -5205,7 +6724,7 @@ int remoteAdmin(const char * command)
                 else
                 {
                     prevRunState = runState;                    //removed setting of isOUCMonitoring to the webGoToOUCAutoController
-                    runState = D_WEBOUCAUTO;
+                    setRunState(D_WEBOUCAUTO);
                     return 4;                                   // command OK
                 }
                 break;
@@ -5216,10 +6735,10 @@ int remoteAdmin(const char * command)
     }
     else if (strncmp(command, "tmc", 3) == 0)
     {
-        if (runStateInt == W_STANDBY)       //command only allowed when
+        if (isWebCommandAllowed(WEB_TMC))  //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTOTIMED;
+            setRunState(D_WEBGOTOTIMED);
             return 5;                       // command OK
         }
         else
@@ -5229,10 +6748,10 @@ int remoteAdmin(const char * command)
     }
     else if (strncmp(command, "cnc", 3) == 0)
     {
-        if (runStateInt == W_STANDBY)       //command only allowed when
+        if (isWebCommandAllowed(WEB_CNC))  //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTOON;
+            setRunState(D_WEBGOTOON);
             return 6;                       // command OK
         }
         else
@@ -5242,10 +6761,10 @@ int remoteAdmin(const char * command)
     }
     else if (strncmp(command, "ouc", 3) == 0)
     {
-        if (runStateInt == W_STANDBY)       //command only allowed when
+        if (isWebCommandAllowed(WEB_OUC))  //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTOCHARGED;
+            setRunState(D_WEBGOTOCHARGED);
             return 7;                       // command OK
         }
         else
@@ -5255,10 +6774,10 @@ int remoteAdmin(const char * command)
     }
     else if (strncmp(command, "usb", 3) == 0)
     {
-        if (runStateInt == W_STANDBY)       //command only allowed when
+        if (isWebCommandAllowed(WEB_USB))  //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTOCHARGEDUSBC;
+            setRunState(D_WEBGOTOCHARGEDUSBC);
             return 27;                      // command OK
         }
         else
@@ -5277,7 +6796,7 @@ int remoteAdmin(const char * command)
                 param.isOUCMonitoring = false;
                 putParameters();
                 prevRunState = runState;
-                runState = D_WEBGOTOSTANDBY;
+                setRunState(D_WEBGOTOSTANDBY);
                 return 9;                                   // command OK
             }
             else
@@ -5292,7 +6811,7 @@ int remoteAdmin(const char * command)
                 param.isOUCMonitoring = false;              //V363
                 putParameters();                            //V363
                 prevRunState = runState;                    //removed clearing of isOUCMonitoring to the goToWebOUCAExitController V148E
-                runState = D_WEBOUCAEXIT;
+                setRunState(D_WEBOUCAEXIT);
                 return 9;
             }
             else
@@ -5304,12 +6823,24 @@ int remoteAdmin(const char * command)
             return -9;                                      //V095G
         }
     }
+    else if (strncmp(command, "tsk", 3) == 0)                   //report task scheduler run counts and durations V138
+    {
+        sendTaskReport();
+        return 12;                                              // command OK
+    }
+    #if LOOP_HISTOGRAM
+    else if (strncmp(command, "lat", 3) == 0)                   //report loop stage latency histograms V139
+    {
+        sendLatencyReport();
+        return 13;                                              // command OK
+    }
+    #endif // LOOP_HISTOGRAM
     else if (strncmp(command, "hib", 3) == 0)                   //hibernate device V081
     {
-        if (runStateInt == W_STANDBY)                           //command only allowed when in standby
+        if (isWebCommandAllowed(WEB_HIB))                       //command only allowed when in standby V145
         {
             prevRunState = runState;
-            runState = D_WEBGOTOHIBERNATE;                      //V081
+            setRunState(D_WEBGOTOHIBERNATE);                    //V081
             return 10;                                          // command OK
         }
         else
@@ -5443,7 +6974,7 @@ int remoteParam(const char * command)
             {
                 param.isOUCMonitoring = false;
                 prevRunState = runState;
-                runState = D_WEBOUCAEXIT;
+                setRunState(D_WEBOUCAEXIT);
             }
         }
         putParameters();
@@ -5608,76 +7139,17 @@ int remoteCharge(const char * command)
 // helper function to translate internal runState D_ to cloud var runStateInt for web app W_
 void onViewRunState()
 {
-    switch (runState)
-    {
-    case D_STARTUP:
-    case D_RESTART:
-    case D_STANDBY:
-    case D_GOTOSTANDBY:
-    case D_WEBGOTOSTANDBY:
-    case D_WEBGOTORESTART:
-    case D_WEBGOTOHARDRESTART:
-        runStateInt = W_STANDBY; 
-        break;
-    case D_GOTOSLEEP:
-    case D_SLEEPING:
-    case D_WEBGOTOHIBERNATE: //V081
-        runStateInt = W_SLEEPING;
-        break;
-    case D_WEBGOTOTIMED:
-    case D_TIMED_ON:
-    case D_GOTOTIMED_ON:
-        runStateInt = W_TIMED_ON;
-        break;
-    case D_WEBGOTOAUTO:
-    case D_GOTOAUTO:
-    case D_AUTO_OFF:
-        runStateInt = W_AUTO_OFF;
-        break;
-    case D_AUTO_ON:
-        runStateInt = W_AUTO_ON;
-        break;
-    case D_WEBGOTOON:
-    case D_GOTOALWAYS_ON:
-    case D_ALWAYS_ON:
-        runStateInt = W_ON;
-        break;
-    case D_WEBGOTOCHARGED:
-    case D_CHARGED_ON:
-    case D_GOTOCHARGED_ON:
-        runStateInt = W_CHARGED_ON;
-        break;
-    case D_WEBGOTOCHARGEDUSBC:
-    case D_CHARGED_ON_USBC:
-    case D_GOTOCHARGED_ON_USBC:
-        runStateInt = W_CHARGED_ON_USBC;
-        break;
-    case D_GOTOCHARGED_ON_AUTO:
-    case D_CHARGED_ON_AUTO:
-        runStateInt = W_CHARGED_ON_AUTO;
-        break;
-    case D_GOTOCHARGED_ON_USBC_AUTO:
-    case D_CHARGED_ON_USBC_AUTO:
-        runStateInt = W_CHARGED_ON_USBC_AUTO;
-        break;
-    default:
-        runStateInt = W_STANDBY;
-    }
+    const RunStateDescriptor* d = findRunState(runState);      //V145
+    runStateInt = (d != nullptr) ? d->webState : W_STANDBY;
 }
 
 // test for configuration data sync'd from Cloud to Device Ledger
 void configurationAvailableCheck()
 {
-    static unsigned long lastConfigTime = 0;
-    if (millis() - lastConfigTime > LAST_CONFIG)    // check for configuration every 20 seconds
+    if (isConfigurationAvailable)
     {
-        lastConfigTime = millis();
-
-        if (isConfigurationAvailable)
-        {
-            checkForConfiguration();
-            //Log.info("Configuration Available");
-        }
+        checkForConfiguration();
+        //Log.info("Configuration Available");
     }
 }
 
@@ -5714,13 +7186,14 @@ void checkForConfiguration()
                     }
                     else
                     {
-                        memset(dataStr, 0, sizeof(dataStr));
-                        JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+                        PublishQueueBuffer eventBuffer;                 //V158
+                        EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
                         writer.beginObject();
-                        writer.name("date").value((const char*)getCreatedTime());
+                        char createdAt[CREATED_AT_SIZE];
+                        writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
                         writer.name("CX").value("performConfiguration Error");
                         writer.endObject();
-                        PublishQueuePosix::instance().publish(eventdiagnostic, dataStr, 50, PRIVATE);
+                        eventBuffer.publish(eventdiagnostic, PRIVATE);
                     }
                 }
             }
@@ -6296,13 +7769,14 @@ void getParameters()
     else
     {
         Log.info("getParameters EEPROM Checksum ERROR");
-        memset(dataStr, 0, sizeof(dataStr));
-        JSONBufferWriter writer(dataStr, sizeof(dataStr) - 1);
+        PublishQueueBuffer eventBuffer;                 //V158
+        EventJSONWriter writer(eventBuffer.data(), eventBuffer.size() - 1);
         writer.beginObject();
-        writer.name("date").value((const char*)getCreatedTime());
+        char createdAt[CREATED_AT_SIZE];
+        writer.name("date").value(getCreatedTime(createdAt, sizeof(createdAt)));
         writer.name("CX").value("getParameter Checksum Error");
         writer.endObject();
-        PublishQueuePosix::instance().publish(eventdiagnostic, dataStr, 50, PRIVATE);
+        eventBuffer.publish(eventdiagnostic, PRIVATE);
     }
 }
 
@@ -6570,7 +8044,14 @@ byte sendMessage(uint8_t address, byte cmd, byte channel, const char *message)
 // helper to receive a message from the I2C slave
 String receiveMessage(uint8_t address, uint8_t _channel)
 {
-    size_t length = hubdata.portsIn;                // Set the length of the message to be received based on the number of ports in
+    if (requestMessage(address, _channel) != 0) return String("");    // Return an empty string if the transmission failed
+    delay(10);                                      // Wait for the slave to process the command
+    return readMessage(address);
+}
+
+// helper to send the message command for a channel to the I2C slave, returns 0 on success V147
+byte requestMessage(uint8_t address, uint8_t _channel)
+{
     byte result = 0;
 
     WITH_LOCK(Wire)
@@ -6581,14 +8062,15 @@ String receiveMessage(uint8_t address, uint8_t _channel)
         result = Wire.endTransmission();            // End transmission
     }
 
-    String message = "";                            // Initialize an empty string to store the message
-    if (result != 0)
-    {
-        Log.error("Failed to send message to address: 0x%02X, error code: %d", address, result);
-        return message;                             // Return an empty string if the transmission failed
-    }
+    if (result != 0) Log.error("Failed to send message to address: 0x%02X, error code: %d", address, result);
+    return result;
+}
 
-    delay(10);                                      // Wait for the slave to process the command
+// helper to read the message requested with requestMessage() from the I2C slave V147
+String readMessage(uint8_t address)
+{
+    size_t length = hubdata.portsIn;                // Set the length of the message to be received based on the number of ports in
+    String message = "";                            // Initialize an empty string to store the message
     Wire.requestFrom(address, length);              // Request data from the I2C slave
 
     while (Wire.available())                        // While there is data available